@@ -25,6 +25,12 @@
 #define HEIGHT 8
 #define STRIDE 64
 #define MIN_WIDTH 2
+#define MAX_PASSES 8
+
+// big enough for be_blur_multi to split passes into several sweeps
+#define LARGE_HEIGHT 64
+#define LARGE_STRIDE 8192
+#define LARGE_PASSES 20
 
 static void check_be_blur(BeBlurFunc func)
 {
@@ -64,8 +70,134 @@ static void check_be_blur(BeBlurFunc func)
     report("be_blur");
 }
 
+static void check_be_convert(BeConvertFunc func, const char *name, int max)
+{
+    ALIGN(uint8_t buf_ref[STRIDE * HEIGHT], 32);
+    ALIGN(uint8_t buf_new[STRIDE * HEIGHT], 32);
+    declare_func(void,
+                 uint8_t *buf, ptrdiff_t stride,
+                 size_t width, size_t height);
+
+    if (check_func(func, name)) {
+        for (int w = 1; w <= STRIDE; w++) {
+            memset(buf_ref, 0, sizeof(buf_ref));
+            memset(buf_new, 0, sizeof(buf_new));
+            for (int y = 0; y < HEIGHT; y++) {
+                for (int x = 0; x < w; x++)
+                    buf_ref[y * STRIDE + x] = buf_new[y * STRIDE + x] = rnd() % (max + 1);
+            }
+
+            call_ref(buf_ref, STRIDE, w, HEIGHT);
+            call_new(buf_new, STRIDE, w, HEIGHT);
+
+            if (memcmp(buf_ref, buf_new, sizeof(buf_ref))) {
+                fail();
+                break;
+            }
+        }
+
+        bench_new(buf_new, STRIDE, STRIDE, HEIGHT);
+    }
+
+    report(name);
+}
+
+static void check_be_blur_multi(const BitmapEngine *engine)
+{
+    ALIGN(uint8_t buf_ref[STRIDE * HEIGHT], 32);
+    ALIGN(uint8_t buf_new[STRIDE * HEIGHT], 32);
+    ALIGN(uint16_t tmp[STRIDE * 2 * MAX_PASSES], 32);
+    declare_func(void,
+                 uint8_t *buf, ptrdiff_t stride,
+                 size_t width, size_t height, int passes, uint16_t *tmp);
+
+    if (check_func(engine->be_blur_multi, "be_blur_multi")) {
+        for (int w = MIN_WIDTH; w <= STRIDE; w++) {
+            memset(buf_ref, 0, sizeof(buf_ref));
+            memset(buf_new, 0, sizeof(buf_new));
+            for (int y = 0; y < HEIGHT; y++) {
+                for (int x = 0; x < w - 1; x++)
+                    buf_ref[y * STRIDE + x] = buf_new[y * STRIDE + x] = rnd();
+            }
+
+            // reference is the same blur done pass by pass
+            int passes = 1 + rnd() % MAX_PASSES;
+            for (int i = 0; i < 2 * STRIDE; i++)
+                tmp[i] = rnd();
+            if (passes > 1) {
+                engine->be_blur_pre(buf_ref, STRIDE, w, HEIGHT);
+                for (int i = 1; i < passes; i++)
+                    engine->be_blur(buf_ref, STRIDE, w, HEIGHT, tmp);
+                engine->be_blur_post(buf_ref, STRIDE, w, HEIGHT);
+            }
+            engine->be_blur(buf_ref, STRIDE, w, HEIGHT, tmp);
+
+            for (int i = 0; i < 2 * STRIDE * MAX_PASSES; i++)
+                tmp[i] = rnd();
+            call_new(buf_new, STRIDE, w, HEIGHT, passes, tmp);
+
+            if (memcmp(buf_ref, buf_new, sizeof(buf_ref))) {
+                fail();
+                break;
+            }
+        }
+
+        bench_new(buf_new, STRIDE, STRIDE, HEIGHT, MAX_PASSES, tmp);
+    }
+
+    report("be_blur_multi");
+}
+
+static void check_be_blur_multi_large(const BitmapEngine *engine)
+{
+    static ALIGN(uint8_t buf_ref[LARGE_STRIDE * LARGE_HEIGHT], 32);
+    static ALIGN(uint8_t buf_new[LARGE_STRIDE * LARGE_HEIGHT], 32);
+    static ALIGN(uint16_t tmp[LARGE_STRIDE * 2 * LARGE_PASSES], 32);
+    declare_func(void,
+                 uint8_t *buf, ptrdiff_t stride,
+                 size_t width, size_t height, int passes, uint16_t *tmp);
+
+    if (check_func(engine->be_blur_multi, "be_blur_multi_large")) {
+        int w = LARGE_STRIDE - rnd() % 64;
+        memset(buf_ref, 0, sizeof(buf_ref));
+        memset(buf_new, 0, sizeof(buf_new));
+        for (int y = 0; y < LARGE_HEIGHT; y++) {
+            for (int x = 0; x < w - 1; x++)
+                buf_ref[y * LARGE_STRIDE + x] = buf_new[y * LARGE_STRIDE + x] = rnd();
+        }
+
+        engine->be_blur_pre(buf_ref, LARGE_STRIDE, w, LARGE_HEIGHT);
+        for (int i = 1; i < LARGE_PASSES; i++)
+            engine->be_blur(buf_ref, LARGE_STRIDE, w, LARGE_HEIGHT, tmp);
+        engine->be_blur_post(buf_ref, LARGE_STRIDE, w, LARGE_HEIGHT);
+        engine->be_blur(buf_ref, LARGE_STRIDE, w, LARGE_HEIGHT, tmp);
+
+        // everything past the documented tmp size must stay untouched
+        size_t used = 2 * LARGE_STRIDE *
+            ass_be_blur_group(LARGE_STRIDE, LARGE_PASSES);
+        for (size_t i = 0; i < 2 * LARGE_STRIDE * LARGE_PASSES; i++)
+            tmp[i] = i < used ? rnd() : 0xDEAD;
+        call_new(buf_new, LARGE_STRIDE, w, LARGE_HEIGHT, LARGE_PASSES, tmp);
+
+        if (memcmp(buf_ref, buf_new, sizeof(buf_ref)))
+            fail();
+        for (size_t i = used; i < 2 * LARGE_STRIDE * LARGE_PASSES; i++) {
+            if (tmp[i] != 0xDEAD) {
+                fail();
+                break;
+            }
+        }
+    }
+
+    report("be_blur_multi_large");
+}
+
 void checkasm_check_be_blur(unsigned cpu_flag)
 {
     BitmapEngine engine = ass_bitmap_engine_init(cpu_flag);
     check_be_blur(engine.be_blur);
+    check_be_convert(engine.be_blur_pre, "be_blur_pre", 255);
+    check_be_convert(engine.be_blur_post, "be_blur_post", 64);
+    check_be_blur_multi(&engine);
+    check_be_blur_multi_large(&engine);
 }
@@ -23,10 +23,10 @@
 #include <string.h>
 
 #define HEIGHT 8
-#define DST_STRIDE 64
+#define DST_STRIDE 160
 #define MIN_WIDTH  1
-#define SRC1_STRIDE 96
-#define SRC2_STRIDE 128
+#define SRC1_STRIDE 192
+#define SRC2_STRIDE 224
 
 static void check_blend_bitmaps(BitmapBlendFunc func, const char *name)
 {
@@ -99,10 +99,48 @@ static void check_mul_bitmaps(BitmapMulFunc func)
     report("mul_bitmaps");
 }
 
+static void check_shift_bitmap(BitmapShiftFunc func, const char *name)
+{
+    ALIGN(uint8_t buf_ref[DST_STRIDE * HEIGHT], 32);
+    ALIGN(uint8_t buf_new[DST_STRIDE * HEIGHT], 32);
+    declare_func(void,
+                 uint8_t *buf, ptrdiff_t stride,
+                 size_t width, size_t height, int shift);
+
+    if (check_func(func, name)) {
+        for (int w = MIN_WIDTH; w <= DST_STRIDE; w++) {
+            int h = 1 + rnd() % HEIGHT;
+            int shift = rnd() % 64;
+
+            memset(buf_ref, 0, sizeof(buf_ref));
+            memset(buf_new, 0, sizeof(buf_new));
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++)
+                    buf_ref[y * DST_STRIDE + x] = buf_new[y * DST_STRIDE + x] = rnd();
+            }
+
+            call_ref(buf_ref, DST_STRIDE, w, h, shift);
+            call_new(buf_new, DST_STRIDE, w, h, shift);
+
+            if (memcmp(buf_ref, buf_new, sizeof(buf_ref))) {
+                fail();
+                break;
+            }
+        }
+
+        bench_new(buf_new, DST_STRIDE, DST_STRIDE, HEIGHT, 37);
+    }
+
+    report(name);
+}
+
 void checkasm_check_blend_bitmaps(unsigned cpu_flag)
 {
     BitmapEngine engine = ass_bitmap_engine_init(cpu_flag);
     check_blend_bitmaps(engine.add_bitmaps, "add_bitmaps");
     check_blend_bitmaps(engine.imul_bitmaps, "imul_bitmaps");
     check_mul_bitmaps(engine.mul_bitmaps);
+    check_blend_bitmaps(engine.fix_outline, "fix_outline");
+    check_shift_bitmap(engine.shift_horz, "shift_horz");
+    check_shift_bitmap(engine.shift_vert, "shift_vert");
 }
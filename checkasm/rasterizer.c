@@ -198,15 +198,13 @@ static void check_merge_tile(MergeTileFunc func, const char *name, int tile_size
 
 void checkasm_check_rasterizer(unsigned cpu_flag)
 {
-    BitmapEngine engine[2] = {
-        ass_bitmap_engine_init(cpu_flag),
-        ass_bitmap_engine_init(cpu_flag | ASS_FLAG_LARGE_TILES)
-    };
+    BitmapEngine engine = ass_bitmap_engine_init(cpu_flag);
+    const RasterizerEngine *tiles[2] = { &engine.tile16, &engine.tile32 };
     for (int i = 0; i < 2; i++) {
-        int tile_size = 1 << engine[i].tile_order;
-        check_fill_solid(engine[i].fill_solid, "fill_solid_tile%d", tile_size);
-        check_fill_halfplane(engine[i].fill_halfplane, "fill_halfplane_tile%d", tile_size);
-        check_fill_generic(engine[i].fill_generic, "fill_generic_tile%d", tile_size);
-        check_merge_tile(engine[i].merge, "merge_tile%d", tile_size);
+        int tile_size = 1 << tiles[i]->tile_order;
+        check_fill_solid(tiles[i]->fill_solid, "fill_solid_tile%d", tile_size);
+        check_fill_halfplane(tiles[i]->fill_halfplane, "fill_halfplane_tile%d", tile_size);
+        check_fill_generic(tiles[i]->fill_generic, "fill_generic_tile%d", tile_size);
+        check_merge_tile(tiles[i]->merge, "merge_tile%d", tile_size);
     }
 }
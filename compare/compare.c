@@ -19,9 +19,11 @@
 #include "image.h"
 #include "../libass/ass.h"
 #include "../libass/ass_filesystem.h"
+#include "../libass/ass_threading.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <limits.h>
 
 #if defined(_WIN32) && !defined(__CYGWIN__)
 #include <direct.h>
@@ -321,46 +323,149 @@ Result classify_result(double error)
         return R_FAIL;
 }
 
-static Result process_image(ASS_Renderer *renderer, ASS_Track *track,
-                            const char *input, const char *output,
-                            const char *file, int64_t time,
-                            int scale_x, int scale_y)
+// ways to get the rendered frame, all of which must give the same result
+typedef enum {
+    MODE_FRAME,     // ass_render_frame()
+    MODE_REPEAT,    // again from warm caches, after a frame of another size
+    MODE_SHARED,    // by two renderers sharing a font database, concurrently
+    MODE_BATCH,     // ass_render_frames() on all frames of a size in a row
+    MODE_PREFETCH,  // ass_render_frame() after ass_prefetch() of the frame
+    MODE_ASYNC,     // ass_render_frame_async(), checked while rendering again
+    MODE_MULTI,     // ass_render_frame_multi(), after a renderer at twice the size
+    MODE_COUNT
+} Mode;
+
+static const char *mode_name[MODE_COUNT] = {
+    "frame", "repeat", "shared", "batch", "prefetch", "async", "multi"
+};
+
+typedef struct {
+    ASS_Renderer *renderer;
+    ASS_Renderer *reference;    // plain ass_render_frame(), unless MODE_FRAME
+    ASS_Renderer *shared;       // second renderer of MODE_SHARED and MODE_MULTI
+    ASS_ThreadPool *pool;       // runs the second renderer of MODE_SHARED
+    Mode mode;
+    const char *output;
+    int scale_x, scale_y;
+} Context;
+
+static void print_time(int64_t time)
 {
     uint64_t tm = time;
     unsigned msec = tm % 1000;  tm /= 1000;
     unsigned sec  = tm %   60;  tm /=   60;
     unsigned min  = tm %   60;  tm /=   60;
     printf("  Time %u:%02u:%02u.%03u - ", (unsigned) tm, min, sec, msec);
+}
 
-    char path[4096];
-    snprintf(path, sizeof(path), "%s/%s", input, file);
+static void set_frame_size(const Context *ctx, ASS_Renderer *renderer,
+                           const Image16 *target)
+{
+    ass_set_storage_size(renderer, target->width, target->height);
+    ass_set_frame_size(renderer, ctx->scale_x * target->width,
+                       ctx->scale_y * target->height);
+}
 
+// Check bitwise equality of two frames, returns -1 on allocation failure
+static int same_frame(const ASS_Image *img1, const ASS_Image *img2,
+                      int32_t width, int32_t height)
+{
+    Image8 frame1, frame2;
+    frame1.width  = frame2.width  = width;
+    frame1.height = frame2.height = height;
+    size_t size = 4 * (size_t) width * height;
+    frame1.buffer = malloc(size);
+    frame2.buffer = malloc(size);
+    int res = -1;
+    if (frame1.buffer && frame2.buffer) {
+        blend_all(&frame1, 0, 0, img1);
+        blend_all(&frame2, 0, 0, img2);
+        res = !memcmp(frame1.buffer, frame2.buffer, size);
+    }
+    free(frame1.buffer);
+    free(frame2.buffer);
+    return res;
+}
+
+// Check fuzzy equality of two frames, as done against target images,
+// returns the error of img, -1 on allocation failure
+static double frame_error(const ASS_Image *img, const ASS_Image *ref,
+                          int32_t width, int32_t height)
+{
+    Image8 frame;
     Image16 target;
-    if (!read_png(path, &target)) {
-        printf("PNG reading failed!\n");
-        return R_ERROR;
+    frame.width  = target.width  = width;
+    frame.height = target.height = height;
+    size_t size = (size_t) width * height;
+    frame.buffer = malloc(4 * size);
+    target.buffer = malloc(8 * size);
+    uint16_t *grad = malloc(2 * size);
+    double res = -1;
+    if (frame.buffer && target.buffer && grad) {
+        blend_all(&frame, 0, 0, ref);
+        for (size_t i = 0; i < 4 * size; i++)
+            target.buffer[i] = 257u * frame.buffer[i];
+        calc_grad(&target, grad);
+        if (!compare1(&target, grad, img, NULL, &res))
+            res = -1;
+    }
+    free(frame.buffer);
+    free(target.buffer);
+    free(grad);
+    return res;
+}
+
+static Result check_image(const Context *ctx, ASS_Track *track,
+                          const Image16 *target, const char *file,
+                          int64_t time, const ASS_Image *img)
+{
+    if (ctx->mode == MODE_MULTI) {
+        // rescaled layouts may be off by rounding, but not visibly
+        set_frame_size(ctx, ctx->reference, target);
+        ASS_Image *ref = ass_render_frame(ctx->reference, track, time, NULL);
+        double error = frame_error(img, ref, ctx->scale_x * target->width,
+                                   ctx->scale_y * target->height);
+        if (error < 0) {
+            out_of_memory();
+            return R_ERROR;
+        }
+        if (classify_result(error) > R_BAD) {
+            printf("Differs from ass_render_frame() by %.3f in %s mode!\n",
+                   error, mode_name[ctx->mode]);
+            return R_ERROR;
+        }
+    } else if (ctx->reference) {
+        set_frame_size(ctx, ctx->reference, target);
+        ASS_Image *ref = ass_render_frame(ctx->reference, track, time, NULL);
+        int same = same_frame(img, ref, ctx->scale_x * target->width,
+                              ctx->scale_y * target->height);
+        if (same < 0) {
+            out_of_memory();
+            return R_ERROR;
+        }
+        if (!same) {
+            printf("Differs from ass_render_frame() in %s mode!\n",
+                   mode_name[ctx->mode]);
+            return R_ERROR;
+        }
     }
 
-    uint16_t *grad = malloc(2 * target.width * target.height);
+    uint16_t *grad = malloc(2 * target->width * target->height);
     if (!grad) {
-        free(target.buffer);
         out_of_memory();
         return R_ERROR;
     }
-    calc_grad(&target, grad);
-
-    ass_set_storage_size(renderer, target.width, target.height);
-    ass_set_frame_size(renderer, scale_x * target.width, scale_y * target.height);
-    ASS_Image *img = ass_render_frame(renderer, track, time, NULL);
+    calc_grad(target, grad);
 
+    char path[4096];
     const char *out_file = NULL;
-    if (output) {
-        snprintf(path, sizeof(path), "%s/%s", output, file);
+    if (ctx->output) {
+        snprintf(path, sizeof(path), "%s/%s", ctx->output, file);
         out_file = path;
     }
     double max_err;
-    int res = compare(&target, grad, img, out_file, &max_err, scale_x, scale_y);
-    free(target.buffer);
+    int res = compare(target, grad, img, out_file, &max_err,
+                      ctx->scale_x, ctx->scale_y);
     free(grad);
     if (!res) {
         out_of_memory();
@@ -373,6 +478,127 @@ static Result process_image(ASS_Renderer *renderer, ASS_Track *track,
     return flag;
 }
 
+// Leaves target->buffer NULL on failure
+static bool load_target(const char *input, const char *file, Image16 *target)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", input, file);
+    if (read_png(path, target))
+        return true;
+    target->buffer = NULL;
+    return false;
+}
+
+typedef struct {
+    ASS_Renderer *renderer;
+    ASS_Track *track;
+    int64_t time;
+    ASS_Image *img;
+} RenderJob;
+
+static void render_job(void *priv, int index)
+{
+    RenderJob *job = (RenderJob *) priv + index;
+    job->img = ass_render_frame(job->renderer, job->track, job->time, NULL);
+}
+
+// next is the time of the next image of the track, -1 if there is none
+static Result process_image(const Context *ctx, ASS_Track *track,
+                            const char *input, const char *file,
+                            int64_t time, int64_t next)
+{
+    print_time(time);
+
+    Image16 target;
+    if (!load_target(input, file, &target)) {
+        printf("PNG reading failed!\n");
+        return R_ERROR;
+    }
+
+    ASS_Renderer *renderer = ctx->renderer;
+    set_frame_size(ctx, renderer, &target);
+    ASS_Image *img;
+    switch (ctx->mode) {
+    case MODE_REPEAT:
+        // what is reused must survive a change of the frame size
+        ass_render_frame(renderer, track, time, NULL);
+        ass_set_frame_size(renderer, 2 * ctx->scale_x * target.width,
+                           2 * ctx->scale_y * target.height);
+        ass_render_frame(renderer, track, time, NULL);
+        set_frame_size(ctx, renderer, &target);
+        img = ass_render_frame(renderer, track, time, NULL);
+        break;
+
+    case MODE_SHARED: {
+        set_frame_size(ctx, ctx->shared, &target);
+        RenderJob job[2] = {
+            { renderer, track, time, NULL },
+            { ctx->shared, track, time, NULL },
+        };
+        ass_thread_pool_run(ctx->pool, render_job, job, 2);
+        img = job[0].img;
+        int same = same_frame(job[0].img, job[1].img,
+                              ctx->scale_x * target.width,
+                              ctx->scale_y * target.height);
+        if (same > 0)
+            break;
+        if (same < 0)
+            out_of_memory();
+        else
+            printf("Differs between renderers sharing a font database!\n");
+        free(target.buffer);
+        return R_ERROR;
+    }
+
+    case MODE_PREFETCH:
+        img = ass_render_frame(renderer, track, time, NULL);
+        // overlaps with the check of this frame
+        if (next >= 0)
+            ass_prefetch(renderer, track, next, next + 1);
+        break;
+
+    case MODE_ASYNC:
+        if (ass_render_frame_async(renderer, track, time) < 0) {
+            printf("ass_render_frame_async failed!\n");
+            free(target.buffer);
+            return R_ERROR;
+        }
+        img = ass_render_frame_wait(renderer, NULL);
+        // the frame must survive the rendering of the next one
+        ass_frame_ref(img);
+        if (ass_render_frame_async(renderer, track, time) < 0) {
+            printf("ass_render_frame_async failed!\n");
+            ass_frame_unref(img);
+            free(target.buffer);
+            return R_ERROR;
+        }
+        break;
+
+    case MODE_MULTI: {
+        // laid out at twice the size and rescaled, so only compared fuzzily
+        ass_set_storage_size(ctx->shared, target.width, target.height);
+        ass_set_frame_size(ctx->shared, 2 * ctx->scale_x * target.width,
+                           2 * ctx->scale_y * target.height);
+        ASS_Renderer *renderers[2] = { ctx->shared, renderer };
+        ASS_Image *images[2];
+        ass_render_frame_multi(renderers, 2, track, time, images, NULL);
+        img = images[1];
+        break;
+    }
+
+    default:
+        img = ass_render_frame(renderer, track, time, NULL);
+    }
+
+    Result res = check_image(ctx, track, &target, file, time, img);
+    if (ctx->mode == MODE_ASYNC) {
+        ass_render_frame_wait(renderer, NULL);
+        ass_frame_unref(img);
+    }
+    free(target.buffer);
+    return res;
+}
+
 
 typedef struct {
     char *name;
@@ -431,6 +657,91 @@ static int item_compare(const void *ptr1, const void *ptr2)
     return 0;
 }
 
+// Whether item i + 1 is another image of the subtitle file of item i
+static bool next_image(const ItemList *list, size_t i)
+{
+    const Item *item = &list->items[i];
+    return i + 1 < list->n_items && item[1].time >= 0 &&
+        item[1].prefix == item->prefix &&
+        !memcmp(item[1].name, item->name, item->prefix);
+}
+
+typedef struct {
+    const Context *ctx;
+    ASS_Track *track;
+    const Item *items;
+    const Image16 *targets;
+    Result level, result;
+    unsigned good;
+} Batch;
+
+static void batch_callback(void *data, int index, ASS_Image *img)
+{
+    Batch *batch = data;
+    const Item *item = &batch->items[index];
+    print_time(item->time);
+    Result res = check_image(batch->ctx, batch->track, &batch->targets[index],
+                             item->name, item->time, img);
+    batch->result = FFMAX(batch->result, res);
+    if (res <= batch->level)
+        batch->good++;
+}
+
+// Render the images of one track in batches of frames of the same size
+static Result process_batch(const Context *ctx, ASS_Track *track,
+                            const Item *items, size_t n,
+                            Result level, unsigned *good)
+{
+    Image16 *targets = malloc(n * sizeof(Image16));
+    long long *times = malloc(n * sizeof(long long));
+    if (!targets || !times) {
+        free(targets);
+        free(times);
+        out_of_memory();
+        return R_ERROR;
+    }
+
+    Batch batch = { ctx, track, NULL, NULL, level, R_SAME, 0 };
+    size_t loaded = 0;
+    for (size_t i = 0; i < n;) {
+        if (loaded == i)
+            load_target(items[i].dir, items[i].name, &targets[loaded++]);
+        if (!targets[i].buffer) {
+            print_time(items[i].time);
+            printf("PNG reading failed!\n");
+            batch.result = R_ERROR;
+            i++;
+            continue;
+        }
+
+        size_t end = i + 1;
+        while (end < n && end - i < INT_MAX) {
+            if (loaded == end)
+                load_target(items[end].dir, items[end].name, &targets[loaded++]);
+            if (!targets[end].buffer ||
+                    targets[end].width != targets[i].width ||
+                    targets[end].height != targets[i].height)
+                break;
+            end++;
+        }
+
+        for (size_t j = i; j < end; j++)
+            times[j - i] = items[j].time;
+        set_frame_size(ctx, ctx->renderer, &targets[i]);
+        batch.items = items + i;
+        batch.targets = targets + i;
+        ass_render_frames(ctx->renderer, track, times, end - i,
+                          batch_callback, &batch);
+        for (; i < end; i++)
+            free(targets[i].buffer);
+    }
+    free(targets);
+    free(times);
+
+    *good += batch.good;
+    return batch.result;
+}
+
 
 static bool add_sub_item(ItemList *list, const char *dir, const char *file, size_t len)
 {
@@ -536,7 +847,7 @@ static bool process_input(ItemList *list, const char *path, ASS_Library *lib)
 
 
 enum {
-    OUTPUT, SCALE, LEVEL, INPUT
+    OUTPUT, SCALE, LEVEL, MODE, THREADS, CACHE, EVICTION, DISK_CACHE, INPUT
 };
 
 static int *parse_cmdline(int argc, char *argv[])
@@ -558,6 +869,11 @@ static int *parse_cmdline(int argc, char *argv[])
         case 'o':  index = OUTPUT;   break;
         case 's':  index = SCALE;    break;
         case 'p':  index = LEVEL;    break;
+        case 'm':  index = MODE;     break;
+        case 't':  index = THREADS;  break;
+        case 'c':  index = CACHE;    break;
+        case 'e':  index = EVICTION; break;
+        case 'd':  index = DISK_CACHE; break;
         default:   goto fail;
         }
         if (argv[i][2] || ++i >= argc || pos[index])
@@ -571,12 +887,54 @@ fail:
     free(pos);
     const char *fmt =
         "Usage: %s ([-i] <input-dir>)+ [-o <output-dir>] [-s <scale:1-8>[x<scale:1-8>]] [-p <pass-level:0-3>]\n"
+        "           [-m <mode>] [-t <threads:1-64>] [-c <cache-budget-mb>] [-e lru|scan|cost]\n"
+        "           [-d <disk-cache-dir>]\n"
         "\n"
-        "Scale can be a single uniform scaling factor or a pair of independent horizontal and vertical factors. -s N is equivalent to -s NxN.\n";
+        "Scale can be a single uniform scaling factor or a pair of independent horizontal and vertical factors. -s N is equivalent to -s NxN.\n"
+        "Mode selects how frames are rendered: frame (default), repeat, shared, batch, prefetch, async or multi.\n"
+        "Frames of any mode but frame must also match ass_render_frame() bitwise.\n";
     printf(fmt, argv[0] ? argv[0] : "compare");
     return NULL;
 }
 
+static bool parse_mode(const char *arg, Mode *mode)
+{
+    for (int i = 0; i < MODE_COUNT; i++) {
+        if (!strcmp(arg, mode_name[i])) {
+            *mode = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_policy(const char *arg, ASS_CachePolicy *policy)
+{
+    if (!strcmp(arg, "lru"))
+        *policy = ASS_CACHE_POLICY_LRU;
+    else if (!strcmp(arg, "scan"))
+        *policy = ASS_CACHE_POLICY_SCAN_RESISTANT;
+    else if (!strcmp(arg, "cost"))
+        *policy = ASS_CACHE_POLICY_COST;
+    else
+        return false;
+    return true;
+}
+
+static bool parse_number(const char *arg, int min, int max, int *value)
+{
+    long n = 0;
+    for (const char *c = arg; *c; c++) {
+        if (*c < '0' || *c > '9' || n > max)
+            return false;
+        n = 10 * n + (*c - '0');
+    }
+    if (!*arg || n < min || n > max)
+        return false;
+    *value = n;
+    return true;
+}
+
 static bool parse_scale(const char *arg,  int *scale_x, int *scale_y)
 {
     if (arg[0] < '1' || arg[0] > '8')
@@ -590,6 +948,21 @@ static bool parse_scale(const char *arg,  int *scale_x, int *scale_y)
     return true;
 }
 
+static bool make_dir(const char *path, const char *what)
+{
+    struct stat st;
+    if (stat(path, &st)) {
+        if (mkdir(path, 0755)) {
+            printf("Cannot create %s directory '%s'!\n", what, path);
+            return false;
+        }
+    } else if (!(st.st_mode & S_IFDIR)) {
+        printf("Invalid %s directory '%s'!\n", what, path);
+        return false;
+    }
+    return true;
+}
+
 void msg_callback(int level, const char *fmt, va_list va, void *data)
 {
     if (level > 3)
@@ -606,6 +979,7 @@ int main(int argc, char *argv[])
         return R_ERROR;
 
     ASS_Library *lib = NULL;
+    Context ctx = {0};
     ItemList list = {0};
     int result = R_ERROR;
 
@@ -625,19 +999,42 @@ int main(int argc, char *argv[])
         level = arg[0] - '0';
     }
 
+    Mode mode = MODE_FRAME;
+    if (pos[MODE] && !parse_mode(argv[pos[MODE]], &mode)) {
+        printf("Invalid mode!\n");
+        goto end;
+    }
+
+    int threads = 1;
+    if (pos[THREADS] && !parse_number(argv[pos[THREADS]], 1, 64, &threads)) {
+        printf("Invalid thread count, should be 1-64!\n");
+        goto end;
+    }
+
+    int budget = 0;
+    if (pos[CACHE] && !parse_number(argv[pos[CACHE]], 1, 65536, &budget)) {
+        printf("Invalid cache budget, should be 1-65536!\n");
+        goto end;
+    }
+
+    ASS_CachePolicy policy = ASS_CACHE_POLICY_LRU;
+    if (pos[EVICTION] && !parse_policy(argv[pos[EVICTION]], &policy)) {
+        printf("Invalid eviction policy, should be lru, scan or cost!\n");
+        goto end;
+    }
+
     const char *output = NULL;
     if (pos[OUTPUT]) {
         output = argv[pos[OUTPUT]];
-        struct stat st;
-        if (stat(output, &st)) {
-            if (mkdir(output, 0755)) {
-                printf("Cannot create output directory '%s'!\n", output);
-                goto end;
-            }
-        } else if (!(st.st_mode & S_IFDIR)) {
-            printf("Invalid output directory '%s'!\n", output);
+        if (!make_dir(output, "output"))
+            goto end;
+    }
+
+    const char *disk_cache = NULL;
+    if (pos[DISK_CACHE]) {
+        disk_cache = argv[pos[DISK_CACHE]];
+        if (!make_dir(disk_cache, "disk cache"))
             goto end;
-        }
     }
 
     lib = ass_library_init();
@@ -653,12 +1050,46 @@ int main(int argc, char *argv[])
             goto end;
     }
 
-    ASS_Renderer *renderer = ass_renderer_init(lib);
-    if (!renderer) {
+    ctx.mode = mode;
+    ctx.output = output;
+    ctx.scale_x = scale_x;
+    ctx.scale_y = scale_y;
+    ctx.renderer = ass_renderer_init(lib);
+    bool shared = mode == MODE_SHARED || mode == MODE_MULTI;
+    if (mode != MODE_FRAME)
+        ctx.reference = ass_renderer_init(lib);
+    if (shared)
+        ctx.shared = ass_renderer_init(lib);
+    if (!ctx.renderer || (mode != MODE_FRAME && !ctx.reference) ||
+            (shared && !ctx.shared)) {
         printf("ass_renderer_init failed!\n");
         goto end;
     }
-    ass_set_fonts(renderer, NULL, NULL, ASS_FONTPROVIDER_NONE, NULL, 0);
+    if (shared) {
+        ASS_FontDatabase *db =
+            ass_font_database_init(lib, NULL, NULL, ASS_FONTPROVIDER_NONE, NULL);
+        ctx.pool = ass_thread_pool_create(1);
+        if (!db || !ctx.pool) {
+            ass_font_database_done(db);
+            printf("Cannot set up shared font database!\n");
+            goto end;
+        }
+        ass_set_font_database(ctx.renderer, db);
+        ass_set_font_database(ctx.shared, db);
+        ass_font_database_done(db);
+        ass_set_threads(ctx.shared, threads);
+    } else
+        ass_set_fonts(ctx.renderer, NULL, NULL, ASS_FONTPROVIDER_NONE, NULL, 0);
+    ass_set_threads(ctx.renderer, threads);
+    if (budget)
+        ass_set_cache_budget(ctx.renderer, budget);
+    ass_set_cache_policy(ctx.renderer, policy);
+    if (disk_cache && ass_set_disk_cache(ctx.renderer, disk_cache) < 0) {
+        printf("Cannot use disk cache directory '%s'!\n", disk_cache);
+        goto end;
+    }
+    if (ctx.reference)
+        ass_set_fonts(ctx.reference, NULL, NULL, ASS_FONTPROVIDER_NONE, NULL, 0);
 
     result = 0;
     size_t prefix = 0;
@@ -674,6 +1105,8 @@ int main(int argc, char *argv[])
             if (track) {
                 ass_free_track(track);
                 track = NULL;
+                // the next file starts from scratch, as after a file switch
+                ass_renderer_trim(ctx.renderer);
             }
             prev = name;
             prefix = len;
@@ -688,19 +1121,31 @@ int main(int argc, char *argv[])
             printf("Multiple subtitle files '%.*s.ass'!\n", (int) len, name);
             continue;
         }
+        if (mode == MODE_BATCH) {
+            size_t n = 1;
+            while (next_image(&list, i + n - 1))
+                n++;
+            total += n;
+            if (track) {
+                Result res = process_batch(&ctx, track, list.items + i, n,
+                                           level, &good);
+                result = FFMAX(result, res);
+            }
+            i += n - 1;
+            continue;
+        }
         total++;
         if (!track)
             continue;
-        Result res = process_image(renderer, track, list.items[i].dir, output,
-                                   name, list.items[i].time,
-                                   scale_x, scale_y);
+        int64_t next = next_image(&list, i) ? list.items[i + 1].time : -1;
+        Result res = process_image(&ctx, track, list.items[i].dir,
+                                   name, list.items[i].time, next);
         result = FFMAX(result, res);
         if (res <= level)
             good++;
     }
     if (track)
         ass_free_track(track);
-    ass_renderer_done(renderer);
 
     if (!total) {
         printf("No images found!\n");
@@ -715,6 +1160,13 @@ int main(int argc, char *argv[])
     }
 
 end:
+    if (ctx.renderer)
+        ass_renderer_done(ctx.renderer);
+    if (ctx.reference)
+        ass_renderer_done(ctx.reference);
+    if (ctx.shared)
+        ass_renderer_done(ctx.shared);
+    ass_thread_pool_free(ctx.pool);
     delete_items(&list);
     if (lib)
         ass_library_done(lib);
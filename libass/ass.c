@@ -75,6 +75,7 @@ void ass_free_track(ASS_Track *track)
         free(track->parser_priv->read_order_bitmap);
         free(track->parser_priv->fontname);
         free(track->parser_priv->fontdata);
+        ass_mutex_destroy(track->parser_priv->init_lock);
         free(track->parser_priv);
     }
     free(track->style_format);
@@ -147,7 +148,6 @@ void ass_free_event(ASS_Track *track, int eid)
     free(event->Name);
     free(event->Effect);
     free(event->Text);
-    free(event->render_priv);
 }
 
 void ass_free_style(ASS_Track *track, int sid)
@@ -1774,6 +1774,9 @@ ASS_Track *ass_new_track(ASS_Library *library)
     track->parser_priv = calloc(1, sizeof(ASS_ParserPriv));
     if (!track->parser_priv)
         goto fail;
+    track->parser_priv->init_lock = ass_mutex_create();
+    if (!track->parser_priv->init_lock)
+        goto fail;
     def_sid = ass_alloc_style(track);
     if (def_sid < 0)
         goto fail;
@@ -1792,12 +1795,80 @@ fail:
             ass_free_style(track, def_sid);
             free(track->styles);
         }
+        if (track->parser_priv)
+            ass_mutex_destroy(track->parser_priv->init_lock);
         free(track->parser_priv);
         free(track);
     }
     return NULL;
 }
 
+/**
+ * \brief Copy the header, styles and some events of a track
+ * \param events indices of the events to copy
+ * \return new track or NULL on allocation failure
+ * The copy can be rendered while the original is modified.
+ */
+ASS_Track *ass_copy_track(ASS_Track *track, const int *events, int n_events)
+{
+    ASS_Track *copy = ass_new_track(track->library);
+    if (!copy)
+        return NULL;
+
+    copy->track_type = track->track_type;
+    copy->PlayResX = track->PlayResX;
+    copy->PlayResY = track->PlayResY;
+    copy->Timer = track->Timer;
+    copy->WrapStyle = track->WrapStyle;
+    copy->ScaledBorderAndShadow = track->ScaledBorderAndShadow;
+    copy->Kerning = track->Kerning;
+    copy->YCbCrMatrix = track->YCbCrMatrix;
+    copy->LayoutResX = track->LayoutResX;
+    copy->LayoutResY = track->LayoutResY;
+    copy->parser_priv->header_flags = track->parser_priv->header_flags;
+    copy->parser_priv->feature_flags = track->parser_priv->feature_flags;
+    if (track->Language && !(copy->Language = strdup(track->Language)))
+        goto fail;
+
+    // replace the default style of the new track
+    ass_free_style(copy, 0);
+    copy->n_styles = 0;
+    for (int i = 0; i < track->n_styles; i++) {
+        int sid = ass_alloc_style(copy);
+        if (sid < 0)
+            goto fail;
+        const ASS_Style *src = track->styles + i;
+        ASS_Style *style = copy->styles + sid;
+        *style = *src;
+        style->Name = src->Name ? strdup(src->Name) : NULL;
+        style->FontName = src->FontName ? strdup(src->FontName) : NULL;
+        if ((src->Name && !style->Name) || (src->FontName && !style->FontName))
+            goto fail;
+    }
+    copy->default_style = track->default_style;
+
+    for (int i = 0; i < n_events; i++) {
+        int eid = ass_alloc_event(copy);
+        if (eid < 0)
+            goto fail;
+        const ASS_Event *src = track->events + events[i];
+        ASS_Event *event = copy->events + eid;
+        *event = *src;
+        event->render_priv = NULL;
+        event->Name = src->Name ? strdup(src->Name) : NULL;
+        event->Effect = src->Effect ? strdup(src->Effect) : NULL;
+        event->Text = src->Text ? strdup(src->Text) : NULL;
+        if ((src->Name && !event->Name) || (src->Effect && !event->Effect) ||
+                (src->Text && !event->Text))
+            goto fail;
+    }
+    return copy;
+
+fail:
+    ass_free_track(copy);
+    return NULL;
+}
+
 int ass_track_set_feature(ASS_Track *track, ASS_Feature feature, int enable)
 {
     if (feature >= sizeof(track->parser_priv->feature_flags) * CHAR_BIT || feature < 0)
@@ -1836,10 +1907,17 @@ int ass_track_set_feature(ASS_Track *track, ASS_Feature feature, int enable)
 /**
  * \brief Prepare track for rendering
  */
+/**
+ * \brief Fill in missing track properties before rendering
+ * Renderers may call this concurrently for the same track.
+ */
 void ass_lazy_track_init(ASS_Library *lib, ASS_Track *track)
 {
-    if (track->PlayResX > 0 && track->PlayResY > 0)
+    ass_mutex_lock(track->parser_priv->init_lock);
+    if (track->PlayResX > 0 && track->PlayResY > 0) {
+        ass_mutex_unlock(track->parser_priv->init_lock);
         return;
+    }
     if (track->PlayResX <= 0 && track->PlayResY <= 0) {
         ass_msg(lib, MSGL_WARN,
                "Neither PlayResX nor PlayResY defined. Assuming 384x288");
@@ -1864,4 +1942,5 @@ void ass_lazy_track_init(ASS_Library *lib, ASS_Track *track)
                    "PlayResX undefined, setting to %d", track->PlayResX);
         }
     }
+    ass_mutex_unlock(track->parser_priv->init_lock);
 }
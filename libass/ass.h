@@ -24,7 +24,7 @@
 #include <stdarg.h>
 #include "ass_types.h"
 
-#define LIBASS_VERSION 0x01704000
+#define LIBASS_VERSION 0x01704010
 
 #ifdef __cplusplus
 extern "C" {
@@ -111,6 +111,9 @@ typedef enum {
  *
  * SIMPLE is a fast, font-agnostic shaper that can do only substitutions.
  * COMPLEX is a slower shaper using OpenType for substitutions and positioning.
+ * COMPLEX automatically skips OpenType processing for runs of text
+ * where it is known to have no effect, so plain text is nearly as fast
+ * as with SIMPLE while complex scripts are still shaped correctly.
  *
  * libass uses the best shaper available by default.
  */
@@ -119,6 +122,24 @@ typedef enum {
     ASS_SHAPING_COMPLEX
 } ASS_ShapingLevel;
 
+/**
+ * \brief Eviction policies of the renderer's glyph and bitmap caches.
+ *
+ * LRU drops the least recently used entries first.
+ * SCAN_RESISTANT drops entries used in a single frame before those reused
+ * in later frames, so seeking through a file does not flush what is shown
+ * over and over.
+ * COST keeps entries that are slow to rebuild for their size, like large
+ * blurred signs, longer than cheap ones like plain glyph bitmaps.
+ *
+ * LRU is the default.
+ */
+typedef enum {
+    ASS_CACHE_POLICY_LRU = 0,
+    ASS_CACHE_POLICY_SCAN_RESISTANT,
+    ASS_CACHE_POLICY_COST
+} ASS_CachePolicy;
+
 /**
  * \brief Style override options. See
  * ass_set_selective_style_override_enabled() for details.
@@ -559,6 +580,43 @@ void ass_set_fonts(ASS_Renderer *priv, const char *default_font,
                    const char *default_family, int dfp,
                    const char *config, int update);
 
+/**
+ * \brief Create a font database that several renderers can share.
+ * It holds what ass_set_fonts() sets up for a single renderer: the font
+ * providers with their scanned fonts, the library's embedded fonts, and
+ * caches of loaded fonts and glyph outlines. Renderers attached to the
+ * same database find fonts once and reuse each other's glyphs.
+ * The parameters are the same as for ass_set_fonts().
+ *
+ * \param priv library handle, must outlive the database
+ * \return font database handle or NULL on failure
+ */
+ASS_FontDatabase *ass_font_database_init(ASS_Library *priv,
+                                         const char *default_font,
+                                         const char *default_family,
+                                         int dfp, const char *config);
+
+/**
+ * \brief Release the caller's reference to a font database.
+ * The database is freed once no renderer uses it anymore.
+ * \param db font database handle or NULL
+ */
+void ass_font_database_done(ASS_FontDatabase *db);
+
+/**
+ * \brief Use a shared font database instead of the fonts set up with
+ * ass_set_fonts(). Calling ass_set_fonts() afterwards detaches the
+ * renderer from the shared database again.
+ * Renderers sharing a database may render in parallel from different
+ * threads. They share fonts, glyph outlines and shaping results; only
+ * shaping itself and the construction of shared cache entries take turns.
+ * Images returned before the call stay valid as usual.
+ *
+ * \param priv renderer handle
+ * \param db font database created with the same library as the renderer
+ */
+void ass_set_font_database(ASS_Renderer *priv, ASS_FontDatabase *db);
+
 /**
  * \brief Set selective style override mode.
  * If enabled, the renderer attempts to override the ASS script's styling of
@@ -606,6 +664,67 @@ int ass_fonts_update(ASS_Renderer *priv);
 void ass_set_cache_limits(ASS_Renderer *priv, int glyph_max,
                           int bitmap_max_size);
 
+/**
+ * \brief Set a single memory budget for the renderer's caches.
+ * Instead of fixed limits, the budget is split between the outline, bitmap
+ * and composite caches, and the split follows how much rendering time
+ * each of them saves for the content being rendered.
+ * Calling ass_set_cache_limits() afterwards disables the budget again.
+ *
+ * \param priv renderer handle
+ * \param max_size total size of these caches (in MB),
+ * 0 or negative to go back to the default limits
+ */
+void ass_set_cache_budget(ASS_Renderer *priv, int max_size);
+
+/**
+ * \brief Set the eviction policy of the glyph and bitmap caches.
+ * \param priv renderer handle
+ * \param policy one of ASS_CachePolicy values
+ */
+void ass_set_cache_policy(ASS_Renderer *priv, ASS_CachePolicy policy);
+
+/**
+ * \brief Keep costly rendered bitmaps in a directory across runs.
+ * Blurred and composited glyph runs that took long to render are stored
+ * in files, and are loaded instead of rendered again by any renderer using
+ * the same directory later, e.g. when the same track is rendered at the same
+ * size again. Fonts are identified by their contents, not by file names.
+ * Entries of other libass or FreeType versions are ignored.
+ * libass never deletes files there; the application should prune the
+ * directory as it sees fit. Several processes may share a directory.
+ *
+ * \param priv renderer handle
+ * \param dir path to an existing writable directory, NULL to disable
+ * \return 0 on success, -1 if the directory cannot be used
+ */
+int ass_set_disk_cache(ASS_Renderer *priv, const char *dir);
+
+/**
+ * \brief Release as much memory as possible, e.g. on memory pressure.
+ * Drops all cached data that is not used by images the caller still
+ * holds, including that of the workers of ass_render_frames(), and cancels
+ * ass_prefetch(). Rendering keeps working normally, but the next frames are
+ * slower while caches fill again.
+ *
+ * \param priv renderer handle
+ */
+void ass_renderer_trim(ASS_Renderer *priv);
+
+/**
+ * \brief Set the number of threads the renderer may use internally.
+ * By default, everything is done on the thread calling ass_render_frame.
+ * With more threads, work on very large glyphs and drawings is split
+ * and run concurrently; the result does not change.
+ * The additional threads are started by this call and wait for work
+ * until the renderer is destroyed or this is called again.
+ *
+ * \param priv renderer handle
+ * \param threads maximum number of threads, including the calling one;
+ * 1 disables threading, 0 or negative to use the number of processors
+ */
+void ass_set_threads(ASS_Renderer *priv, int threads);
+
 /**
  * \brief Render a frame, producing a list of ASS_Image.
  * \param priv renderer handle
@@ -613,10 +732,148 @@ void ass_set_cache_limits(ASS_Renderer *priv, int glyph_max,
  * \param now video timestamp in milliseconds
  * \param detect_change compare to the previous call and set to 1
  * if positions may have changed, or set to 2 if content may have changed.
+ *
+ * Several renderers may render the same track at the same time from
+ * different threads, as long as nothing modifies the track meanwhile.
+ * Automatic pruning modifies it, see ass_configure_prune().
+ *
+ * The images are valid until the next frame is rendered, or longer with
+ * ass_frame_ref().
  */
 ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
                             long long now, int *detect_change);
 
+/**
+ * \brief Render a frame with several renderers at once, e.g. to produce
+ * the same subtitles at each frame size of an adaptive bitrate ladder.
+ * Each event is parsed, shaped and laid out once, by the first renderer,
+ * and the others only position, rasterize and composite it at their own
+ * size. This needs renderers sharing a font database (see
+ * ass_set_font_database()) with ASS_HINTING_NONE, the same shaping level,
+ * no selective style overrides, and frame sizes, margins and line spacing
+ * of the same aspect; other renderers render as with ass_render_frame().
+ * Sharing keeps the line breaks of the first renderer and rounds glyph
+ * positions at its size, so results may differ slightly from those of
+ * ass_render_frame(). Put the largest size first for the best accuracy.
+ *
+ * \param renderers distinct renderer handles, each configured as needed
+ * \param n number of renderers
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \param images output, n image lists as ass_render_frame() would return
+ * \param detect_change NULL or output, n values as for ass_render_frame()
+ */
+void ass_render_frame_multi(ASS_Renderer *const *renderers, int n,
+                            ASS_Track *track, long long now,
+                            ASS_Image **images, int *detect_change);
+
+
+/**
+ * \brief Callback receiving the frames of ass_render_frames().
+ * \param data user data passed to ass_render_frames()
+ * \param index index of the frame in the batch
+ * \param images rendered frame, as ass_render_frame() would return it.
+ * Only valid until the callback returns, or longer with ass_frame_ref().
+ */
+typedef void (*ASS_FrameCallback)(void *data, int index, ASS_Image *images);
+
+/**
+ * \brief Render a batch of frames, e.g. for encoding or thumbnails.
+ * The result is the same as calling ass_render_frame() for each timestamp
+ * in turn, but with more than one thread set via ass_set_threads(), frames
+ * are rendered ahead on worker threads. Workers get renderers of their own
+ * with the same settings, which share the font database and are kept for
+ * later calls until the renderer is destroyed. Consecutive frames displaying
+ * a common event subject to collision handling, i.e. not positioned with
+ * \pos or \move, are rendered by the same worker to keep the result
+ * unchanged, so only batches with non-decreasing timestamps can be split
+ * up at all. Frames are rendered by the calling thread alone if the track
+ * is pruned automatically (see ass_configure_prune()).
+ *
+ * \param priv renderer handle
+ * \param track subtitle track, which must not be modified meanwhile
+ * \param times video timestamps in milliseconds
+ * \param n number of timestamps
+ * \param callback called for each frame in order, in the calling thread
+ * \param data user data passed to the callback
+ */
+void ass_render_frames(ASS_Renderer *priv, ASS_Track *track,
+                       const long long *times, int n,
+                       ASS_FrameCallback callback, void *data);
+
+/**
+ * \brief Prepare for rendering a time window, e.g. right after a seek.
+ * Events displayed in [start, end) are rendered on a background thread
+ * and thrown away, filling the renderer's caches, so that ass_render_frame()
+ * later finds glyphs, bitmaps and composites ready. Prefetching stops early
+ * once it has filled a cache up to its limit (see ass_set_cache_limits()),
+ * and runs alongside ass_render_frame(), sharing the renderer's caches.
+ * Animated events are prepared as displayed first.
+ *
+ * A new call cancels the previous one, as does changing any setting of the
+ * renderer. The events to prefetch are copied, so the track may be modified
+ * or freed as soon as this returns, e.g. by feeding it packets after a seek.
+ * Nothing is prefetched without threading support.
+ *
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param start start of the window, video timestamp in milliseconds
+ * \param end end of the window (exclusive), or start to only cancel
+ */
+void ass_prefetch(ASS_Renderer *priv, ASS_Track *track,
+                  long long start, long long end);
+
+/**
+ * \brief Start rendering a frame on a thread of the renderer, e.g. to keep
+ * subtitle rendering off the video presentation path.
+ * The frame is rendered as by ass_render_frame(); get it with
+ * ass_render_frame_wait(). Only one frame is rendered at a time, a call
+ * waits for the previous frame to finish. Until the frame is finished,
+ * the renderer and the track must not be used otherwise, except for
+ * ass_render_frame_ready(), ass_frame_ref() and ass_frame_unref().
+ * Without threading support the frame is rendered right away.
+ *
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \return 0 on success, negative if rendering could not be started
+ */
+int ass_render_frame_async(ASS_Renderer *priv, ASS_Track *track,
+                           long long now);
+
+/**
+ * \brief Check whether the frame of ass_render_frame_async() is finished.
+ * \param priv renderer handle
+ * \return nonzero if ass_render_frame_wait() would return immediately
+ */
+int ass_render_frame_ready(ASS_Renderer *priv);
+
+/**
+ * \brief Wait for the frame of ass_render_frame_async() to finish.
+ * \param priv renderer handle
+ * \param detect_change as for ass_render_frame(), compared to the frame
+ * rendered before
+ * \return the frame, as ass_render_frame() would return it
+ */
+ASS_Image *ass_render_frame_wait(ASS_Renderer *priv, int *detect_change);
+
+/**
+ * \brief Keep a frame beyond the rendering of the next one.
+ * May be called from any thread.
+ * \param images image list returned by a renderer
+ */
+void ass_frame_ref(ASS_Image *images);
+
+/**
+ * \brief Release a frame kept with ass_frame_ref().
+ * May be called from any thread, even while the renderer renders another
+ * frame. This includes frames of ass_render_frames() and
+ * ass_render_frame_wait(). All frames must be released before the renderer
+ * is destroyed.
+ * \param images image list returned by a renderer
+ */
+void ass_frame_unref(ASS_Image *images);
+
 
 /*
  * The following functions operate on track objects and do not need
@@ -756,6 +1013,8 @@ void ass_prune_events(ASS_Track *track, long long deadline);
  * "now - delay" will be deleted. A delay of 0 prunes aggressively.
  * Negative delays disable automatic pruning.
  * Disabled by default (no removal of events from memory).
+ * A track with automatic pruning must not be rendered by several
+ * renderers at the same time.
  */
 void ass_configure_prune(ASS_Track *track, long long delay);
 
@@ -36,68 +36,100 @@
 #include "ass_render.h"
 
 
-static void be_blur_pre(uint8_t *buf, intptr_t stride, intptr_t width, intptr_t height)
+// scratch memory kept between filters, anything larger is freed after use
+#define FILTER_SCRATCH_KEEP (4 << 20)
+
+void ass_filter_context_init(FilterContext *ctx)
 {
-    for (int y = 0; y < height; ++y)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            // This is equivalent to (value * 64 + 127) / 255 for all
-            // values from 0 to 256 inclusive. Assist vectorizing
-            // compilers by noting that all temporaries fit in 8 bits.
-            buf[y * stride + x] =
-                (uint8_t) ((buf[y * stride + x] >> 1) + 1) >> 1;
-        }
-    }
+    ctx->scratch = NULL;
+    ctx->scratch_size = 0;
+    ctx->pool = NULL;
 }
 
-static void be_blur_post(uint8_t *buf, intptr_t stride, intptr_t width, intptr_t height)
+void ass_filter_context_done(FilterContext *ctx)
 {
-    for (int y = 0; y < height; ++y)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            // This is equivalent to (value * 255 + 32) / 64 for all values
-            // from 0 to 96 inclusive, and we only care about 0 to 64.
-            uint8_t value = buf[y * stride + x];
-            buf[y * stride + x] = (value << 2) - (value > 32);
-        }
-    }
+    ass_aligned_free(ctx->scratch);
 }
 
-void ass_synth_blur(const BitmapEngine *engine, Bitmap *bm,
-                    int be, double blur_r2x, double blur_r2y)
+/**
+ * \brief Get temporary memory valid until the next call
+ * \return aligned buffer of at least size bytes, NULL on error
+ */
+void *ass_filter_scratch(const BitmapEngine *engine, FilterContext *ctx, size_t size)
 {
-    if (!bm->buffer)
-        return;
-
-    // Apply gaussian blur
-    if (blur_r2x > 0.001 || blur_r2y > 0.001)
-        ass_gaussian_blur(engine, bm, blur_r2x, blur_r2y);
-
-    if (!be)
-        return;
+    if (size <= ctx->scratch_size)
+        return ctx->scratch;
 
-    // Apply box blur (multiple passes, if requested)
+    // grow geometrically, but not past what is kept between filters
+    size_t grown = ctx->scratch_size + ctx->scratch_size / 2;
+    size = FFMAX(size, FFMIN(grown, FILTER_SCRATCH_KEEP));
     unsigned align = 1 << engine->align_order;
-    size_t size = sizeof(uint16_t) * bm->stride * 2;
-    uint16_t *tmp = ass_aligned_alloc(align, size, false);
-    if (!tmp)
+    void *scratch = ass_aligned_alloc(align, size, false);
+    if (!scratch)
+        return NULL;
+    ass_aligned_free(ctx->scratch);
+    ctx->scratch = scratch;
+    ctx->scratch_size = size;
+    return scratch;
+}
+
+/**
+ * \brief Give back scratch memory not worth keeping for the next filter
+ * Huge blurs are rare, but would otherwise hold their memory for good.
+ */
+static void release_filter_scratch(FilterContext *ctx)
+{
+    if (ctx->scratch_size <= FILTER_SCRATCH_KEEP)
         return;
+    ass_aligned_free(ctx->scratch);
+    ctx->scratch = NULL;
+    ctx->scratch_size = 0;
+}
 
+static void be_blur(const BitmapEngine *engine, FilterContext *ctx,
+                    Bitmap *bm, int be)
+{
     int32_t w = bm->w;
     int32_t h = bm->h;
     ptrdiff_t stride = bm->stride;
     uint8_t *buf = bm->buffer;
+
+    int group = engine->be_blur_multi ? ass_be_blur_group(stride, be) : 1;
+    size_t size = sizeof(uint16_t) * stride * 2 * group;
+    uint16_t *tmp = ass_filter_scratch(engine, ctx, size);
+    if (!tmp)
+        return;
+
+    if (engine->be_blur_multi) {
+        engine->be_blur_multi(buf, stride, w, h, be, tmp);
+        return;
+    }
+
     if (--be) {
-        be_blur_pre(buf, stride, w, h);
+        engine->be_blur_pre(buf, stride, w, h);
         do {
             engine->be_blur(buf, stride, w, h, tmp);
         } while (--be);
-        be_blur_post(buf, stride, w, h);
+        engine->be_blur_post(buf, stride, w, h);
     }
     engine->be_blur(buf, stride, w, h, tmp);
-    ass_aligned_free(tmp);
+}
+
+void ass_synth_blur(const BitmapEngine *engine, FilterContext *ctx, Bitmap *bm,
+                    int be, double blur_r2x, double blur_r2y)
+{
+    if (!bm->buffer)
+        return;
+
+    // Apply gaussian blur
+    if (blur_r2x > 0.001 || blur_r2y > 0.001)
+        ass_gaussian_blur(engine, ctx, bm, blur_r2x, blur_r2y);
+
+    // Apply box blur (multiple passes, if requested)
+    if (be)
+        be_blur(engine, ctx, bm, be);
+
+    release_filter_scratch(ctx);
 }
 
 bool ass_alloc_bitmap(const BitmapEngine *engine, Bitmap *bm,
@@ -146,8 +178,15 @@ bool ass_copy_bitmap(const BitmapEngine *engine, Bitmap *dst, const Bitmap *src)
     return true;
 }
 
+/**
+ * \brief Rasterize outlines into a new bitmap
+ * \param window in: part of the plane to rasterize (full pixel units),
+ * outlines are clipped against it; NULL to rasterize them entirely
+ * \return false on error or if nothing lies within the window
+ */
 bool ass_outline_to_bitmap(RenderContext *state, Bitmap *bm,
-                           ASS_Outline *outline1, ASS_Outline *outline2)
+                           ASS_Outline *outline1, ASS_Outline *outline2,
+                           const ASS_Rect *window)
 {
     ASS_Renderer *render_priv = state->renderer;
     RasterizerData *rst = &state->rasterizer;
@@ -167,10 +206,19 @@ bool ass_outline_to_bitmap(RenderContext *state, Bitmap *bm,
     int32_t y_min = (rst->bbox.y_min -   1) >> 6;
     int32_t x_max = (rst->bbox.x_max + 127) >> 6;
     int32_t y_max = (rst->bbox.y_max + 127) >> 6;
+    if (window) {
+        x_min = FFMAX(x_min, window->x_min);
+        y_min = FFMAX(y_min, window->y_min);
+        x_max = FFMIN(x_max, window->x_max);
+        y_max = FFMIN(y_max, window->y_max);
+        if (x_min >= x_max || y_min >= y_max)
+            return false;
+    }
     int32_t w = x_max - x_min;
     int32_t h = y_max - y_min;
 
-    int mask = (1 << render_priv->engine.tile_order) - 1;
+    const RasterizerEngine *engine = ass_rasterizer_select(&render_priv->engine, rst);
+    int mask = (1 << engine->tile_order) - 1;
 
     // XXX: is that possible to trigger at all?
     if (w < 0 || h < 0 || w > INT_MAX - mask || h > INT_MAX - mask) {
@@ -186,7 +234,7 @@ bool ass_outline_to_bitmap(RenderContext *state, Bitmap *bm,
     bm->left = x_min;
     bm->top  = y_min;
 
-    if (!ass_rasterizer_fill(&render_priv->engine, rst, bm->buffer,
+    if (!ass_rasterizer_fill(engine, rst, bm->buffer,
                              x_min, y_min, bm->stride, tile_h, bm->stride)) {
         ass_msg(render_priv->library, MSGL_WARN, "Failed to rasterize glyph!\n");
         ass_free_bitmap(bm);
@@ -202,7 +250,7 @@ bool ass_outline_to_bitmap(RenderContext *state, Bitmap *bm,
  * The glyph bitmap is subtracted from outline bitmap. This way looks much
  * better in some cases.
  */
-void ass_fix_outline(Bitmap *bm_g, Bitmap *bm_o)
+void ass_fix_outline(const BitmapEngine *engine, Bitmap *bm_g, Bitmap *bm_o)
 {
     if (!bm_g->buffer || !bm_o->buffer)
         return;
@@ -211,50 +259,28 @@ void ass_fix_outline(Bitmap *bm_g, Bitmap *bm_o)
     int32_t t = FFMAX(bm_o->top,  bm_g->top);
     int32_t r = FFMIN(bm_o->left + bm_o->stride, bm_g->left + bm_g->stride);
     int32_t b = FFMIN(bm_o->top  + bm_o->h,      bm_g->top  + bm_g->h);
+    if (r <= l || b <= t)
+        return;
 
     uint8_t *g = bm_g->buffer + (t - bm_g->top) * bm_g->stride + (l - bm_g->left);
     uint8_t *o = bm_o->buffer + (t - bm_o->top) * bm_o->stride + (l - bm_o->left);
-
-    for (int32_t y = 0; y < b - t; y++) {
-        for (int32_t x = 0; x < r - l; x++)
-            o[x] = (o[x] > g[x]) ? o[x] - (g[x] / 2) : 0;
-        g += bm_g->stride;
-        o += bm_o->stride;
-    }
+    engine->fix_outline(o, bm_o->stride, g, bm_g->stride, r - l, b - t);
 }
 
 /**
  * \brief Shift a bitmap by the fraction of a pixel in x and y direction
  * expressed in 26.6 fixed point
  */
-void ass_shift_bitmap(Bitmap *bm, int shift_x, int shift_y)
+void ass_shift_bitmap(const BitmapEngine *engine, Bitmap *bm,
+                      int shift_x, int shift_y)
 {
     assert((shift_x & ~63) == 0 && (shift_y & ~63) == 0);
 
-    if (!bm->buffer)
+    if (!bm->buffer || !bm->w || !bm->h)
         return;
 
-    int32_t w = bm->w, h = bm->h;
-    ptrdiff_t s = bm->stride;
-    uint8_t *buf = bm->buffer;
-
-    // Shift in x direction
     if (shift_x)
-        for (int32_t y = 0; y < h; y++) {
-            for (int32_t x = w - 1; x > 0; x--) {
-                uint8_t b = buf[x + y * s - 1] * shift_x >> 6;
-                buf[x + y * s - 1] -= b;
-                buf[x + y * s] += b;
-            }
-        }
-
-    // Shift in y direction
+        engine->shift_horz(bm->buffer, bm->stride, bm->w, bm->h, shift_x);
     if (shift_y)
-        for (int32_t x = 0; x < w; x++) {
-            for (int32_t y = h - 1; y > 0; y--) {
-                uint8_t b = buf[x + y * s - s] * shift_y >> 6;
-                buf[x + y * s - s] -= b;
-                buf[x + y * s] += b;
-            }
-        }
+        engine->shift_vert(bm->buffer, bm->stride, bm->w, bm->h, shift_y);
 }
@@ -26,6 +26,7 @@
 #include "ass.h"
 #include "ass_outline.h"
 #include "ass_bitmap_engine.h"
+#include "ass_threading.h"
 
 typedef struct {
     int32_t left, top;
@@ -34,6 +35,17 @@ typedef struct {
     uint8_t *buffer;      // h * stride buffer
 } Bitmap;
 
+// state reused by bitmap filters between calls
+typedef struct {
+    void *scratch;        // aligned temporary memory
+    size_t scratch_size;
+    ASS_ThreadPool *pool; // see ass_set_threads(), NULL if none
+} FilterContext;
+
+void ass_filter_context_init(FilterContext *ctx);
+void ass_filter_context_done(FilterContext *ctx);
+void *ass_filter_scratch(const BitmapEngine *engine, FilterContext *ctx, size_t size);
+
 bool ass_alloc_bitmap(const BitmapEngine *engine, Bitmap *bm, int32_t w, int32_t h, bool zero);
 bool ass_realloc_bitmap(const BitmapEngine *engine, Bitmap *bm, int32_t w, int32_t h);
 bool ass_copy_bitmap(const BitmapEngine *engine, Bitmap *dst, const Bitmap *src);
@@ -42,13 +54,17 @@ void ass_free_bitmap(Bitmap *bm);
 struct render_context;
 
 bool ass_outline_to_bitmap(struct render_context *state, Bitmap *bm,
-                           ASS_Outline *outline1, ASS_Outline *outline2);
+                           ASS_Outline *outline1, ASS_Outline *outline2,
+                           const ASS_Rect *window);
 
-void ass_synth_blur(const BitmapEngine *engine, Bitmap *bm,
+void ass_synth_blur(const BitmapEngine *engine, FilterContext *ctx, Bitmap *bm,
                     int be, double blur_r2x, double blur_r2y);
 
-bool ass_gaussian_blur(const BitmapEngine *engine, Bitmap *bm, double r2x, double r2y);
-void ass_shift_bitmap(Bitmap *bm, int shift_x, int shift_y);
-void ass_fix_outline(Bitmap *bm_g, Bitmap *bm_o);
+bool ass_gaussian_blur(const BitmapEngine *engine, FilterContext *ctx,
+                       Bitmap *bm, double r2x, double r2y);
+int ass_gaussian_blur_padding(double r2);
+void ass_shift_bitmap(const BitmapEngine *engine, Bitmap *bm,
+                      int shift_x, int shift_y);
+void ass_fix_outline(const BitmapEngine *engine, Bitmap *bm_g, Bitmap *bm_o);
 
 #endif                          /* LIBASS_BITMAP_H */
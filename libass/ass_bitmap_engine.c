@@ -32,9 +32,8 @@
     MergeTileFunc         ass_merge_tile          ## tile_size ## _ ## suffix;
 
 #define RASTERIZER_FUNCTION(name, suffix) \
-    engine.name = mask & ASS_FLAG_LARGE_TILES ? \
-        ass_ ## name ## _tile32_ ## suffix : \
-        ass_ ## name ## _tile16_ ## suffix;
+    engine.tile16.name = ass_ ## name ## _tile16_ ## suffix; \
+    engine.tile32.name = ass_ ## name ## _tile32_ ## suffix;
 
 #define RASTERIZER_FUNCTIONS(suffix) \
     RASTERIZER_FUNCTION(fill_solid,     suffix) \
@@ -47,7 +46,12 @@
     BitmapBlendFunc ass_add_bitmaps_  ## suffix; \
     BitmapBlendFunc ass_imul_bitmaps_ ## suffix; \
     BitmapMulFunc   ass_mul_bitmaps_  ## suffix; \
-    BeBlurFunc      ass_be_blur_      ## suffix;
+    BitmapBlendFunc ass_fix_outline_  ## suffix; \
+    BitmapShiftFunc ass_shift_horz_   ## suffix; \
+    BitmapShiftFunc ass_shift_vert_   ## suffix; \
+    BeBlurFunc      ass_be_blur_      ## suffix; \
+    BeConvertFunc   ass_be_blur_pre_  ## suffix; \
+    BeConvertFunc   ass_be_blur_post_ ## suffix;
 
 #define GENERIC_FUNCTION(name, suffix) \
     engine.name = ass_ ## name ## _ ## suffix;
@@ -56,7 +60,12 @@
     GENERIC_FUNCTION(add_bitmaps,  suffix) \
     GENERIC_FUNCTION(imul_bitmaps, suffix) \
     GENERIC_FUNCTION(mul_bitmaps,  suffix) \
-    GENERIC_FUNCTION(be_blur,      suffix)
+    GENERIC_FUNCTION(fix_outline,  suffix) \
+    GENERIC_FUNCTION(shift_horz,   suffix) \
+    GENERIC_FUNCTION(shift_vert,   suffix) \
+    GENERIC_FUNCTION(be_blur,      suffix) \
+    GENERIC_FUNCTION(be_blur_pre,  suffix) \
+    GENERIC_FUNCTION(be_blur_post, suffix)
 
 
 #define PARAM_BLUR_SET(suffix) \
@@ -123,7 +132,7 @@ unsigned ass_get_cpu_flags(unsigned mask)
     ass_get_cpuid(&eax, &ebx, &ecx, &edx);
     uint32_t max_leaf = eax;
 
-    bool avx = false;
+    bool avx = false, avx512 = false;
     if (max_leaf >= 1) {
         eax = 1;
         ass_get_cpuid(&eax, &ebx, &ecx, &edx);
@@ -141,6 +150,11 @@ unsigned ass_get_cpu_flags(unsigned mask)
             if (xcr0l & (1 << 1) &&  // XSAVE for XMM
                 xcr0l & (1 << 2))    // XSAVE for YMM
                     avx = true;
+            if (avx &&
+                xcr0l & (1 << 5) &&  // XSAVE for opmask
+                xcr0l & (1 << 6) &&  // XSAVE for upper halves of ZMM0-15
+                xcr0l & (1 << 7))    // XSAVE for ZMM16-31
+                    avx512 = true;
         }
     }
 
@@ -149,6 +163,13 @@ unsigned ass_get_cpu_flags(unsigned mask)
         ass_get_cpuid(&eax, &ebx, &ecx, &edx);
         if (avx && ebx & (1 << 5))  // AVX2
             flags |= ASS_CPU_FLAG_X86_AVX2;
+        if (avx512 &&
+            ebx & (1 << 5) &&   // AVX2
+            ebx & (1 << 8) &&   // BMI2
+            ebx & (1 << 16) &&  // AVX512F
+            ebx & (1 << 30) &&  // AVX512BW
+            ebx & (1u << 31))   // AVX512VL
+                flags |= ASS_CPU_FLAG_X86_AVX512;
     }
 
 #endif
@@ -164,8 +185,13 @@ BitmapEngine ass_bitmap_engine_init(unsigned mask)
 {
     ALL_PROTOTYPES(16, c)
     BLUR_PROTOTYPES(32, c)
+    BeBlurMultiFunc ass_be_blur_multi_c;
     BitmapEngine engine = {0};
-    engine.tile_order = mask & ASS_FLAG_LARGE_TILES ? 5 : 4;
+    engine.min_tile_order = mask & ASS_FLAG_LARGE_TILES ? 5 : 4;
+    engine.max_tile_order =
+        mask & (ASS_FLAG_LARGE_TILES | ASS_FLAG_ADAPTIVE_TILES) ? 5 : 4;
+    engine.tile16.tile_order = 4;
+    engine.tile32.tile_order = 5;
 
 #if CONFIG_ASM
     unsigned flags = ass_get_cpu_flags(mask);
@@ -173,6 +199,19 @@ BitmapEngine ass_bitmap_engine_init(unsigned mask)
     if (flags & ASS_CPU_FLAG_X86_AVX2) {
         ALL_PROTOTYPES(32, avx2)
         ALL_FUNCTIONS(5, 32, avx2)
+#if ARCH_X86_64
+        // AVX-512 only replaces the blending functions: they work on rows
+        // of any width with masked tails. Rasterizer and blur kernels are
+        // tied to align_order (tile sizes, 32-byte blur stripes), and
+        // 64-byte stripes would double the padding of every bitmap, so
+        // those stay on AVX2.
+        if (flags & ASS_CPU_FLAG_X86_AVX512) {
+            GENERIC_PROTOTYPES(avx512)
+            GENERIC_FUNCTION(add_bitmaps,  avx512)
+            GENERIC_FUNCTION(imul_bitmaps, avx512)
+            GENERIC_FUNCTION(mul_bitmaps,  avx512)
+        }
+#endif
         return engine;
     } else if (flags & ASS_CPU_FLAG_X86_SSE2) {
         ALL_PROTOTYPES(16, sse2)
@@ -196,7 +235,10 @@ BitmapEngine ass_bitmap_engine_init(unsigned mask)
 #endif
 #endif
 
+    // assembly engines keep their faster pass-by-pass be_blur,
+    // the fused kernel only beats the C one
     ALL_FUNCTIONS(4, 16, c)
+    engine.be_blur_multi = ass_be_blur_multi_c;
     if (mask & ASS_FLAG_WIDE_STRIPE) {
         BLUR_FUNCTIONS(5, 32, c)
     }
@@ -25,7 +25,7 @@
 /*
  * All of these routines require some basic preconditions about their args:
  * - Widths and heights must be > 0
- * - For be_blur, width and height must be > 1
+ * - For be_blur and be_blur_multi, width and height must be > 1
  * - All strides must be multiples of the engine alignment
  * - All buffers, except for BitmapBlendFunc and sources of BitmapMulFunc,
  *   must be aligned to the engine alignment
@@ -48,8 +48,31 @@ typedef void BitmapMulFunc(uint8_t *restrict dst, ptrdiff_t dst_stride,
                            const uint8_t *restrict src2, ptrdiff_t src2_stride,
                            size_t width, size_t height);
 
+typedef void BitmapShiftFunc(uint8_t *buf, ptrdiff_t stride,
+                             size_t width, size_t height, int shift);
+
 typedef void BeBlurFunc(uint8_t *restrict buf, ptrdiff_t stride,
                         size_t width, size_t height, uint16_t *restrict tmp);
+typedef void BeConvertFunc(uint8_t *buf, ptrdiff_t stride,
+                           size_t width, size_t height);
+// tmp must hold 2 * ass_be_blur_group(stride, passes) * stride elements
+typedef void BeBlurMultiFunc(uint8_t *restrict buf, ptrdiff_t stride,
+                             size_t width, size_t height, int passes,
+                             uint16_t *restrict tmp);
+
+#define BE_SWEEP_CACHE_SIZE  (128 * 1024)  // working set budget of fused passes
+
+/**
+ * \brief Number of passes be_blur_multi runs per sweep over the bitmap
+ * Every pass of a sweep keeps one bitmap row and two accumulator rows hot.
+ */
+static inline int ass_be_blur_group(ptrdiff_t stride, int passes)
+{
+    ptrdiff_t group = BE_SWEEP_CACHE_SIZE / (5 * stride);
+    if (group < 1)
+        return 1;
+    return group < passes ? group : passes;
+}
 
 // intermediate bitmaps represented as sets of vertical stripes of int16_t[alignment / 2]
 typedef void Convert8to16Func(int16_t *restrict dst, const uint8_t *restrict src,
@@ -62,22 +85,35 @@ typedef void ParamFilterFunc(int16_t *restrict dst, const int16_t *restrict src,
                              size_t src_width, size_t src_height,
                              const int16_t *restrict param);
 
+// rasterizer functions for one tile size
 typedef struct {
-    int align_order;  // log2(alignment)
-
-    // rasterizer functions
     int tile_order;  // log2(tile_size)
     FillSolidTileFunc *fill_solid;
     FillHalfplaneTileFunc *fill_halfplane;
     FillGenericTileFunc *fill_generic;
     MergeTileFunc *merge;
+} RasterizerEngine;
+
+typedef struct {
+    int align_order;  // log2(alignment)
+
+    // rasterizer functions, selected per outline by ass_rasterizer_select()
+    int min_tile_order;  // 5 with ASS_FLAG_LARGE_TILES, 4 otherwise
+    int max_tile_order;  // 4 without ASS_FLAG_LARGE_TILES/ADAPTIVE_TILES, 5 otherwise
+    RasterizerEngine tile16, tile32;
 
     // blend functions
     BitmapBlendFunc *add_bitmaps, *imul_bitmaps;
     BitmapMulFunc *mul_bitmaps;
 
-    // be blur function
+    // border and shadow functions
+    BitmapBlendFunc *fix_outline;  // dst is the border, src is the glyph
+    BitmapShiftFunc *shift_horz, *shift_vert;  // shift in 1/64 pixel, [0, 64)
+
+    // be blur functions
     BeBlurFunc *be_blur;
+    BeConvertFunc *be_blur_pre, *be_blur_post;
+    BeBlurMultiFunc *be_blur_multi;  // complete \be, NULL to go pass by pass
 
     // gaussian blur functions
     Convert8to16Func *stripe_unpack;
@@ -93,12 +129,14 @@ enum {
     ASS_CPU_FLAG_X86_SSE2      = 0x0001,
     ASS_CPU_FLAG_X86_SSSE3     = 0x0002,
     ASS_CPU_FLAG_X86_AVX2      = 0x0004,
+    ASS_CPU_FLAG_X86_AVX512    = 0x0008,  // F, BW, VL and BMI2; blending only
 #elif ARCH_AARCH64
     ASS_CPU_FLAG_ARM_NEON      = 0x0001,
 #endif
     ASS_CPU_FLAG_ALL           = 0x0FFF,
-    ASS_FLAG_LARGE_TILES       = 0x1000,
+    ASS_FLAG_LARGE_TILES       = 0x1000,  // never use small tiles
     ASS_FLAG_WIDE_STRIPE       = 0x2000,  // for C version only
+    ASS_FLAG_ADAPTIVE_TILES    = 0x4000,  // choose tile size per outline
 };
 
 unsigned ass_get_cpu_flags(unsigned mask);
@@ -24,6 +24,14 @@
 
 #include "ass_utils.h"
 #include "ass_bitmap.h"
+#include "ass_threading.h"
+
+
+// Parallel blur: bitmaps of at least PARALLEL_MIN_SIZE pixels are split
+// into groups of at least MIN_GROUP_STRIPES stripes processed concurrently
+#define PARALLEL_MIN_SIZE  (512 * 512)
+#define MIN_GROUP_STRIPES  4
+#define MAX_GROUPS  16
 
 
 /*
@@ -165,12 +173,156 @@ static void find_best_method(BlurMethod *blur, double r2)
         blur->coeff[i] = (int) (0x10000 * mu[i] + 0.5);
 }
 
+/**
+ * \brief Distance in pixels by which ass_gaussian_blur() extends the bitmap
+ * \param r2 in: standard deviation along the axis squared
+ */
+int ass_gaussian_blur_padding(double r2)
+{
+    BlurMethod blur;
+    find_best_method(&blur, r2);
+    return ((blur.radius + 4) << blur.level) - 4;
+}
+
+/*
+ * Parallel Filter Passes
+ *
+ * Vertical filters and unpacking treat every stripe independently,
+ * so a pass is split into groups of stripes that run concurrently.
+ * Horizontal filters mix neighboring stripes: each group filters
+ * the part of the source it depends on into private memory
+ * and copies its own stripes out of there.
+ * Group boundaries are even, which keeps source pointers
+ * of all filters aligned and matches the 2x stripe ratio of expand_horz.
+ */
+
+typedef enum {
+    PASS_UNPACK,
+    PASS_VERT,
+    PASS_SHRINK_HORZ,
+    PASS_EXPAND_HORZ,
+    PASS_BLUR_HORZ,
+} PassType;
+
+typedef struct {
+    const BitmapEngine *engine;
+    PassType type;
+    FilterFunc *filter;
+    ParamFilterFunc *param_filter;
+    const int16_t *param;
+    int radius;  // of param_filter
+
+    int16_t *dst;
+    const int16_t *src;
+    const uint8_t *bitmap;  // source of PASS_UNPACK
+    ptrdiff_t bitmap_stride;
+    size_t src_width, src_height, dst_height;
+
+    size_t stripe_width;
+    int n_groups;
+    ASS_ThreadPool *pool;
+    size_t bound[MAX_GROUPS + 1];  // destination stripe range of each group
+    int16_t *group_tmp;  // private memory of horizontal filters
+    size_t group_tmp_size;
+} FilterPass;
+
+/**
+ * \brief Filter part of the source starting at given stripe
+ */
+static void apply_filter(const FilterPass *pass, int16_t *dst,
+                         size_t src_stripe, size_t width)
+{
+    size_t sw = pass->stripe_width, height = pass->src_height;
+    if (pass->type == PASS_UNPACK) {
+        pass->engine->stripe_unpack(dst, pass->bitmap + src_stripe * sw,
+                                    pass->bitmap_stride, width, height);
+        return;
+    }
+    const int16_t *src = pass->src + src_stripe * sw * height;
+    if (pass->filter)
+        pass->filter(dst, src, width, height);
+    else
+        pass->param_filter(dst, src, width, height, pass->param);
+}
+
+static void filter_group(void *priv, int index)
+{
+    const FilterPass *pass = priv;
+    size_t sw = pass->stripe_width;
+    size_t dst_step = sw * pass->dst_height;
+    size_t beg = pass->bound[index], end = pass->bound[index + 1];
+
+    // first source stripe needed, first destination stripe computed from it
+    // and the end of needed source stripes
+    size_t src_beg, dst_beg, src_end;
+    switch (pass->type) {
+    case PASS_SHRINK_HORZ:
+        src_beg = beg ? 2 * beg - 2 : 0;
+        dst_beg = src_beg / 2;
+        src_end = 2 * end + 1;
+        break;
+    case PASS_EXPAND_HORZ:
+        src_beg = beg ? beg / 2 - 1 : 0;
+        dst_beg = 2 * src_beg;
+        src_end = (end - 1) / 2 + 1;
+        break;
+    case PASS_BLUR_HORZ: {
+        size_t n = (2 * pass->radius + sw - 1) / sw;
+        src_beg = beg > n ? beg - n : 0;
+        dst_beg = src_beg;
+        src_end = end;
+        break;
+    }
+    default:
+        // stripes are independent, filter in place
+        apply_filter(pass, pass->dst + beg * dst_step, beg,
+                     FFMIN(end * sw, pass->src_width) - beg * sw);
+        return;
+    }
+
+    int16_t *tmp = pass->group_tmp + index * pass->group_tmp_size;
+    apply_filter(pass, tmp, src_beg,
+                 FFMIN(src_end * sw, pass->src_width) - src_beg * sw);
+    memcpy(pass->dst + beg * dst_step, tmp + (beg - dst_beg) * dst_step,
+           sizeof(int16_t) * (end - beg) * dst_step);
+}
+
+/**
+ * \brief Run one filter pass, in parallel if set up by the caller
+ * \param dst_width width of the result
+ */
+static void run_pass(FilterPass *pass, PassType type,
+                     int16_t *dst, const int16_t *src,
+                     size_t width, size_t height,
+                     size_t dst_width, size_t dst_height)
+{
+    pass->type = type;
+    pass->dst = dst;
+    pass->src = src;
+    pass->src_width = width;
+    pass->src_height = height;
+    pass->dst_height = dst_height;
+    if (pass->n_groups < 2) {
+        apply_filter(pass, dst, 0, width);
+        return;
+    }
+
+    size_t sw = pass->stripe_width;
+    size_t n_stripes = (dst_width + sw - 1) / sw;
+    for (int i = 0; i < pass->n_groups; i++)
+        pass->bound[i] = (n_stripes * i / pass->n_groups) & ~(size_t) 1;
+    pass->bound[pass->n_groups] = n_stripes;
+    ass_thread_pool_run(pass->pool, filter_group, pass, pass->n_groups);
+}
+
 /**
  * \brief Perform approximate gaussian blur
+ * \param ctx scratch memory and threads to use
  * \param r2x in: desired standard deviation along X axis squared
  * \param r2y in: desired standard deviation along Y axis squared
  */
-bool ass_gaussian_blur(const BitmapEngine *engine, Bitmap *bm, double r2x, double r2y)
+bool ass_gaussian_blur(const BitmapEngine *engine, FilterContext *ctx,
+                       Bitmap *bm, double r2x, double r2y)
 {
     BlurMethod blur_x, blur_y;
     find_best_method(&blur_x, r2x);
@@ -189,53 +341,91 @@ bool ass_gaussian_blur(const BitmapEngine *engine, Bitmap *bm, double r2x, doubl
     if (size > INT_MAX / 4)
         return false;
 
-    int16_t *tmp = ass_aligned_alloc(2 * stripe_width, 4 * size, false);
+    FilterPass pass = {
+        .engine = engine,
+        .bitmap = bm->buffer,
+        .bitmap_stride = bm->stride,
+        .stripe_width = stripe_width,
+        .n_groups = 1,
+        .pool = ctx->pool,
+    };
+    int n_threads = ass_thread_pool_size(ctx->pool) + 1;
+    if (n_threads > 1 && (uint64_t) end_w * end_h >= PARALLEL_MIN_SIZE) {
+        // the narrowest pass limits the number of groups
+        uint32_t min_w = w;
+        for (int i = 0; i < blur_x.level; i++)
+            min_w = (min_w + 5) >> 1;
+        size_t min_stripes = (min_w + stripe_width - 1) / stripe_width;
+        size_t max_stripes = (end_w + stripe_width - 1) / stripe_width;
+        int n_groups = FFMIN(n_threads, MAX_GROUPS);
+        n_groups = FFMIN(n_groups, min_stripes / MIN_GROUP_STRIPES);
+        if (n_groups > 1) {
+            // group size is limited by even boundaries,
+            // horizontal filters need up to 4 extra stripes
+            pass.n_groups = n_groups;
+            pass.group_tmp_size = (max_stripes / n_groups + 6) * stripe_width * end_h;
+            if (pass.group_tmp_size > (INT_MAX / 4 - size) / n_groups)
+                pass.n_groups = 1;
+        }
+    }
+
+    int16_t *tmp = ass_filter_scratch(engine, ctx, sizeof(int16_t) *
+        (2 * size + (pass.n_groups > 1 ? pass.n_groups * pass.group_tmp_size : 0)));
     if (!tmp)
         return false;
+    pass.group_tmp = tmp + 2 * size;
 
-    engine->stripe_unpack(tmp, bm->buffer, bm->stride, w, h);
+    run_pass(&pass, PASS_UNPACK, tmp, NULL, w, h, w, h);
     int16_t *buf[2] = {tmp, tmp + size};
     int index = 0;
 
     for (int i = 0; i < blur_y.level; i++) {
-        engine->shrink_vert(buf[index ^ 1], buf[index], w, h);
+        pass.filter = engine->shrink_vert;
+        run_pass(&pass, PASS_VERT, buf[index ^ 1], buf[index], w, h, w, (h + 5) >> 1);
         h = (h + 5) >> 1;
         index ^= 1;
     }
     for (int i = 0; i < blur_x.level; i++) {
-        engine->shrink_horz(buf[index ^ 1], buf[index], w, h);
+        pass.filter = engine->shrink_horz;
+        run_pass(&pass, PASS_SHRINK_HORZ, buf[index ^ 1], buf[index], w, h, (w + 5) >> 1, h);
         w = (w + 5) >> 1;
         index ^= 1;
     }
     assert(blur_x.radius >= 4 && blur_x.radius <= 8);
-    engine->blur_horz[blur_x.radius - 4](buf[index ^ 1], buf[index], w, h, blur_x.coeff);
+    pass.filter = NULL;
+    pass.param_filter = engine->blur_horz[blur_x.radius - 4];
+    pass.param = blur_x.coeff;
+    pass.radius = blur_x.radius;
+    run_pass(&pass, PASS_BLUR_HORZ, buf[index ^ 1], buf[index], w, h, w + 2 * blur_x.radius, h);
     w += 2 * blur_x.radius;
     index ^= 1;
     assert(blur_y.radius >= 4 && blur_y.radius <= 8);
-    engine->blur_vert[blur_y.radius - 4](buf[index ^ 1], buf[index], w, h, blur_y.coeff);
+    pass.param_filter = engine->blur_vert[blur_y.radius - 4];
+    pass.param = blur_y.coeff;
+    pass.radius = blur_y.radius;
+    run_pass(&pass, PASS_VERT, buf[index ^ 1], buf[index], w, h, w, h + 2 * blur_y.radius);
     h += 2 * blur_y.radius;
     index ^= 1;
     for (int i = 0; i < blur_x.level; i++) {
-        engine->expand_horz(buf[index ^ 1], buf[index], w, h);
+        pass.filter = engine->expand_horz;
+        run_pass(&pass, PASS_EXPAND_HORZ, buf[index ^ 1], buf[index], w, h, 2 * w + 4, h);
         w = 2 * w + 4;
         index ^= 1;
     }
     for (int i = 0; i < blur_y.level; i++) {
-        engine->expand_vert(buf[index ^ 1], buf[index], w, h);
+        pass.filter = engine->expand_vert;
+        run_pass(&pass, PASS_VERT, buf[index ^ 1], buf[index], w, h, w, 2 * h + 4);
         h = 2 * h + 4;
         index ^= 1;
     }
     assert(w == end_w && h == end_h);
 
-    if (!ass_realloc_bitmap(engine, bm, w, h)) {
-        ass_aligned_free(tmp);
+    if (!ass_realloc_bitmap(engine, bm, w, h))
         return false;
-    }
     bm->left -= ((blur_x.radius + 4) << blur_x.level) - 4;
     bm->top  -= ((blur_y.radius + 4) << blur_y.level) - 4;
 
     engine->stripe_pack(bm->buffer, bm->stride, buf[index], w, h);
-    ass_aligned_free(tmp);
     return true;
 }
 
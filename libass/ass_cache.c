@@ -23,12 +23,14 @@
 #include <inttypes.h>
 #include <ft2build.h>
 #include FT_OUTLINE_H
+#include FT_TRUETYPE_TABLES_H
 #include <assert.h>
 
 #include "ass_utils.h"
 #include "ass_font.h"
 #include "ass_outline.h"
 #include "ass_cache.h"
+#include "ass_threading.h"
 
 // Always enable native-endian mode, since we don't care about cross-platform consistency of the hash
 #define WYHASH_LITTLE_ENDIAN 1
@@ -177,6 +179,39 @@ const CacheDesc composite_cache_desc = {
 };
 
 
+// clipped composite cache
+static bool clip_key_move(void *dst, void *src)
+{
+    ClipHashKey *d = dst, *s = src;
+    if (!d)
+        return true;
+    *d = *s;
+    ass_cache_inc_ref(d->source);
+    ass_cache_inc_ref(d->clip);
+    return true;
+}
+
+static void clip_destruct(void *key, void *value)
+{
+    ClipHashKey *k = key;
+    ass_free_bitmap(value);
+    ass_cache_dec_ref(k->source);
+    ass_cache_dec_ref(k->clip);
+}
+
+size_t ass_clip_construct(void *key, void *value, void *priv);
+
+const CacheDesc clip_cache_desc = {
+    .hash_func = clip_hash,
+    .compare_func = clip_compare,
+    .key_move_func = clip_key_move,
+    .construct_func = ass_clip_construct,
+    .destruct_func = clip_destruct,
+    .key_size = sizeof(ClipHashKey),
+    .value_size = sizeof(Bitmap)
+};
+
+
 // outline cache
 static ass_hashcode outline_hash(void *key, ass_hashcode hval)
 {
@@ -325,24 +360,340 @@ const CacheDesc glyph_metrics_cache_desc = {
 };
 
 
+// HarfBuzz font cache, uses the same keys as the font-face size metric cache
+static void hb_font_destruct(void *key, void *value)
+{
+    FaceSizeMetricsHashKey *k = key;
+    hb_font_destroy(*(hb_font_t **) value);
+    ass_cache_dec_ref(k->font);
+}
+
+size_t ass_hb_font_construct(void *key, void *value, void *priv);
+
+const CacheDesc hb_font_cache_desc = {
+    .hash_func = face_size_metrics_hash,
+    .compare_func = face_size_metrics_compare,
+    .key_move_func = face_size_metrics_key_move,
+    .construct_func = ass_hb_font_construct,
+    .destruct_func = hb_font_destruct,
+    .key_size = sizeof(FaceSizeMetricsHashKey),
+    .value_size = sizeof(hb_font_t *)
+};
+
+
+// HarfBuzz shape plan cache
+static bool shape_plan_key_move(void *dst, void *src)
+{
+    ShapePlanHashKey *d = dst, *s = src;
+    if (!d)
+        return true;
+
+    *d = *s;
+    ass_cache_inc_ref(s->font);
+    return true;
+}
+
+static void shape_plan_destruct(void *key, void *value)
+{
+    ShapePlanHashKey *k = key;
+    hb_shape_plan_destroy(*(hb_shape_plan_t **) value);
+    ass_cache_dec_ref(k->font);
+}
+
+size_t ass_shape_plan_construct(void *key, void *value, void *priv);
+
+const CacheDesc shape_plan_cache_desc = {
+    .hash_func = shape_plan_hash,
+    .compare_func = shape_plan_compare,
+    .key_move_func = shape_plan_key_move,
+    .construct_func = ass_shape_plan_construct,
+    .destruct_func = shape_plan_destruct,
+    .key_size = sizeof(ShapePlanHashKey),
+    .value_size = sizeof(hb_shape_plan_t *)
+};
+
+
+// shaped run cache
+static bool shape_key_move(void *dst, void *src)
+{
+    ShapeHashKey *d = dst, *s = src;
+    if (!d)
+        return true;
+
+    *d = *s;
+    d->text.str = ass_copy_string(s->text);
+    if (!d->text.str)
+        return false;
+    ass_cache_inc_ref(s->font);
+    return true;
+}
+
+static void shape_destruct(void *key, void *value)
+{
+    ShapeHashValue *v = value;
+    ShapeHashKey *k = key;
+    free(v->glyphs);
+    free((char *) k->text.str);
+    ass_cache_dec_ref(k->font);
+}
+
+size_t ass_shape_construct(void *key, void *value, void *priv);
+
+const CacheDesc shape_cache_desc = {
+    .hash_func = shape_hash,
+    .compare_func = shape_compare,
+    .key_move_func = shape_key_move,
+    .construct_func = ass_shape_construct,
+    .destruct_func = shape_destruct,
+    .key_size = sizeof(ShapeHashKey),
+    .value_size = sizeof(ShapeHashValue)
+};
+
+
+
+// lookup coverage cache
+static bool lookup_coverage_key_move(void *dst, void *src)
+{
+    LookupCoverageHashKey *d = dst, *s = src;
+    if (!d)
+        return true;
+
+    *d = *s;
+    ass_cache_inc_ref(s->font);
+    return true;
+}
+
+static void lookup_coverage_destruct(void *key, void *value)
+{
+    LookupCoverageHashValue *v = value;
+    LookupCoverageHashKey *k = key;
+    hb_set_destroy(v->glyphs);
+    ass_cache_dec_ref(k->font);
+}
+
+size_t ass_lookup_coverage_construct(void *key, void *value, void *priv);
+
+const CacheDesc lookup_coverage_cache_desc = {
+    .hash_func = lookup_coverage_hash,
+    .compare_func = lookup_coverage_compare,
+    .key_move_func = lookup_coverage_key_move,
+    .construct_func = ass_lookup_coverage_construct,
+    .destruct_func = lookup_coverage_destruct,
+    .key_size = sizeof(LookupCoverageHashKey),
+    .value_size = sizeof(LookupCoverageHashValue)
+};
+
+
+// layout cache
+static bool layout_key_move(void *dst, void *src)
+{
+    LayoutHashKey *d = dst, *s = src;
+    if (!d)
+        return true;
+
+    *d = *s;
+    d->glyphs.str = ass_copy_string(s->glyphs);
+    d->language.str = ass_copy_string(s->language);
+    if (d->glyphs.str && d->language.str)
+        return true;
+    free((char *) d->glyphs.str);
+    free((char *) d->language.str);
+    return false;
+}
+
+static void layout_destruct(void *key, void *value)
+{
+    LayoutHashValue *v = value;
+    LayoutHashKey *k = key;
+    for (int i = 0; i < v->glyph_count; i++)
+        ass_cache_dec_ref(v->glyphs[i].outline);
+    free(v->glyphs);
+    free(v->lines);
+    free((char *) k->glyphs.str);
+    free((char *) k->language.str);
+}
+
+size_t ass_layout_construct(void *key, void *value, void *priv);
+
+const CacheDesc layout_cache_desc = {
+    .hash_func = layout_hash,
+    .compare_func = layout_compare,
+    .key_move_func = layout_key_move,
+    .construct_func = ass_layout_construct,
+    .destruct_func = layout_destruct,
+    .key_size = sizeof(LayoutHashKey),
+    .value_size = sizeof(LayoutHashValue)
+};
+
+
+// Stable digests of cache keys for the disk cache.
+// Unlike the hash functions above, they match between runs:
+// referenced cache values are digested through their keys,
+// and fonts by properties of the face instead of by pointer.
+#define DIGEST(member) \
+    hval = ass_hash_buf(&(member), sizeof(member), hval)
+
+static ass_hashcode face_digest(ASS_Font *font, int face_index, ass_hashcode hval)
+{
+    FT_Face face = font->faces[face_index];
+    DIGEST(font->desc.vertical);
+    if (face->family_name)
+        hval = ass_hash_buf(face->family_name, strlen(face->family_name), hval);
+    if (face->style_name)
+        hval = ass_hash_buf(face->style_name, strlen(face->style_name), hval);
+    DIGEST(face->face_index);
+    DIGEST(face->face_flags);
+    DIGEST(face->style_flags);
+    DIGEST(face->num_glyphs);
+    DIGEST(face->units_per_EM);
+
+    // the head table has a checksum of the whole font file
+    TT_Header *head = FT_Get_Sfnt_Table(face, FT_SFNT_HEAD);
+    if (head) {
+        DIGEST(head->Font_Revision);
+        DIGEST(head->CheckSum_Adjust);
+        DIGEST(head->Created);
+        DIGEST(head->Modified);
+    }
+    return hval;
+}
+
+ass_hashcode ass_outline_digest(void *key, ass_hashcode hval)
+{
+    OutlineHashKey *k = key;
+    DIGEST(k->type);
+    switch (k->type) {
+    case OUTLINE_GLYPH: {
+        GlyphHashKey *glyph = &k->u.glyph;
+        hval = face_digest(glyph->font, glyph->face_index, hval);
+        DIGEST(glyph->size);
+        DIGEST(glyph->glyph_index);
+        DIGEST(glyph->bold);
+        DIGEST(glyph->italic);
+        DIGEST(glyph->flags);
+        DIGEST(glyph->hinting);
+        return hval;
+    }
+    case OUTLINE_DRAWING:
+        return ass_hash_buf(k->u.drawing.text.str, k->u.drawing.text.len, hval);
+    case OUTLINE_BORDER: {
+        BorderHashKey *border = &k->u.border;
+        hval = ass_outline_digest(ass_cache_key(border->outline), hval);
+        DIGEST(border->scale_ord_x);
+        DIGEST(border->scale_ord_y);
+        DIGEST(border->border);
+        return hval;
+    }
+    default:  // OUTLINE_BOX
+        return hval;
+    }
+}
+
+ass_hashcode ass_bitmap_digest(void *key, ass_hashcode hval)
+{
+    BitmapHashKey *k = key;
+    hval = ass_outline_digest(ass_cache_key(k->outline), hval);
+    DIGEST(k->offset);
+    DIGEST(k->matrix_x);
+    DIGEST(k->matrix_y);
+    DIGEST(k->matrix_z);
+    DIGEST(k->window_min);
+    DIGEST(k->window_max);
+    return hval;
+}
+
+static ass_hashcode bitmap_ref_digest(Bitmap *bm, ass_hashcode hval)
+{
+    bool present = bm;
+    DIGEST(present);
+    return bm ? ass_bitmap_digest(ass_cache_key(bm), hval) : hval;
+}
+
+ass_hashcode ass_composite_digest(void *key, ass_hashcode hval)
+{
+    CompositeHashKey *k = key;
+    DIGEST(k->filter.flags);
+    DIGEST(k->filter.be);
+    DIGEST(k->filter.blur_x);
+    DIGEST(k->filter.blur_y);
+    DIGEST(k->filter.shadow);
+    DIGEST(k->bitmap_count);
+    for (size_t i = 0; i < k->bitmap_count; i++) {
+        BitmapRef *ref = &k->bitmaps[i];
+        hval = bitmap_ref_digest(ref->bm, hval);
+        hval = bitmap_ref_digest(ref->bm_o, hval);
+        DIGEST(ref->pos);
+        DIGEST(ref->pos_o);
+    }
+    return hval;
+}
+
+#undef DIGEST
+
 
 // Cache data
 typedef struct cache_item {
     Cache *cache;
+    CacheGroup *group;
     const CacheDesc *desc;
-    struct cache_item *next, **prev;
+    struct cache_item *next, **prev;    // next also links retired items
     struct cache_item *queue_next, **queue_prev;
     size_t size, ref_count;
+    double cost;        // seconds spent constructing the value, if timed
+    double priority;    // eviction priority, CACHE_POLICY_COST only
+    int queue;          // queue holding the item if queue_prev is set
+    uint64_t used;      // frame of the cache when the item was last used
+    uint64_t retired;   // epoch of the group when the last reference was dropped
+    bool retiring;      // queued for destruction, may still regain references
 } CacheItem;
 
+// Caches whose items reference each other share a lock. Unreferenced items
+// are retired instead of freed at once: values returned by ass_cache_get()
+// are used without a reference, so an item is only freed once every reader
+// that could have seen it has left. Readers may also take a new reference
+// to a retired item, which then lives on outside of its cache.
+struct cache_group {
+    ASS_Mutex *lock;            // recursive, as constructors use other caches
+    uint64_t epoch;             // incremented whenever a reader enters
+    CacheReader *readers;
+    CacheItem *retired, **retired_last;     // oldest first
+    bool reclaiming;
+};
+
+// Items used since the last cut, in order of use.
+// Every item in a queue holds one reference.
+typedef struct {
+    CacheItem *first, **last;
+    size_t count;
+} CacheQueue;
+
+enum {
+    QUEUE_PROBATION,    // items used in one frame, the only queue outside of CACHE_POLICY_2Q
+    QUEUE_PROTECTED,    // items reused in later frames
+    QUEUE_COUNT
+};
+
+// part of the limit reserved for repeatedly used items with CACHE_POLICY_2Q
+#define PROTECTED_RATIO 0.75
+
 struct cache {
+    CacheGroup *group;
     unsigned buckets;
     CacheItem **map;
-    CacheItem *queue_first, **queue_last;
+    CacheQueue queue[QUEUE_COUNT];
 
     const CacheDesc *desc;
+    CachePolicy policy;
 
+    uint64_t frame;         // number of ass_cache_cut() calls, one per frame
     size_t cache_size;
+    size_t protected_size;  // size of items in QUEUE_PROTECTED
+    double inflation;       // priority below which items are evicted, CACHE_POLICY_COST only
+
+    // statistics since the last ass_cache_take_stats() call
+    size_t hits, misses;
+    unsigned timing_requests;   // users of construct_time, see ass_cache_request_timing()
+    double construct_time;
 };
 
 #define CACHE_ALIGN 8
@@ -358,15 +709,217 @@ static inline CacheItem *value_to_item(void *value)
     return (CacheItem *) ((char *) value - CACHE_ITEM_SIZE);
 }
 
+static inline size_t item_size(const CacheItem *item)
+{
+    return item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+}
+
+static inline void queue_init(CacheQueue *queue)
+{
+    queue->first = NULL;
+    queue->last = &queue->first;
+    queue->count = 0;
+}
+
+static inline void queue_push(CacheQueue *queue, CacheItem *item)
+{
+    *queue->last = item;
+    item->queue_prev = queue->last;
+    queue->last = &item->queue_next;
+    item->queue_next = NULL;
+    queue->count++;
+}
+
+static inline void queue_remove(CacheQueue *queue, CacheItem *item)
+{
+    if (item->queue_next)
+        item->queue_next->queue_prev = item->queue_prev;
+    else
+        queue->last = item->queue_prev;
+    *item->queue_prev = item->queue_next;
+    item->queue_prev = NULL;
+    queue->count--;
+}
+
+/**
+ * \brief Reset item priority after use with CACHE_POLICY_COST
+ * Follows GreedyDual-Size: an item is worth its construction time per byte
+ * on top of the current inflation, which rises as cheaper items are evicted.
+ * Failed items count as size 1, which would make them look extremely
+ * valuable per byte, so their cost is left out.
+ */
+static inline void update_priority(Cache *cache, CacheItem *item)
+{
+    double value = item->size == 1 ? 0 : item->cost / item_size(item);
+    item->priority = cache->inflation + value;
+}
+
+/**
+ * \brief Move item to the tail of the queue it belongs to after a hit
+ */
+static void touch_item(Cache *cache, CacheItem *item)
+{
+    int queue = QUEUE_PROBATION;
+    if (cache->policy == CACHE_POLICY_2Q) {
+        // the same glyph often repeats within a frame, only reuse
+        // in a later frame shows that an item is worth keeping
+        bool protected = item->queue_prev && item->queue == QUEUE_PROTECTED;
+        if (protected || item->used != cache->frame)
+            queue = QUEUE_PROTECTED;
+    } else if (cache->policy == CACHE_POLICY_COST)
+        update_priority(cache, item);
+    item->used = cache->frame;
+
+    if (item->queue_prev) {
+        if (item->queue == queue && !item->queue_next)
+            return;
+        queue_remove(&cache->queue[item->queue], item);
+        if (item->queue == QUEUE_PROTECTED)
+            cache->protected_size -= item_size(item);
+    } else
+        item->ref_count++;
+
+    item->queue = queue;
+    queue_push(&cache->queue[queue], item);
+    if (queue == QUEUE_PROTECTED)
+        cache->protected_size += item_size(item);
+}
+
+
+CacheGroup *ass_cache_group_create(void)
+{
+    CacheGroup *group = calloc(1, sizeof(*group));
+    if (!group)
+        return NULL;
+    group->lock = ass_mutex_create_recursive();
+    if (!group->lock) {
+        free(group);
+        return NULL;
+    }
+    group->retired_last = &group->retired;
+    return group;
+}
+
+// All caches of the group are done, so nothing can be retired anymore
+void ass_cache_group_done(CacheGroup *group)
+{
+    if (!group)
+        return;
+    assert(!group->readers && !group->retired);
+    ass_mutex_destroy(group->lock);
+    free(group);
+}
+
+static inline void destroy_item(const CacheDesc *desc, CacheItem *item)
+{
+    assert(item->desc == desc);
+    char *value = (char *) item + CACHE_ITEM_SIZE;
+    desc->destruct_func(value + align_cache(desc->value_size), value);
+    free(item);
+}
+
+/**
+ * \brief Remove an item without references from its cache
+ * and queue it for destruction
+ */
+static void retire_item(CacheGroup *group, CacheItem *item)
+{
+    Cache *cache = item->cache;
+    if (cache) {
+        if (item->next)
+            item->next->prev = item->prev;
+        *item->prev = item->next;
+        cache->cache_size -= item_size(item);
+        item->cache = NULL;
+    }
+
+    // a retired item that regained and lost references keeps its place,
+    // it is merely reclaimed no sooner than its new epoch allows
+    item->retired = group->epoch;
+    if (item->retiring)
+        return;
+    item->retiring = true;
+    item->next = NULL;
+    *group->retired_last = item;
+    group->retired_last = &item->next;
+}
+
+/**
+ * \brief Destroy retired items no active reader can still use
+ * Destructors release referenced items, which may retire further items
+ * of the same group; those are handled by the same loop.
+ */
+static void reclaim_items(CacheGroup *group)
+{
+    if (group->reclaiming)
+        return;
+    group->reclaiming = true;
+
+    uint64_t min_epoch = UINT64_MAX;
+    for (CacheReader *reader = group->readers; reader; reader = reader->next)
+        min_epoch = FFMIN(min_epoch, reader->epoch);
+
+    CacheItem *item;
+    while ((item = group->retired) && (item->ref_count || item->retired < min_epoch)) {
+        group->retired = item->next;
+        if (!group->retired)
+            group->retired_last = &group->retired;
+        item->retiring = false;
+        if (!item->ref_count)
+            destroy_item(item->desc, item);
+    }
+    group->reclaiming = false;
+}
+
+void ass_cache_group_lock(CacheGroup *group)
+{
+    ass_mutex_lock(group->lock);
+}
+
+void ass_cache_group_unlock(CacheGroup *group)
+{
+    if (group->retired)
+        reclaim_items(group);
+    ass_mutex_unlock(group->lock);
+}
+
+/**
+ * \brief Start using values of the group's caches without references
+ * Values returned by ass_cache_get() after this stay valid until
+ * ass_cache_group_leave(), whatever other threads do with the caches.
+ */
+void ass_cache_group_enter(CacheGroup *group, CacheReader *reader)
+{
+    ass_mutex_lock(group->lock);
+    reader->epoch = ++group->epoch;
+    reader->next = group->readers;
+    if (reader->next)
+        reader->next->prev = &reader->next;
+    reader->prev = &group->readers;
+    group->readers = reader;
+    ass_mutex_unlock(group->lock);
+}
+
+void ass_cache_group_leave(CacheGroup *group, CacheReader *reader)
+{
+    ass_mutex_lock(group->lock);
+    if (reader->next)
+        reader->next->prev = reader->prev;
+    *reader->prev = reader->next;
+    ass_cache_group_unlock(group);
+}
+
 
 // Create a cache with type-specific hash/compare/destruct/size functions
-Cache *ass_cache_create(const CacheDesc *desc)
+Cache *ass_cache_create(const CacheDesc *desc, CacheGroup *group)
 {
     Cache *cache = calloc(1, sizeof(*cache));
     if (!cache)
         return NULL;
+    cache->group = group;
     cache->buckets = 0xFFFF;
-    cache->queue_last = &cache->queue_first;
+    for (int i = 0; i < QUEUE_COUNT; i++)
+        queue_init(&cache->queue[i]);
     cache->desc = desc;
     cache->map = calloc(cache->buckets, sizeof(CacheItem *));
     if (!cache->map) {
@@ -379,10 +932,14 @@ Cache *ass_cache_create(const CacheDesc *desc)
 
 // Retrieve a value corresponding to a particular cache key,
 // creating one if it does not already exist.
-// The returned item is guaranteed to be valid until the next ass_cache_cut call;
-// to extend its lifetime further, call ass_cache_inc_ref().
+// The returned item is guaranteed to be valid until the caller leaves
+// the group, see ass_cache_group_enter(), or else until the next
+// ass_cache_cut call; to extend its lifetime further, call ass_cache_inc_ref().
+// Constructors run with the group locked.
 void *ass_cache_get(Cache *cache, void *key, void *priv)
 {
+    CacheGroup *group = cache->group;
+    ass_cache_group_lock(group);
     const CacheDesc *desc = cache->desc;
     size_t key_offs = CACHE_ITEM_SIZE + align_cache(desc->value_size);
     unsigned bucket = desc->hash_func(key, ASS_HASH_INIT) % cache->buckets;
@@ -390,19 +947,11 @@ void *ass_cache_get(Cache *cache, void *key, void *priv)
     while (item) {
         if (desc->compare_func(key, (char *) item + key_offs)) {
             assert(item->size);
-            if (!item->queue_prev || item->queue_next) {
-                if (item->queue_prev) {
-                    item->queue_next->queue_prev = item->queue_prev;
-                    *item->queue_prev = item->queue_next;
-                } else
-                    item->ref_count++;
-                *cache->queue_last = item;
-                item->queue_prev = cache->queue_last;
-                cache->queue_last = &item->queue_next;
-                item->queue_next = NULL;
-            }
+            touch_item(cache, item);
             desc->key_move_func(NULL, key);
+            cache->hits++;
 
+            ass_cache_group_unlock(group);
             return (char *) item + CACHE_ITEM_SIZE;
         }
         item = item->next;
@@ -411,18 +960,30 @@ void *ass_cache_get(Cache *cache, void *key, void *priv)
     item = malloc(key_offs + desc->key_size);
     if (!item) {
         desc->key_move_func(NULL, key);
+        ass_cache_group_unlock(group);
         return NULL;
     }
     item->cache = cache;
+    item->group = group;
     item->desc = desc;
+    item->retiring = false;
     void *new_key = (char *) item + key_offs;
     if (!desc->key_move_func(new_key, key)) {
         free(item);
+        ass_cache_group_unlock(group);
         return NULL;
     }
     void *value = (char *) item + CACHE_ITEM_SIZE;
+    // timing every miss is not free, so only when someone looks at it
+    bool timed = cache->timing_requests || cache->policy == CACHE_POLICY_COST;
+    double start = timed ? ass_thread_time() : 0;
     item->size = desc->construct_func(new_key, value, priv);
     assert(item->size);
+    item->cost = timed ? ass_thread_time() - start : 0;
+    cache->construct_time += item->cost;
+    cache->misses++;
+    item->used = cache->frame;
+    update_priority(cache, item);
 
     CacheItem **bucketptr = &cache->map[bucket];
     if (*bucketptr)
@@ -431,13 +992,12 @@ void *ass_cache_get(Cache *cache, void *key, void *priv)
     item->next = *bucketptr;
     *bucketptr = item;
 
-    *cache->queue_last = item;
-    item->queue_prev = cache->queue_last;
-    cache->queue_last = &item->queue_next;
-    item->queue_next = NULL;
+    item->queue = QUEUE_PROBATION;
+    queue_push(&cache->queue[QUEUE_PROBATION], item);
     item->ref_count = 1;
 
-    cache->cache_size += item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+    cache->cache_size += item_size(item);
+    ass_cache_group_unlock(group);
     return value;
 }
 
@@ -447,21 +1007,15 @@ void *ass_cache_key(void *value)
     return (char *) value + align_cache(item->desc->value_size);
 }
 
-static inline void destroy_item(const CacheDesc *desc, CacheItem *item)
-{
-    assert(item->desc == desc);
-    char *value = (char *) item + CACHE_ITEM_SIZE;
-    desc->destruct_func(value + align_cache(desc->value_size), value);
-    free(item);
-}
-
 void ass_cache_inc_ref(void *value)
 {
     if (!value)
         return;
     CacheItem *item = value_to_item(value);
-    assert(item->size && item->ref_count);
+    ass_cache_group_lock(item->group);
+    assert(item->size && (item->ref_count || item->retiring));
     item->ref_count++;
+    ass_cache_group_unlock(item->group);
 }
 
 void ass_cache_dec_ref(void *value)
@@ -469,53 +1023,123 @@ void ass_cache_dec_ref(void *value)
     if (!value)
         return;
     CacheItem *item = value_to_item(value);
+    // the group outlives the cache, which may be gone already
+    CacheGroup *group = item->group;
+    ass_cache_group_lock(group);
     assert(item->size && item->ref_count);
-    if (--item->ref_count)
-        return;
+    if (!--item->ref_count)
+        retire_item(group, item);
+    ass_cache_group_unlock(group);
+}
 
-    Cache *cache = item->cache;
-    if (cache) {
-        if (item->next)
-            item->next->prev = item->prev;
-        *item->prev = item->next;
+/**
+ * \brief Drop the queue reference of the first item in a queue
+ * \return false if the queue is empty
+ */
+static bool evict_first(Cache *cache, int queue)
+{
+    CacheItem *item = cache->queue[queue].first;
+    if (!item)
+        return false;
+    assert(item->size);
 
-        cache->cache_size -= item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
-    }
-    destroy_item(item->desc, item);
+    queue_remove(&cache->queue[queue], item);
+    if (queue == QUEUE_PROTECTED)
+        cache->protected_size -= item_size(item);
+    if (!--item->ref_count)
+        retire_item(cache->group, item);
+    return true;
 }
 
 void ass_cache_cut(Cache *cache, size_t max_size)
 {
-    if (cache->cache_size <= max_size)
+    ass_cache_group_lock(cache->group);
+    cache->frame++;
+    if (cache->cache_size <= max_size) {
+        ass_cache_group_unlock(cache->group);
         return;
+    }
 
-    do {
-        CacheItem *item = cache->queue_first;
-        if (!item)
-            break;
-        assert(item->size);
+    CacheQueue *probation = &cache->queue[QUEUE_PROBATION];
+    switch (cache->policy) {
+    case CACHE_POLICY_2Q:
+        // keep repeatedly used items within their part of the limit,
+        // so that a scan through many new items cannot flush them
+        while (cache->protected_size > max_size * PROTECTED_RATIO) {
+            CacheItem *item = cache->queue[QUEUE_PROTECTED].first;
+            queue_remove(&cache->queue[QUEUE_PROTECTED], item);
+            cache->protected_size -= item_size(item);
+            item->queue = QUEUE_PROBATION;
+            queue_push(probation, item);
+        }
+        while (cache->cache_size > max_size && evict_first(cache, QUEUE_PROBATION));
+        while (cache->cache_size > max_size && evict_first(cache, QUEUE_PROTECTED));
+        break;
 
-        cache->queue_first = item->queue_next;
-        if (--item->ref_count) {
-            item->queue_prev = NULL;
-            continue;
+    case CACHE_POLICY_COST: {
+        // evict items below the inflation in order of use;
+        // once all have been passed over, raise it to the lowest priority left
+        size_t passed = 0;
+        double min_priority = INFINITY;
+        while (cache->cache_size > max_size) {
+            CacheItem *item = probation->first;
+            if (!item)
+                break;
+            if (item->priority <= cache->inflation) {
+                evict_first(cache, QUEUE_PROBATION);
+                continue;
+            }
+            if (passed >= probation->count) {
+                cache->inflation = min_priority;
+                min_priority = INFINITY;
+                passed = 0;
+                continue;
+            }
+            min_priority = FFMIN(min_priority, item->priority);
+            queue_remove(probation, item);
+            queue_push(probation, item);
+            passed++;
         }
+        break;
+    }
 
-        if (item->next)
-            item->next->prev = item->prev;
-        *item->prev = item->next;
+    default:
+        while (cache->cache_size > max_size && evict_first(cache, QUEUE_PROBATION));
+    }
+    ass_cache_group_unlock(cache->group);
+}
 
-        cache->cache_size -= item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
-        destroy_item(cache->desc, item);
-    } while (cache->cache_size > max_size);
-    if (cache->queue_first)
-        cache->queue_first->queue_prev = &cache->queue_first;
-    else
-        cache->queue_last = &cache->queue_first;
+/**
+ * \brief Change the eviction policy, see CachePolicy
+ * Items keep their order of use, repeatedly used ones are evicted last.
+ */
+void ass_cache_set_policy(Cache *cache, CachePolicy policy)
+{
+    ass_cache_group_lock(cache->group);
+    if (cache->policy == policy) {
+        ass_cache_group_unlock(cache->group);
+        return;
+    }
+
+    CacheQueue *probation = &cache->queue[QUEUE_PROBATION];
+    if (policy != CACHE_POLICY_2Q) {
+        CacheItem *item;
+        while ((item = cache->queue[QUEUE_PROTECTED].first)) {
+            queue_remove(&cache->queue[QUEUE_PROTECTED], item);
+            item->queue = QUEUE_PROBATION;
+            queue_push(probation, item);
+        }
+        cache->protected_size = 0;
+    }
+    for (CacheItem *item = probation->first; item; item = item->queue_next)
+        update_priority(cache, item);
+    cache->policy = policy;
+    ass_cache_group_unlock(cache->group);
 }
 
 void ass_cache_empty(Cache *cache)
 {
+    ass_cache_group_lock(cache->group);
     for (int i = 0; i < cache->buckets; i++) {
         CacheItem *item = cache->map[i];
         while (item) {
@@ -523,54 +1147,126 @@ void ass_cache_empty(Cache *cache)
             CacheItem *next = item->next;
             if (item->queue_prev)
                 item->ref_count--;
-            if (item->ref_count)
-                item->cache = NULL;
-            else
-                destroy_item(cache->desc, item);
+            item->cache = NULL;
+            if (!item->ref_count)
+                retire_item(cache->group, item);
             item = next;
         }
         cache->map[i] = NULL;
     }
 
-    cache->queue_first = NULL;
-    cache->queue_last = &cache->queue_first;
+    for (int i = 0; i < QUEUE_COUNT; i++)
+        queue_init(&cache->queue[i]);
     cache->cache_size = 0;
+    cache->protected_size = 0;
+    ass_cache_group_unlock(cache->group);
+}
+
+// Total size of the items, in the units used by ass_cache_cut()
+size_t ass_cache_size(Cache *cache)
+{
+    ass_cache_group_lock(cache->group);
+    size_t size = cache->cache_size;
+    ass_cache_group_unlock(cache->group);
+    return size;
+}
+
+// Get statistics gathered since the previous call and start over
+void ass_cache_take_stats(Cache *cache, CacheStats *stats)
+{
+    ass_cache_group_lock(cache->group);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->construct_time = cache->construct_time;
+    cache->hits = cache->misses = 0;
+    cache->construct_time = 0;
+    ass_cache_group_unlock(cache->group);
+}
+
+/**
+ * \brief Start or stop measuring construction time for ass_cache_take_stats()
+ * Requests are counted, as renderers share caches of the font database.
+ * CACHE_POLICY_COST measures it regardless.
+ */
+void ass_cache_request_timing(Cache *cache, bool request)
+{
+    ass_cache_group_lock(cache->group);
+    if (request)
+        cache->timing_requests++;
+    else {
+        assert(cache->timing_requests);
+        cache->timing_requests--;
+    }
+    ass_cache_group_unlock(cache->group);
 }
 
 void ass_cache_done(Cache *cache)
 {
+    CacheGroup *group = cache->group;
+    ass_cache_group_lock(group);
     ass_cache_empty(cache);
     free(cache->map);
     free(cache);
+    ass_cache_group_unlock(group);
 }
 
 // Type-specific creation function
-Cache *ass_font_cache_create(void)
+Cache *ass_font_cache_create(CacheGroup *group)
+{
+    return ass_cache_create(&font_cache_desc, group);
+}
+
+Cache *ass_outline_cache_create(CacheGroup *group)
+{
+    return ass_cache_create(&outline_cache_desc, group);
+}
+
+Cache *ass_glyph_metrics_cache_create(CacheGroup *group)
+{
+    return ass_cache_create(&glyph_metrics_cache_desc, group);
+}
+
+Cache *ass_face_size_metrics_cache_create(CacheGroup *group)
+{
+    return ass_cache_create(&face_size_metrics_cache_desc, group);
+}
+
+Cache *ass_hb_font_cache_create(CacheGroup *group)
+{
+    return ass_cache_create(&hb_font_cache_desc, group);
+}
+
+Cache *ass_shape_plan_cache_create(CacheGroup *group)
+{
+    return ass_cache_create(&shape_plan_cache_desc, group);
+}
+
+Cache *ass_shape_cache_create(CacheGroup *group)
 {
-    return ass_cache_create(&font_cache_desc);
+    return ass_cache_create(&shape_cache_desc, group);
 }
 
-Cache *ass_outline_cache_create(void)
+Cache *ass_lookup_coverage_cache_create(CacheGroup *group)
 {
-    return ass_cache_create(&outline_cache_desc);
+    return ass_cache_create(&lookup_coverage_cache_desc, group);
 }
 
-Cache *ass_glyph_metrics_cache_create(void)
+Cache *ass_layout_cache_create(CacheGroup *group)
 {
-    return ass_cache_create(&glyph_metrics_cache_desc);
+    return ass_cache_create(&layout_cache_desc, group);
 }
 
-Cache *ass_face_size_metrics_cache_create(void)
+Cache *ass_bitmap_cache_create(CacheGroup *group)
 {
-    return ass_cache_create(&face_size_metrics_cache_desc);
+    return ass_cache_create(&bitmap_cache_desc, group);
 }
 
-Cache *ass_bitmap_cache_create(void)
+Cache *ass_composite_cache_create(CacheGroup *group)
 {
-    return ass_cache_create(&bitmap_cache_desc);
+    return ass_cache_create(&composite_cache_desc, group);
 }
 
-Cache *ass_composite_cache_create(void)
+Cache *ass_clip_cache_create(CacheGroup *group)
 {
-    return ass_cache_create(&composite_cache_desc);
+    return ass_cache_create(&clip_cache_desc, group);
 }
@@ -20,12 +20,15 @@
 #ifndef LIBASS_CACHE_H
 #define LIBASS_CACHE_H
 
+#include <hb.h>
+
 #include "ass.h"
 #include "ass_font.h"
 #include "ass_outline.h"
 #include "ass_bitmap.h"
 
 typedef struct cache Cache;
+typedef struct cache_group CacheGroup;
 typedef uint64_t ass_hashcode;
 
 // cache values
@@ -42,6 +45,54 @@ typedef struct {
     int asc, desc;  // ascender/descender
 } OutlineHashValue;
 
+typedef struct {
+    hb_codepoint_t glyph_index;
+    uint32_t cluster;
+    // in HarfBuzz font units, i.e. not yet scaled by GlyphInfo::scale_x|y
+    hb_position_t x_advance, y_advance;
+    hb_position_t x_offset, y_offset;
+} ShapedGlyph;
+
+typedef struct {
+    bool valid;
+    unsigned glyph_count;
+    ShapedGlyph *glyphs;
+} ShapeHashValue;
+
+typedef struct {
+    bool simple;    // whether runs in this face can be shaped without HarfBuzz
+    hb_set_t *glyphs;  // glyphs that may be acted upon by default lookups
+} LookupCoverageHashValue;
+
+// glyph as placed by text layout, see layout_text() in ass_render.c
+typedef struct {
+    OutlineHashValue *outline;
+    ASS_DVector transform_scale, transform_offset;
+    ASS_Rect bbox;
+    ASS_Vector pos, offset;
+    ASS_Vector advance, cluster_advance;
+    int face_index, glyph_index;
+    hb_script_t script;
+    int asc, desc;
+    int shape_run_id;
+    char linebreak;
+    bool skip, is_trimmed_whitespace, starts_new_run;
+    bool cluster_end;           // last glyph of its cluster
+} LayoutGlyph;
+
+typedef struct {
+    int offset, len;
+} LayoutLine;
+
+typedef struct {
+    bool valid;
+    int glyph_count;            // including additional glyphs of clusters
+    LayoutGlyph *glyphs;
+    int n_lines;
+    LayoutLine *lines;
+    ASS_DRect bbox;             // text bounding box before baseline shear
+} LayoutHashValue;
+
 // Create definitions for bitmap, outline and composite hash keys
 #define CREATE_STRUCT_DEFINITIONS
 #include "ass_cache_template.h"
@@ -98,19 +149,56 @@ typedef struct
     size_t value_size;
 } CacheDesc;
 
-Cache *ass_cache_create(const CacheDesc *desc);
+// eviction order of ass_cache_cut()
+typedef enum {
+    CACHE_POLICY_LRU,   // least recently used first
+    CACHE_POLICY_2Q,    // items used in one frame only first, then least recently used
+    CACHE_POLICY_COST,  // least recently used, with costly items kept longer
+} CachePolicy;
+
+typedef struct {
+    size_t hits, misses;
+    double construct_time;  // seconds spent constructing values, if timed
+} CacheStats;
+
+// a thread using values of a cache group, see ass_cache_group_enter()
+typedef struct cache_reader {
+    uint64_t epoch;
+    struct cache_reader *next, **prev;
+} CacheReader;
+
+CacheGroup *ass_cache_group_create(void);
+void ass_cache_group_done(CacheGroup *group);
+void ass_cache_group_lock(CacheGroup *group);
+void ass_cache_group_unlock(CacheGroup *group);
+void ass_cache_group_enter(CacheGroup *group, CacheReader *reader);
+void ass_cache_group_leave(CacheGroup *group, CacheReader *reader);
+Cache *ass_cache_create(const CacheDesc *desc, CacheGroup *group);
 void *ass_cache_get(Cache *cache, void *key, void *priv);
 void *ass_cache_key(void *value);
 void ass_cache_inc_ref(void *value);
 void ass_cache_dec_ref(void *value);
 void ass_cache_cut(Cache *cache, size_t max_size);
 void ass_cache_empty(Cache *cache);
+size_t ass_cache_size(Cache *cache);
+void ass_cache_take_stats(Cache *cache, CacheStats *stats);
+void ass_cache_request_timing(Cache *cache, bool request);
+void ass_cache_set_policy(Cache *cache, CachePolicy policy);
 void ass_cache_done(Cache *cache);
-Cache *ass_font_cache_create(void);
-Cache *ass_outline_cache_create(void);
-Cache *ass_face_size_metrics_cache_create(void);
-Cache *ass_glyph_metrics_cache_create(void);
-Cache *ass_bitmap_cache_create(void);
-Cache *ass_composite_cache_create(void);
+ass_hashcode ass_outline_digest(void *key, ass_hashcode hval);
+ass_hashcode ass_bitmap_digest(void *key, ass_hashcode hval);
+ass_hashcode ass_composite_digest(void *key, ass_hashcode hval);
+Cache *ass_font_cache_create(CacheGroup *group);
+Cache *ass_outline_cache_create(CacheGroup *group);
+Cache *ass_face_size_metrics_cache_create(CacheGroup *group);
+Cache *ass_glyph_metrics_cache_create(CacheGroup *group);
+Cache *ass_hb_font_cache_create(CacheGroup *group);
+Cache *ass_shape_plan_cache_create(CacheGroup *group);
+Cache *ass_shape_cache_create(CacheGroup *group);
+Cache *ass_lookup_coverage_cache_create(CacheGroup *group);
+Cache *ass_layout_cache_create(CacheGroup *group);
+Cache *ass_bitmap_cache_create(CacheGroup *group);
+Cache *ass_composite_cache_create(CacheGroup *group);
+Cache *ass_clip_cache_create(CacheGroup *group);
 
 #endif                          /* LIBASS_CACHE_H */
@@ -66,6 +66,10 @@ START(bitmap, bitmap_hash_key)
     VECTOR(matrix_x)
     VECTOR(matrix_y)
     VECTOR(matrix_z)
+    // part of the bitmap to rasterize, in pixels relative to its position;
+    // INT32_MIN to INT32_MAX if unrestricted, see restrict_bitmap()
+    VECTOR(window_min)
+    VECTOR(window_max)
 END(BitmapHashKey)
 
 // font is refed when inserted and unrefed when dropped
@@ -87,14 +91,77 @@ END(GlyphMetricsHashKey)
 // font is refed when inserted and unrefed when dropped
 START(glyph, glyph_hash_key)
     GENERIC(ASS_Font *, font)
-    GENERIC(double, size) // font size
+    // font size; constant without hinting, see fix_glyph_scaling()
+    GENERIC(double, size)
     GENERIC(int, face_index)
     GENERIC(int, glyph_index)
     GENERIC(int, bold)
     GENERIC(int, italic)
     GENERIC(unsigned, flags) // glyph decoration flags
+    GENERIC(int, hinting)    // ASS_Hinting
 END(GlyphHashKey)
 
+// describes a run of text shaped with HarfBuzz
+// font is refed when inserted and unrefed when dropped;
+// text holds the UTF-32 codepoints passed to HarfBuzz, including context,
+// of which item_length codepoints starting at item_offset are shaped;
+// on call to ass_cache_get(), text is a non-owning view;
+// its content is duplicated when inserted; the copy is freed when dropped
+START(shape, shape_hash_key)
+    GENERIC(ASS_Font *, font)
+    GENERIC(double, size)
+    GENERIC(int, face_index)
+    GENERIC(hb_script_t, script)
+    GENERIC(hb_language_t, language)
+    GENERIC(hb_direction_t, direction)
+    GENERIC(unsigned, features)  // bitmask of enabled shaper features
+    STRING(text)
+    GENERIC(unsigned, item_offset)
+    GENERIC(unsigned, item_length)
+END(ShapeHashKey)
+
+// describes a HarfBuzz shape plan
+// font is refed when inserted and unrefed when dropped
+START(shape_plan, shape_plan_hash_key)
+    GENERIC(ASS_Font *, font)
+    GENERIC(int, face_index)
+    GENERIC(hb_script_t, script)
+    GENERIC(hb_language_t, language)
+    GENERIC(hb_direction_t, direction)
+    GENERIC(unsigned, features)  // bitmask of enabled shaper features
+END(ShapePlanHashKey)
+
+// describes the OpenType lookups HarfBuzz applies to a face by default
+// font is refed when inserted and unrefed when dropped
+START(lookup_coverage, lookup_coverage_hash_key)
+    GENERIC(ASS_Font *, font)
+    GENERIC(int, face_index)
+    GENERIC(unsigned, features)  // bitmask of enabled shaper features
+END(LookupCoverageHashKey)
+
+// describes the inputs of event text layout
+// glyphs holds the serialized per-glyph parameters, see build_layout_key();
+// on call to ass_cache_get(), glyphs and language are non-owning views;
+// their content is duplicated when inserted; the copies are freed when dropped
+START(layout, layout_hash_key)
+    STRING(glyphs)
+    STRING(language)
+    GENERIC(double, max_text_width)
+    GENERIC(double, screen_scale_x)
+    GENERIC(double, screen_scale_y)
+    GENERIC(double, par_scale_x)
+    GENERIC(double, line_spacing)
+    GENERIC(int, shaper)            // ASS_ShapingLevel
+    GENERIC(int, hinting)           // ASS_Hinting
+    GENERIC(int, kerning)
+    GENERIC(uint32_t, feature_flags)
+    GENERIC(int, font_encoding)
+    GENERIC(int, wrap_style)
+    GENERIC(int, halign)
+    GENERIC(int, justify)
+    GENERIC(int, hscroll)
+END(LayoutHashKey)
+
 // describes an outline drawing
 // on call to ass_cache_get(), text is a non-owning view;
 // its content is duplicated when inserted; the copy is freed when dropped
@@ -131,6 +198,22 @@ START(bitmap_ref, bitmap_ref_key)
     VECTOR(pos_o)
 END(BitmapRef)
 
+// describes an image multiplied by a vector clip mask,
+// or with a rectangle masked out if clip is NULL
+// source and clip are refed when inserted and unrefed when dropped;
+// source is the cache value owning the image, bitmap points into it
+START(clip, clip_hash_key)
+    GENERIC(void *, source)
+    GENERIC(const uint8_t *, bitmap)
+    GENERIC(int, w)
+    GENERIC(int, h)
+    GENERIC(int, stride)
+    GENERIC(Bitmap *, clip)
+    VECTOR(rect)    // size of the masked out rectangle if clip is NULL
+    VECTOR(offset)  // image position relative to the clip bitmap or rectangle
+    GENERIC(int, inverse)
+END(ClipHashKey)
+
 #undef START
 #undef GENERIC
 #undef STRING
@@ -0,0 +1,413 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "ass_utils.h"
+#include "ass_filesystem.h"
+#include "ass_disk_cache.h"
+
+#define WYHASH_LITTLE_ENDIAN 1
+#include "wyhash.h"
+
+// bump when the file layout or the digests of cache keys change
+#define DISK_CACHE_VERSION 1
+#define DISK_CACHE_MAGIC 0x43535341  // "ASSC" in little endian
+
+#define KEY_NAME_LEN 32     // hexadecimal digits of DiskCacheKey
+#define TMP_NAME_LEN (KEY_NAME_LEN + 21)  // key, '.', 16 digits, ".tmp"
+
+// Files start with FileHeader, followed by n_bitmaps FileBitmap records
+// and then the rows of all bitmaps without padding.
+// Everything is in native byte order; foreign files fail the magic check.
+typedef struct {
+    uint32_t magic;
+    uint32_t n_bitmaps;
+    uint64_t hash[2];   // DiskCacheKey, guards against renamed files
+} FileHeader;
+
+typedef struct {
+    int32_t left, top;
+    int32_t w, h;
+} FileBitmap;
+
+struct disk_cache {
+    ASS_Library *library;
+    uint64_t seed[2];
+
+    // directory followed by room for a file name
+    char *path, *tmp_path;
+    size_t prefix;
+    unsigned tmp_count;
+
+    // open addressing set of stored keys, all-zero key marks a free slot;
+    // avoids a failing open() for every value that was never stored
+    DiskCacheKey *index;
+    size_t index_mask, index_count;
+};
+
+
+static inline bool key_valid(const DiskCacheKey *key)
+{
+    return key->hash[0] || key->hash[1];
+}
+
+static bool index_find(const DiskCache *cache, const DiskCacheKey *key)
+{
+    size_t pos = key->hash[0] & cache->index_mask;
+    while (key_valid(&cache->index[pos])) {
+        if (cache->index[pos].hash[0] == key->hash[0] &&
+                cache->index[pos].hash[1] == key->hash[1])
+            return true;
+        pos = (pos + 1) & cache->index_mask;
+    }
+    return false;
+}
+
+static bool index_add(DiskCache *cache, const DiskCacheKey *key)
+{
+    if (index_find(cache, key))
+        return true;
+
+    // keep at most half of the slots in use
+    if (2 * (cache->index_count + 1) > cache->index_mask + 1) {
+        size_t size = 2 * (cache->index_mask + 1);
+        DiskCacheKey *index = calloc(size, sizeof(DiskCacheKey));
+        if (!index)
+            return false;
+        for (size_t i = 0; i <= cache->index_mask; i++) {
+            if (!key_valid(&cache->index[i]))
+                continue;
+            size_t pos = cache->index[i].hash[0] & (size - 1);
+            while (key_valid(&index[pos]))
+                pos = (pos + 1) & (size - 1);
+            index[pos] = cache->index[i];
+        }
+        free(cache->index);
+        cache->index = index;
+        cache->index_mask = size - 1;
+    }
+
+    size_t pos = key->hash[0] & cache->index_mask;
+    while (key_valid(&cache->index[pos]))
+        pos = (pos + 1) & cache->index_mask;
+    cache->index[pos] = *key;
+    cache->index_count++;
+    return true;
+}
+
+static void format_hex(char *dst, uint64_t val)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 15; i >= 0; i--, val >>= 4)
+        dst[i] = digits[val & 15];
+}
+
+static bool parse_hex(const char *src, uint64_t *val)
+{
+    *val = 0;
+    for (int i = 0; i < 16; i++) {
+        char c = src[i];
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else
+            return false;
+        *val = *val << 4 | digit;
+    }
+    return true;
+}
+
+/**
+ * \brief Set the file name part of a path buffer
+ * \param path cache->path or cache->tmp_path
+ * \param suffix unique number of a temporary file, 0 for the final name
+ */
+static const char *entry_path(const DiskCache *cache, char *path,
+                              const DiskCacheKey *key, uint64_t suffix)
+{
+    char *name = path + cache->prefix;
+    format_hex(name, key->hash[0]);
+    format_hex(name + 16, key->hash[1]);
+    name += KEY_NAME_LEN;
+    if (suffix) {
+        *name++ = '.';
+        format_hex(name, suffix);
+        memcpy(name + 16, ".tmp", 4);
+        name += 20;
+    }
+    *name = '\0';
+    return path;
+}
+
+DiskCache *ass_disk_cache_create(ASS_Library *library, FT_Library ftlibrary,
+                                 const char *dir)
+{
+    ASS_Dir d;
+    if (!ass_open_dir(&d, dir)) {
+        ass_msg(library, MSGL_WARN, "Cannot open disk cache directory '%s'", dir);
+        return NULL;
+    }
+
+    DiskCache *cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        goto fail;
+    cache->library = library;
+
+    // entries of other versions get other names and are never looked up
+    FT_Int ft_version[3];
+    FT_Library_Version(ftlibrary, &ft_version[0], &ft_version[1], &ft_version[2]);
+    int32_t stamp[5] = {
+        DISK_CACHE_VERSION, LIBASS_VERSION,
+        ft_version[0], ft_version[1], ft_version[2],
+    };
+    cache->seed[0] = wyhash(stamp, sizeof(stamp), 0x1d5e6c4ba21e7c3fULL, _wyp);
+    cache->seed[1] = wyhash(stamp, sizeof(stamp), 0x8f3a92d06b4c15e7ULL, _wyp);
+
+    // d.path holds the directory with a trailing separator
+    cache->prefix = d.prefix;
+    cache->path = malloc(d.prefix + TMP_NAME_LEN + 1);
+    cache->tmp_path = malloc(d.prefix + TMP_NAME_LEN + 1);
+    if (!cache->path || !cache->tmp_path)
+        goto fail;
+    memcpy(cache->path, d.path, d.prefix);
+    memcpy(cache->tmp_path, d.path, d.prefix);
+
+    cache->index_mask = 255;
+    cache->index = calloc(cache->index_mask + 1, sizeof(DiskCacheKey));
+    if (!cache->index)
+        goto fail;
+
+    const char *name;
+    while ((name = ass_read_dir(&d))) {
+        DiskCacheKey key;
+        if (strlen(name) != KEY_NAME_LEN ||
+                !parse_hex(name, &key.hash[0]) ||
+                !parse_hex(name + 16, &key.hash[1]) ||
+                !key_valid(&key))
+            continue;
+        if (!index_add(cache, &key))
+            goto fail;
+    }
+    ass_close_dir(&d);
+
+    ass_msg(library, MSGL_V, "Disk cache '%s': %zu entries",
+            dir, cache->index_count);
+    return cache;
+
+fail:
+    ass_close_dir(&d);
+    ass_disk_cache_done(cache);
+    return NULL;
+}
+
+void ass_disk_cache_done(DiskCache *cache)
+{
+    if (!cache)
+        return;
+    free(cache->index);
+    free(cache->path);
+    free(cache->tmp_path);
+    free(cache);
+}
+
+void ass_disk_cache_key(const DiskCache *cache, DiskCacheKey *dst,
+                        HashFunction digest, void *key)
+{
+    dst->hash[0] = digest(key, cache->seed[0]);
+    dst->hash[1] = digest(key, cache->seed[1]);
+}
+
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    void *handle;
+} MappedFile;
+
+#ifdef HAVE_MMAP
+
+static bool map_file(MappedFile *file, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size > 0 && (uintmax_t) st.st_size <= SIZE_MAX)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    file->data = data;
+    file->size = st.st_size;
+    file->handle = data;
+    return true;
+}
+
+static void unmap_file(MappedFile *file)
+{
+    munmap(file->handle, file->size);
+}
+
+#else
+
+static bool map_file(MappedFile *file, const char *path)
+{
+    FILE *fp = ass_open_file(path, FN_DIR_LIST);
+    if (!fp)
+        return false;
+    uint8_t *data = NULL;
+    long size = -1;
+    if (!fseek(fp, 0, SEEK_END) && (size = ftell(fp)) > 0 &&
+            !fseek(fp, 0, SEEK_SET) && (data = malloc(size)) &&
+            fread(data, 1, size, fp) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    if (!data)
+        return false;
+    file->data = data;
+    file->size = size;
+    file->handle = data;
+    return true;
+}
+
+static void unmap_file(MappedFile *file)
+{
+    free(file->handle);
+}
+
+#endif
+
+static bool parse_entry(const MappedFile *file, const DiskCacheKey *key,
+                        const BitmapEngine *engine,
+                        Bitmap *const *bm, size_t n_bm)
+{
+    FileHeader header;
+    if (file->size < sizeof(header))
+        return false;
+    memcpy(&header, file->data, sizeof(header));
+    if (header.magic != DISK_CACHE_MAGIC || header.n_bitmaps != n_bm ||
+            header.hash[0] != key->hash[0] || header.hash[1] != key->hash[1])
+        return false;
+
+    size_t pos = sizeof(header) + n_bm * sizeof(FileBitmap);
+    if (file->size < pos)
+        return false;
+    for (size_t i = 0; i < n_bm; i++) {
+        FileBitmap info;
+        memcpy(&info, file->data + sizeof(header) + i * sizeof(info), sizeof(info));
+        memset(bm[i], 0, sizeof(Bitmap));
+        if (info.w < 0 || info.h < 0 || !info.w != !info.h)
+            return false;
+        if (!info.w)
+            continue;
+
+        if ((uint64_t) info.w * info.h > file->size - pos ||
+                !ass_alloc_bitmap(engine, bm[i], info.w, info.h, false))
+            return false;
+        bm[i]->left = info.left;
+        bm[i]->top  = info.top;
+        for (int32_t y = 0; y < info.h; y++) {
+            memcpy(bm[i]->buffer + y * bm[i]->stride, file->data + pos, info.w);
+            pos += info.w;
+        }
+    }
+    return pos == file->size;
+}
+
+bool ass_disk_cache_load(DiskCache *cache, const DiskCacheKey *key,
+                         const BitmapEngine *engine,
+                         Bitmap *const *bm, size_t n_bm)
+{
+    if (!index_find(cache, key))
+        return false;
+
+    MappedFile file;
+    if (!map_file(&file, entry_path(cache, cache->path, key, 0)))
+        return false;
+    bool res = parse_entry(&file, key, engine, bm, n_bm);
+    unmap_file(&file);
+    if (res)
+        return true;
+
+    ass_msg(cache->library, MSGL_V, "Ignoring invalid disk cache entry '%s'",
+            cache->path);
+    for (size_t i = 0; i < n_bm; i++) {
+        ass_free_bitmap(bm[i]);
+        memset(bm[i], 0, sizeof(Bitmap));
+    }
+    return false;
+}
+
+void ass_disk_cache_store(DiskCache *cache, const DiskCacheKey *key,
+                          Bitmap *const *bm, size_t n_bm)
+{
+    if (!key_valid(key) || index_find(cache, key))
+        return;
+
+    // write under a unique temporary name and rename when complete,
+    // so that concurrent processes never see partial files
+    uint64_t suffix = (uintptr_t) cache ^ ((uint64_t) clock() << 20) ^
+        ((uint64_t) time(NULL) << 40) ^ ++cache->tmp_count;
+    const char *path = entry_path(cache, cache->path, key, 0);
+    const char *tmp_path = entry_path(cache, cache->tmp_path, key, suffix | 1);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp)
+        return;
+
+    FileHeader header = {
+        .magic = DISK_CACHE_MAGIC,
+        .n_bitmaps = n_bm,
+        .hash = { key->hash[0], key->hash[1] },
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (size_t i = 0; i < n_bm && ok; i++) {
+        FileBitmap info = { bm[i]->left, bm[i]->top, bm[i]->w, bm[i]->h };
+        if (!bm[i]->buffer)
+            info.w = info.h = 0;
+        ok = fwrite(&info, sizeof(info), 1, fp) == 1;
+    }
+    for (size_t i = 0; i < n_bm && ok; i++) {
+        if (!bm[i]->buffer)
+            continue;
+        for (int32_t y = 0; y < bm[i]->h && ok; y++)
+            ok = fwrite(bm[i]->buffer + y * bm[i]->stride, bm[i]->w, 1, fp) == 1;
+    }
+    if (fclose(fp))
+        ok = false;
+
+    if (!ok || rename(tmp_path, path) || !index_add(cache, key))
+        remove(tmp_path);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_DISK_CACHE_H
+#define LIBASS_DISK_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "ass.h"
+#include "ass_font.h"
+#include "ass_cache.h"
+#include "ass_bitmap.h"
+
+// Persistent store of rendered bitmaps, one file per cache value
+// in a local directory, see ass_set_disk_cache()
+typedef struct disk_cache DiskCache;
+
+// identifies a stored value by two independent digests of its cache key
+typedef struct {
+    uint64_t hash[2];
+} DiskCacheKey;
+
+DiskCache *ass_disk_cache_create(ASS_Library *library, FT_Library ftlibrary,
+                                 const char *dir);
+void ass_disk_cache_done(DiskCache *cache);
+
+/**
+ * \brief Compute the key of a cache value
+ * \param digest stable digest function of the cache key, e.g. ass_bitmap_digest()
+ */
+void ass_disk_cache_key(const DiskCache *cache, DiskCacheKey *dst,
+                        HashFunction digest, void *key);
+
+/**
+ * \brief Load stored bitmaps
+ * \param bm bitmaps to fill, n_bm of them as passed to ass_disk_cache_store()
+ * \return true on success, false if not stored or unreadable
+ */
+bool ass_disk_cache_load(DiskCache *cache, const DiskCacheKey *key,
+                         const BitmapEngine *engine,
+                         Bitmap *const *bm, size_t n_bm);
+
+/**
+ * \brief Store bitmaps, failures are ignored
+ */
+void ass_disk_cache_store(DiskCache *cache, const DiskCacheKey *key,
+                          Bitmap *const *bm, size_t n_bm);
+
+#endif /* LIBASS_DISK_CACHE_H */
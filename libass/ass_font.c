@@ -476,7 +476,7 @@ fail:
  */
 ASS_Font *ass_font_new(ASS_Renderer *render_priv, ASS_FontDesc *desc)
 {
-    ASS_Font *font = ass_cache_get(render_priv->cache.font_cache, desc, render_priv);
+    ASS_Font *font = ass_cache_get(render_priv->cache.font_cache, desc, render_priv->fontdb);
     if (!font)
         return NULL;
     if (font->library)
@@ -486,19 +486,19 @@ ASS_Font *ass_font_new(ASS_Renderer *render_priv, ASS_FontDesc *desc)
 
 size_t ass_font_construct(void *key, void *value, void *priv)
 {
-    ASS_Renderer *render_priv = priv;
+    ASS_FontDatabase *fontdb = priv;
     ASS_FontDesc *desc = key;
     ASS_Font *font = value;
 
-    font->library = render_priv->library;
-    font->ftlibrary = render_priv->ftlibrary;
+    font->library = fontdb->library;
+    font->ftlibrary = fontdb->ftlibrary;
     font->n_faces = 0;
     font->desc.family = desc->family;
     font->desc.bold = desc->bold;
     font->desc.italic = desc->italic;
     font->desc.vertical = desc->vertical;
 
-    int error = add_face(render_priv->fontselect, font, 0);
+    int error = add_face(fontdb->fontselect, font, 0);
     if (error == -1)
         font->library = NULL;
     return 1;
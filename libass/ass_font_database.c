@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdlib.h>
+
+#include "ass_font_database.h"
+#include "ass_utils.h"
+
+ASS_FontDatabase *ass_font_database_create(ASS_Library *library)
+{
+    ASS_FontDatabase *db = calloc(1, sizeof(*db));
+    if (!db)
+        return NULL;
+    db->ref_count = 1;
+    db->library = library;
+
+    FT_Library ft;
+    if (FT_Init_FreeType(&ft)) {
+        ass_msg(library, MSGL_FATAL, "%s failed", "FT_Init_FreeType");
+        free(db);
+        return NULL;
+    }
+    db->ftlibrary = ft;
+
+    int vmajor, vminor, vpatch;
+    FT_Library_Version(ft, &vmajor, &vminor, &vpatch);
+    ass_msg(library, MSGL_V, "Raster: FreeType %d.%d.%d",
+           vmajor, vminor, vpatch);
+
+    CacheGroup *group = db->cache_group = ass_cache_group_create();
+    if (!group) {
+        FT_Done_FreeType(ft);
+        free(db);
+        return NULL;
+    }
+    db->font_cache = ass_font_cache_create(group);
+    db->outline_cache = ass_outline_cache_create(group);
+    db->face_size_metrics_cache = ass_face_size_metrics_cache_create(group);
+    db->metrics_cache = ass_glyph_metrics_cache_create(group);
+    db->hb_font_cache = ass_hb_font_cache_create(group);
+    db->shape_plan_cache = ass_shape_plan_cache_create(group);
+    db->shape_cache = ass_shape_cache_create(group);
+    db->lookup_coverage_cache = ass_lookup_coverage_cache_create(group);
+    if (!db->font_cache || !db->outline_cache ||
+        !db->face_size_metrics_cache || !db->metrics_cache ||
+        !db->hb_font_cache || !db->shape_plan_cache ||
+        !db->shape_cache || !db->lookup_coverage_cache) {
+        ass_font_database_unref(db);
+        return NULL;
+    }
+
+    return db;
+}
+
+ASS_FontDatabase *ass_font_database_init(ASS_Library *library,
+                                         const char *default_font,
+                                         const char *default_family,
+                                         int dfp, const char *config)
+{
+    ASS_FontDatabase *db = ass_font_database_create(library);
+    if (!db)
+        return NULL;
+
+    db->fontselect = ass_fontselect_init(library, db->ftlibrary,
+            &db->num_emfonts, default_family, default_font, config, dfp);
+    if (!db->fontselect) {
+        ass_font_database_unref(db);
+        return NULL;
+    }
+    return db;
+}
+
+void ass_font_database_ref(ASS_FontDatabase *db)
+{
+    ass_font_database_lock(db);
+    db->ref_count++;
+    ass_font_database_unlock(db);
+}
+
+void ass_font_database_unref(ASS_FontDatabase *db)
+{
+    if (!db)
+        return;
+
+    ass_font_database_lock(db);
+    int ref_count = --db->ref_count;
+    ass_font_database_unlock(db);
+    if (ref_count)
+        return;
+
+    // caches whose items reference fonts go first
+    if (db->outline_cache)
+        ass_cache_done(db->outline_cache);
+    if (db->shape_cache)
+        ass_cache_done(db->shape_cache);
+    if (db->lookup_coverage_cache)
+        ass_cache_done(db->lookup_coverage_cache);
+    if (db->shape_plan_cache)
+        ass_cache_done(db->shape_plan_cache);
+    if (db->hb_font_cache)
+        ass_cache_done(db->hb_font_cache);
+    if (db->face_size_metrics_cache)
+        ass_cache_done(db->face_size_metrics_cache);
+    if (db->metrics_cache)
+        ass_cache_done(db->metrics_cache);
+    if (db->font_cache)
+        ass_cache_done(db->font_cache);
+
+    if (db->fontselect)
+        ass_fontselect_free(db->fontselect);
+    FT_Done_FreeType(db->ftlibrary);
+    ass_cache_group_done(db->cache_group);
+    free(db);
+}
+
+void ass_font_database_done(ASS_FontDatabase *db)
+{
+    ass_font_database_unref(db);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_FONT_DATABASE_H
+#define LIBASS_FONT_DATABASE_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "ass.h"
+#include "ass_font.h"
+#include "ass_cache.h"
+#include "ass_fontselect.h"
+
+// Fonts and everything derived from them only, see ass_font_database_init().
+// The caches lock themselves. Everything else, including FreeType and
+// HarfBuzz objects referenced by cache values, is only used with the lock
+// of the cache group held, see ass_font_database_lock().
+struct ass_font_database {
+    int ref_count;
+    CacheGroup *cache_group;
+
+    ASS_Library *library;
+    FT_Library ftlibrary;
+    ASS_FontSelector *fontselect;   // NULL until fonts are configured
+    size_t num_emfonts;             // library fonts loaded into fontselect
+
+    // values of these caches depend on nothing but fonts;
+    // caches of renderers may reference their items
+    Cache *font_cache;
+    Cache *outline_cache;
+    Cache *face_size_metrics_cache;
+    Cache *metrics_cache;
+    Cache *hb_font_cache;
+    Cache *shape_plan_cache;
+    Cache *shape_cache;
+    Cache *lookup_coverage_cache;
+};
+
+/**
+ * \brief Create a database without fonts
+ */
+ASS_FontDatabase *ass_font_database_create(ASS_Library *library);
+void ass_font_database_ref(ASS_FontDatabase *db);
+void ass_font_database_unref(ASS_FontDatabase *db);
+
+static inline void ass_font_database_lock(ASS_FontDatabase *db)
+{
+    ass_cache_group_lock(db->cache_group);
+}
+
+static inline void ass_font_database_unlock(ASS_FontDatabase *db)
+{
+    ass_cache_group_unlock(db->cache_group);
+}
+
+#endif /* LIBASS_FONT_DATABASE_H */
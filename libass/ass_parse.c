@@ -513,7 +513,7 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 t2 = state->event->Duration;
             }
             delta_t = (uint32_t) t2 - t1;
-            t = render_priv->time - state->event->Start;
+            t = state->time - state->event->Start;
             if (t <= t1)
                 k = 0.;
             else if (t >= t2)
@@ -649,7 +649,7 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             }
             if ((state->parsed_tags & PARSED_FADE) == 0) {
                 state->fade =
-                    interpolate_alpha(render_priv->time -
+                    interpolate_alpha(state->time -
                             state->event->Start, t1, t2,
                             t3, t4, a1, a2, a3);
                 state->parsed_tags |= PARSED_FADE;
@@ -695,7 +695,7 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             if (t2 == 0)
                 t2 = state->event->Duration;
             delta_t = (uint32_t) t2 - t1;
-            t = render_priv->time - state->event->Start;        // FIXME: move to render_context
+            t = state->time - state->event->Start;        // FIXME: move to render_context
             if (t < t1)
                 k = 0.;
             else if (t >= t2)
@@ -806,7 +806,7 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             if (nargs) {
                 int len = args->end - args->start;
                 ass_reset_render_context(state,
-                        lookup_style_strict(render_priv->track, args->start, len));
+                        lookup_style_strict(state->track, args->start, len));
             } else
                 ass_reset_render_context(state, NULL);
         } else if (tag("be")) {
@@ -905,7 +905,7 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
         } else if (tag("q")) {
             int32_t val = argtoi32(*args);
             if (!nargs || !(val >= 0 && val <= 3))
-                val = render_priv->track->WrapStyle;
+                val = state->track->WrapStyle;
             state->wrap_style = val;
         } else if (tag("fe")) {
             int32_t val;
@@ -936,7 +936,7 @@ void ass_apply_transition_effects(RenderContext *state)
         v[cnt++] = atoi(++p);
     }
 
-    ASS_Vector layout_res = ass_layout_res(render_priv);
+    ASS_Vector layout_res = ass_layout_res(render_priv, state->track);
     if (strncmp(event->Effect, "Banner;", 7) == 0) {
         double delay;
         if (cnt < 1) {
@@ -962,10 +962,10 @@ void ass_apply_transition_effects(RenderContext *state)
         // To achieve both we need to keep our Playres-relative delay with high precision,
         // but must temporarily convert to storage-relative and truncate and take the
         // maxuimum there, before converting back.
-        double scale_x = ((double) layout_res.x) / render_priv->track->PlayResX;
+        double scale_x = ((double) layout_res.x) / state->track->PlayResX;
         delay = ((int) FFMAX(delay / scale_x, 1)) * scale_x;
         state->scroll_shift =
-            (render_priv->time - event->Start) / delay;
+            (state->time - event->Start) / delay;
         state->evt_type |= EVENT_HSCROLL;
         state->detect_collisions = 0;
         state->wrap_style = 2;
@@ -992,10 +992,10 @@ void ass_apply_transition_effects(RenderContext *state)
         }
         delay = v[2];
         // See explanation for Banner
-        double scale_y = ((double) layout_res.y) / render_priv->track->PlayResY;
+        double scale_y = ((double) layout_res.y) / state->track->PlayResY;
         delay = ((int) FFMAX(delay / scale_y, 1)) * scale_y;
         state->scroll_shift =
-            (render_priv->time - event->Start) / delay;
+            (state->time - event->Start) / delay;
         if (v[0] < v[1]) {
             y0 = v[0];
             y1 = v[1];
@@ -1025,7 +1025,7 @@ void ass_apply_transition_effects(RenderContext *state)
 void ass_process_karaoke_effects(RenderContext *state)
 {
     TextInfo *text_info = &state->text_info;
-    long long tm_current = state->renderer->time - state->event->Start;
+    long long tm_current = state->time - state->event->Start;
 
     int32_t timing = 0, skip_timing = 0;
     Effect effect_type = EF_NONE;
@@ -1179,3 +1179,60 @@ int ass_event_has_hard_overrides(char *str)
     }
     return 0;
 }
+
+/**
+ * \brief Get the number of parenthesized arguments of an override tag
+ * \param p tag after the backslash
+ * \return number of arguments, or -1 if the tag has another name or its
+ * arguments are not plainly comma-separated
+ */
+static int count_tag_args(const char *p, const char *name)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    size_t len = strlen(name);
+    if (strncmp(p, name, len) || p[len] != '(')
+        return -1;
+    p += len + 1;
+
+    int nargs = 1;
+    for (; *p != ')'; p++) {
+        if (!*p || *p == '}' || *p == '\\' || *p == '(')
+            return -1;
+        if (*p == ',')
+            nargs++;
+    }
+    return nargs;
+}
+
+// Return 1 if the event is positioned with \pos or \move for sure, which
+// exempts it from collision handling. Return 0 if it may not be.
+int ass_event_is_positioned(const char *str)
+{
+    // like ass_event_has_hard_overrides, but only counts valid tags
+    // outside of the arguments of other tags, e.g. \t
+    while (*str) {
+        if (str[0] == '\\' && str[1] != '\0') {
+            str += 2;
+        } else if (str[0] == '{') {
+            str++;
+            int depth = 0;
+            while (*str && *str != '}') {
+                if (*str == '(') {
+                    depth++;
+                } else if (*str == ')') {
+                    depth = FFMAX(depth - 1, 0);
+                } else if (*str == '\\' && !depth) {
+                    int nargs = count_tag_args(str + 1, "move");
+                    if (count_tag_args(str + 1, "pos") == 2 ||
+                        nargs == 4 || nargs == 6)
+                        return 1;
+                }
+                str++;
+            }
+        } else {
+            str++;
+        }
+    }
+    return 0;
+}
@@ -35,6 +35,7 @@ unsigned ass_get_next_char(RenderContext *state, char **str);
 char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                      bool nested);
 int ass_event_has_hard_overrides(char *str);
+int ass_event_is_positioned(const char *str);
 void ass_apply_fade(uint32_t *clr, int fade);
 
 
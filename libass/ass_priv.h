@@ -23,6 +23,7 @@
 #include <stdint.h>
 
 #include "ass_shaper.h"
+#include "ass_threading.h"
 
 typedef enum {
     PST_UNKNOWN = 0,
@@ -68,6 +69,8 @@ struct parser_priv {
 
     long long prune_delay;
     long long prune_next_ts;
+
+    ASS_Mutex *init_lock;   // see ass_lazy_track_init()
 };
 
 #endif /* LIBASS_PRIV_H */
@@ -28,8 +28,21 @@
 #include "ass_utils.h"
 #include "ass_outline.h"
 #include "ass_rasterizer.h"
+#include "ass_threading.h"
 
 
+// Thresholds for ass_rasterizer_select(), see profile/rasterizer.c:
+// minimal bounding box side, in pixels, to consider large tiles
+#define LARGE_TILE_MIN_SIZE  512
+// maximal number of segments per large tile to use them
+#define LARGE_TILE_MAX_DENSITY  4
+
+// Parallel fill: window is split into horizontal bands of at least
+// PARALLEL_MIN_HEIGHT pixels if its area is at least PARALLEL_MIN_AREA
+#define PARALLEL_MIN_AREA  (512 * 512)
+#define PARALLEL_MIN_HEIGHT  128
+#define MAX_BANDS  16
+
 
 static inline int ilog2(uint32_t n)
 {
@@ -58,9 +71,12 @@ bool ass_rasterizer_init(const BitmapEngine *engine, RasterizerData *rst, int ou
     rst->size[0] = rst->capacity[0] = 0;
     rst->size[1] = rst->capacity[1] = 0;
     rst->n_first = 0;
+    rst->bands = NULL;
+    rst->n_bands = 0;
+    rst->pool = NULL;
 
     unsigned align = 1 << engine->align_order;
-    unsigned size = 1 << (2 * engine->tile_order);
+    unsigned size = 1 << (2 * engine->tile32.tile_order);
     rst->tile = ass_aligned_alloc(align, size, false);
     return rst->tile;
 }
@@ -95,6 +111,45 @@ void ass_rasterizer_done(RasterizerData *rst)
     free(rst->linebuf[1]);
 
     ass_aligned_free(rst->tile);
+
+    for (int i = 0; i < rst->n_bands; i++)
+        ass_rasterizer_done(&rst->bands[i]);
+    free(rst->bands);
+}
+
+bool ass_rasterizer_set_threads(const BitmapEngine *engine, RasterizerData *rst,
+                                ASS_ThreadPool *pool)
+{
+    // the last band is filled with rst itself
+    int n_bands = FFMIN(ass_thread_pool_size(pool), MAX_BANDS - 1);
+    if (n_bands == rst->n_bands) {
+        rst->pool = pool;
+        return true;
+    }
+
+    RasterizerData *bands = NULL;
+    if (n_bands) {
+        bands = ass_realloc_array(NULL, n_bands, sizeof(RasterizerData));
+        if (!bands)
+            return false;
+        for (int i = 0; i < n_bands; i++) {
+            if (ass_rasterizer_init(engine, &bands[i], rst->outline_error))
+                continue;
+            ass_aligned_free(bands[i].tile);
+            while (i--)
+                ass_rasterizer_done(&bands[i]);
+            free(bands);
+            return false;
+        }
+    }
+
+    for (int i = 0; i < rst->n_bands; i++)
+        ass_rasterizer_done(&rst->bands[i]);
+    free(rst->bands);
+    rst->bands = bands;
+    rst->n_bands = n_bands;
+    rst->pool = pool;
+    return true;
 }
 
 
@@ -537,7 +592,7 @@ static void polyline_split_vert(const struct segment *src, const size_t n_src[2]
 }
 
 
-static inline void rasterizer_fill_solid(const BitmapEngine *engine,
+static inline void rasterizer_fill_solid(const RasterizerEngine *engine,
                                          uint8_t *buf, int width, int height, ptrdiff_t stride,
                                          int set)
 {
@@ -555,7 +610,7 @@ static inline void rasterizer_fill_solid(const BitmapEngine *engine,
     }
 }
 
-static inline void rasterizer_fill_halfplane(const BitmapEngine *engine,
+static inline void rasterizer_fill_halfplane(const RasterizerEngine *engine,
                                              uint8_t *buf, int width, int height, ptrdiff_t stride,
                                              int32_t a, int32_t b, int64_t c, int32_t scale)
 {
@@ -627,7 +682,7 @@ static inline int get_fill_flags(struct segment *line, size_t n_lines, int windi
  * Rasterizes (possibly recursive) one quad-tree level.
  * Truncates used input buffer.
  */
-static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rst,
+static bool rasterizer_fill_level(const RasterizerEngine *engine, RasterizerData *rst,
                                   uint8_t *buf, int width, int height, ptrdiff_t stride,
                                   int index, const size_t n_lines[2], const int winding[2])
 {
@@ -719,7 +774,109 @@ static bool rasterizer_fill_level(const BitmapEngine *engine, RasterizerData *rs
     return true;
 }
 
-bool ass_rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
+typedef struct {
+    const RasterizerEngine *engine;
+    RasterizerData *rst;
+    uint8_t *buf;
+    int width, height;
+    ptrdiff_t stride;
+    size_t n_lines[2];
+    int winding[2];
+    bool result;
+} BandJob;
+
+static void fill_band(void *priv, int index)
+{
+    BandJob *job = (BandJob *) priv + index;
+    job->result = rasterizer_fill_level(job->engine, job->rst,
+                                        job->buf, job->width, job->height, job->stride,
+                                        0, job->n_lines, job->winding);
+}
+
+/**
+ * \brief Fill horizontal bands of the window concurrently
+ * Bands are cut off the top of the polyline one by one, each into
+ * its own segment buffer; the remainder is filled with rst itself.
+ * Arguments are the same as for rasterizer_fill_level() with index 0.
+ */
+static bool rasterizer_fill_bands(const RasterizerEngine *engine, RasterizerData *rst,
+                                  uint8_t *buf, int width, int height, ptrdiff_t stride,
+                                  const size_t n_lines[2], const int winding[2])
+{
+    int n_bands = FFMIN(rst->n_bands + 1, height / PARALLEL_MIN_HEIGHT);
+    int mask = (1 << engine->tile_order) - 1;
+    int band_height = (height + n_bands - 1) / n_bands;
+    band_height = (band_height + mask) & ~mask;
+    n_bands = (height + band_height - 1) / band_height;
+
+    BandJob job[MAX_BANDS];
+    size_t n_rest[2] = { n_lines[0], n_lines[1] };
+    int winding_rest[2] = { winding[0], winding[1] };
+    for (int i = 0; i < n_bands; i++) {
+        job[i].engine = engine;
+        job[i].buf = buf + i * band_height * stride;
+        job[i].width = width;
+        job[i].height = FFMIN(band_height, height - i * band_height);
+        job[i].stride = stride;
+        job[i].winding[0] = winding_rest[0];
+        job[i].winding[1] = winding_rest[1];
+        if (i == n_bands - 1) {
+            job[i].rst = rst;
+            job[i].n_lines[0] = n_rest[0];
+            job[i].n_lines[1] = n_rest[1];
+            rst->size[0] = n_rest[0] + n_rest[1];
+            break;
+        }
+
+        RasterizerData *band = job[i].rst = &rst->bands[i];
+        band->size[0] = band->size[1] = 0;
+        if (!check_capacity(band, 0, n_rest[0] + n_rest[1])) {
+            rst->size[0] = 0;
+            return false;
+        }
+        polyline_split_vert(rst->linebuf[0], n_rest,
+                            band->linebuf[0], job[i].n_lines,
+                            rst->linebuf[0], n_rest,
+                            winding_rest, (int32_t) band_height << 6);
+        band->size[0] = job[i].n_lines[0] + job[i].n_lines[1];
+    }
+
+    ass_thread_pool_run(rst->pool, fill_band, job, n_bands);
+
+    bool result = true;
+    for (int i = 0; i < n_bands; i++)
+        result &= job[i].result;
+    rst->size[0] = rst->size[1] = 0;
+    return result;
+}
+
+
+const RasterizerEngine *ass_rasterizer_select(const BitmapEngine *engine,
+                                              const RasterizerData *rst)
+{
+    if (engine->min_tile_order > engine->tile16.tile_order)
+        return &engine->tile32;
+    if (engine->max_tile_order < engine->tile32.tile_order)
+        return &engine->tile16;
+
+    // Large tiles halve the number of splitting levels and tile calls,
+    // but pad the bitmap to a coarser grid and make every generic tile
+    // four times as expensive. They only pay off when the outline covers
+    // enough of them and its edges are sparse enough that most tiles
+    // end up solid or halfplane.
+    int64_t w = ((int64_t) rst->bbox.x_max - rst->bbox.x_min) >> 6;
+    int64_t h = ((int64_t) rst->bbox.y_max - rst->bbox.y_min) >> 6;
+    if (FFMIN(w, h) < LARGE_TILE_MIN_SIZE)
+        return &engine->tile16;
+
+    int order = engine->tile32.tile_order;
+    int64_t n_tiles = (w >> order) * (h >> order);
+    if (rst->size[0] > LARGE_TILE_MAX_DENSITY * n_tiles)
+        return &engine->tile16;
+    return &engine->tile32;
+}
+
+bool ass_rasterizer_fill(const RasterizerEngine *engine, RasterizerData *rst,
                          uint8_t *buf, int x0, int y0,
                          int width, int height, ptrdiff_t stride)
 {
@@ -779,6 +936,11 @@ bool ass_rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
     }
     rst->size[0] = n_lines[0] + n_lines[1];
     rst->size[1] = 0;
+    if (rst->n_bands && height >= 2 * PARALLEL_MIN_HEIGHT &&
+            (int64_t) width * height >= PARALLEL_MIN_AREA)
+        return rasterizer_fill_bands(engine, rst,
+                                     buf, width, height, stride,
+                                     n_lines, winding);
     return rasterizer_fill_level(engine, rst,
                                  buf, width, height, stride,
                                  0, n_lines, winding);
@@ -24,6 +24,7 @@
 #include <stdbool.h>
 
 #include "ass_bitmap.h"
+#include "ass_threading.h"
 
 
 enum {
@@ -42,7 +43,7 @@ struct segment {
     int32_t x_min, x_max, y_min, y_max;
 };
 
-typedef struct {
+typedef struct rasterizer_data {
     int outline_error;  // acceptable error (in 1/64 pixel units)
 
     // usable after rasterizer_set_outline
@@ -54,11 +55,24 @@ typedef struct {
     size_t n_first;
 
     uint8_t *tile;
+
+    // per-band state for parallel fill
+    struct rasterizer_data *bands;
+    int n_bands;
+    ASS_ThreadPool *pool;
 } RasterizerData;
 
 bool ass_rasterizer_init(const BitmapEngine *engine, RasterizerData *rst, int outline_error);
 void ass_rasterizer_done(RasterizerData *rst);
 
+/**
+ * \brief Set the threads used to fill large polylines
+ * \param pool threads filling bands alongside the caller, NULL to disable
+ * \return false on error, with the previous setting kept
+ */
+bool ass_rasterizer_set_threads(const BitmapEngine *engine, RasterizerData *rst,
+                                ASS_ThreadPool *pool);
+
 /**
  * \brief Convert outline to polyline and calculate exact bounds
  * \param path in: source outline
@@ -68,6 +82,16 @@ void ass_rasterizer_done(RasterizerData *rst);
 bool ass_rasterizer_set_outline(RasterizerData *rst,
                                 const ASS_Outline *path, bool extra);
 
+/**
+ * \brief Choose the tile size for the current polyline
+ * Small tiles unless the engine was created with ASS_FLAG_LARGE_TILES
+ * (always large) or ASS_FLAG_ADAPTIVE_TILES (large for big, sparse outlines).
+ * \return rasterizer functions to pass to ass_rasterizer_fill();
+ * width and height of its window must be multiples of their tile size
+ */
+const RasterizerEngine *ass_rasterizer_select(const BitmapEngine *engine,
+                                              const RasterizerData *rst);
+
 /**
  * \brief Polyline rasterization function
  * \param x0, y0, width, height in: source window (full pixel units)
@@ -75,8 +99,10 @@ bool ass_rasterizer_set_outline(RasterizerData *rst,
  * \param stride output buffer stride (aligned)
  * \return false on error
  * Deletes preprocessed polyline after work.
+ * Large windows are split into horizontal bands and filled concurrently
+ * if enabled with ass_rasterizer_set_threads().
  */
-bool ass_rasterizer_fill(const BitmapEngine *engine, RasterizerData *rst,
+bool ass_rasterizer_fill(const RasterizerEngine *engine, RasterizerData *rst,
                          uint8_t *buf, int x0, int y0,
                          int width, int height, ptrdiff_t stride);
 
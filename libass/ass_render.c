@@ -46,6 +46,7 @@
 #define MAX_PERSP_SCALE 16.0
 #define SUBPIXEL_ORDER 3  // ~ log2(64 / POSITION_PRECISION)
 #define BLUR_PRECISION (1.0 / 256)  // blur error as fraction of full input range
+#define WINDOW_ALIGN_ORDER 8  // granularity of bitmap windows, see restrict_bitmap()
 
 
 static bool text_info_init(TextInfo* text_info)
@@ -74,6 +75,7 @@ static void text_info_done(TextInfo* text_info)
     free(text_info->breaks);
     free(text_info->lines);
     free(text_info->combined_bitmaps);
+    free(text_info->layout_key);
 }
 
 static bool render_context_init(RenderContext *state, ASS_Renderer *priv)
@@ -83,15 +85,17 @@ static bool render_context_init(RenderContext *state, ASS_Renderer *priv)
     if (!text_info_init(&state->text_info))
         return false;
 
-    if (!(state->shaper = ass_shaper_new(priv->cache.metrics_cache, priv->cache.face_size_metrics_cache)))
+    if (!(state->shaper = ass_shaper_new(&priv->cache)))
         return false;
 
+    ass_filter_context_init(&state->filter);
     return ass_rasterizer_init(&priv->engine, &state->rasterizer, RASTERIZER_PRECISION);
 }
 
 static void render_context_done(RenderContext *state)
 {
     ass_rasterizer_done(&state->rasterizer);
+    ass_filter_context_done(&state->filter);
 
     if (state->shaper)
         ass_shaper_free(state->shaper);
@@ -101,57 +105,53 @@ static void render_context_done(RenderContext *state)
 
 ASS_Renderer *ass_renderer_init(ASS_Library *library)
 {
-    int error;
-    FT_Library ft;
     ASS_Renderer *priv = 0;
-    int vmajor, vminor, vpatch;
 
     ass_msg(library, MSGL_INFO, "libass API version: 0x%X", LIBASS_VERSION);
     ass_msg(library, MSGL_INFO, "libass source: %s", CONFIG_SOURCEVERSION);
 
-    error = FT_Init_FreeType(&ft);
-    if (error) {
-        ass_msg(library, MSGL_FATAL, "%s failed", "FT_Init_FreeType");
-        goto fail;
-    }
-
-    FT_Library_Version(ft, &vmajor, &vminor, &vpatch);
-    ass_msg(library, MSGL_V, "Raster: FreeType %d.%d.%d",
-           vmajor, vminor, vpatch);
-
     priv = calloc(1, sizeof(ASS_Renderer));
-    if (!priv) {
-        FT_Done_FreeType(ft);
+    if (!priv)
         goto fail;
-    }
 
     priv->library = library;
-    priv->ftlibrary = ft;
     // images_root and related stuff is zero-filled in calloc
 
     unsigned flags = ASS_CPU_FLAG_ALL;
 #if CONFIG_LARGE_TILES
     flags |= ASS_FLAG_LARGE_TILES;
+#endif
+#if CONFIG_ADAPTIVE_TILES
+    flags |= ASS_FLAG_ADAPTIVE_TILES;
 #endif
     priv->engine = ass_bitmap_engine_init(flags);
 
-    priv->cache.font_cache = ass_font_cache_create();
-    priv->cache.bitmap_cache = ass_bitmap_cache_create();
-    priv->cache.composite_cache = ass_composite_cache_create();
-    priv->cache.outline_cache = ass_outline_cache_create();
-    priv->cache.face_size_metrics_cache = ass_face_size_metrics_cache_create();
-    priv->cache.metrics_cache = ass_glyph_metrics_cache_create();
-    if (!priv->cache.font_cache || !priv->cache.bitmap_cache ||
-        !priv->cache.composite_cache || !priv->cache.outline_cache ||
-        !priv->cache.face_size_metrics_cache || !priv->cache.metrics_cache)
+    // fonts are set up later by ass_set_fonts() or ass_set_font_database()
+    ASS_FontDatabase *fontdb = ass_font_database_create(library);
+    if (!fontdb)
+        goto fail;
+    ass_attach_font_database(priv, fontdb);
+    ass_font_database_unref(fontdb);
+
+    CacheGroup *group = priv->cache.group = ass_cache_group_create();
+    if (!group)
+        goto fail;
+    priv->cache.bitmap_cache = ass_bitmap_cache_create(group);
+    priv->cache.composite_cache = ass_composite_cache_create(group);
+    priv->cache.clip_cache = ass_clip_cache_create(group);
+    priv->cache.layout_cache = ass_layout_cache_create(group);
+    if (!priv->cache.bitmap_cache || !priv->cache.composite_cache ||
+        !priv->cache.clip_cache || !priv->cache.layout_cache)
         goto fail;
 
     priv->cache.glyph_max = GLYPH_CACHE_MAX;
     priv->cache.bitmap_max_size = BITMAP_CACHE_MAX_SIZE;
     priv->cache.composite_max_size = COMPOSITE_CACHE_MAX_SIZE;
+    priv->cache.clip_max_size = CLIP_CACHE_MAX_SIZE;
 
     if (!render_context_init(&priv->state, priv))
         goto fail;
+    priv->n_threads = 1;
 
     priv->user_override_style.Name = "OverrideStyle"; // name insignificant
 
@@ -172,28 +172,88 @@ fail:
     return NULL;
 }
 
+/**
+ * \brief Drop everything in the renderer's own caches that refers to
+ * the font database
+ */
+static void empty_renderer_caches(CacheStore *cache)
+{
+    if (cache->layout_cache)
+        ass_cache_empty(cache->layout_cache);
+    if (cache->clip_cache)
+        ass_cache_empty(cache->clip_cache);
+    if (cache->composite_cache)
+        ass_cache_empty(cache->composite_cache);
+    if (cache->bitmap_cache)
+        ass_cache_empty(cache->bitmap_cache);
+}
+
+/**
+ * \brief Switch the renderer to another font database
+ * The renderer's own caches reference fonts and outlines of the old
+ * database and are emptied. Images already returned keep the old database
+ * alive until they are released.
+ */
+void ass_attach_font_database(ASS_Renderer *priv, ASS_FontDatabase *db)
+{
+    ass_font_database_ref(db);
+
+    CacheStore *cache = &priv->cache;
+    ASS_FontDatabase *old = priv->fontdb;
+    if (old) {
+        empty_renderer_caches(cache);
+        if (cache->budget)
+            ass_cache_request_timing(old->outline_cache, false);
+        ass_font_database_unref(old);
+    }
+    priv->fontdb = db;
+
+    cache->font_cache = db->font_cache;
+    cache->outline_cache = db->outline_cache;
+    if (cache->budget)
+        ass_cache_request_timing(cache->outline_cache, true);
+    cache->face_size_metrics_cache = db->face_size_metrics_cache;
+    cache->metrics_cache = db->metrics_cache;
+    cache->hb_font_cache = db->hb_font_cache;
+    cache->shape_plan_cache = db->shape_plan_cache;
+    cache->shape_cache = db->shape_cache;
+    cache->lookup_coverage_cache = db->lookup_coverage_cache;
+    if (priv->state.shaper)
+        ass_shaper_set_caches(priv->state.shaper, cache);
+}
+
 void ass_renderer_done(ASS_Renderer *render_priv)
 {
     if (!render_priv)
         return;
+    ass_stop_async_render(render_priv);
+    ass_cancel_prefetch(render_priv);
+    for (int i = 0; i < render_priv->n_workers; i++)
+        ass_renderer_done(render_priv->workers[i]);
+    free(render_priv->workers);
 
     ass_frame_unref(render_priv->images_root);
     ass_frame_unref(render_priv->prev_images_root);
 
-    ass_cache_done(render_priv->cache.composite_cache);
-    ass_cache_done(render_priv->cache.bitmap_cache);
-    ass_cache_done(render_priv->cache.outline_cache);
-    ass_cache_done(render_priv->cache.face_size_metrics_cache);
-    ass_cache_done(render_priv->cache.metrics_cache);
-    ass_cache_done(render_priv->cache.font_cache);
-
-    if (render_priv->fontselect)
-        ass_fontselect_free(render_priv->fontselect);
-    if (render_priv->ftlibrary)
-        FT_Done_FreeType(render_priv->ftlibrary);
+    if (render_priv->cache.layout_cache)
+        ass_cache_done(render_priv->cache.layout_cache);
+    if (render_priv->cache.clip_cache)
+        ass_cache_done(render_priv->cache.clip_cache);
+    if (render_priv->cache.composite_cache)
+        ass_cache_done(render_priv->cache.composite_cache);
+    if (render_priv->cache.bitmap_cache)
+        ass_cache_done(render_priv->cache.bitmap_cache);
+    ass_cache_group_done(render_priv->cache.group);
+    if (render_priv->fontdb && render_priv->cache.budget)
+        ass_cache_request_timing(render_priv->fontdb->outline_cache, false);
+    ass_font_database_unref(render_priv->fontdb);
+    ass_disk_cache_done(render_priv->cache.disk_cache);
+
     free(render_priv->eimg);
+    free(render_priv->event_states);
 
     render_context_done(&render_priv->state);
+    ass_thread_pool_free(render_priv->pool);
 
     free(render_priv->settings.default_font);
     free(render_priv->settings.default_family);
@@ -209,8 +269,7 @@ void ass_renderer_done(ASS_Renderer *render_priv)
  */
 static ASS_Image *my_draw_bitmap(unsigned char *bitmap, int bitmap_w,
                                  int bitmap_h, int stride, int dst_x,
-                                 int dst_y, uint32_t color,
-                                 CompositeHashValue *source)
+                                 int dst_y, uint32_t color, void *source)
 {
     ASS_ImagePriv *img = malloc(sizeof(ASS_ImagePriv));
     if (!img) {
@@ -231,6 +290,7 @@ static ASS_Image *my_draw_bitmap(unsigned char *bitmap, int bitmap_w,
     ass_cache_inc_ref(source);
     img->buffer = source ? NULL : bitmap;
     img->ref_count = 0;
+    img->fontdb = NULL;
 
     return &img->result;
 }
@@ -238,48 +298,51 @@ static ASS_Image *my_draw_bitmap(unsigned char *bitmap, int bitmap_w,
 /**
  * \brief Mapping between script and screen coordinates
  */
-static double x2scr_pos(ASS_Renderer *render_priv, double x)
+static double x2scr_pos(RenderContext *state, double x)
 {
-    return x * render_priv->frame_content_width / render_priv->par_scale_x / render_priv->track->PlayResX +
+    ASS_Renderer *render_priv = state->renderer;
+    return x * render_priv->frame_content_width / state->par_scale_x / state->track->PlayResX +
         render_priv->settings.left_margin;
 }
 static double x2scr_left(RenderContext *state, double x)
 {
     ASS_Renderer *render_priv = state->renderer;
     if (state->explicit || !render_priv->settings.use_margins)
-        return x2scr_pos(render_priv, x);
-    return x * render_priv->fit_width / render_priv->par_scale_x /
-        render_priv->track->PlayResX;
+        return x2scr_pos(state, x);
+    return x * render_priv->fit_width / state->par_scale_x /
+        state->track->PlayResX;
 }
 static double x2scr_right(RenderContext *state, double x)
 {
     ASS_Renderer *render_priv = state->renderer;
     if (state->explicit || !render_priv->settings.use_margins)
-        return x2scr_pos(render_priv, x);
-    return x * render_priv->fit_width / render_priv->par_scale_x /
-        render_priv->track->PlayResX +
+        return x2scr_pos(state, x);
+    return x * render_priv->fit_width / state->par_scale_x /
+        state->track->PlayResX +
         (render_priv->width - render_priv->fit_width);
 }
-static double x2scr_pos_scaled(ASS_Renderer *render_priv, double x)
+static double x2scr_pos_scaled(RenderContext *state, double x)
 {
-    return x * render_priv->frame_content_width / render_priv->track->PlayResX +
+    ASS_Renderer *render_priv = state->renderer;
+    return x * render_priv->frame_content_width / state->track->PlayResX +
         render_priv->settings.left_margin;
 }
 /**
  * \brief Mapping between script and screen coordinates
  */
-static double y2scr_pos(ASS_Renderer *render_priv, double y)
+static double y2scr_pos(RenderContext *state, double y)
 {
-    return y * render_priv->frame_content_height / render_priv->track->PlayResY +
+    ASS_Renderer *render_priv = state->renderer;
+    return y * render_priv->frame_content_height / state->track->PlayResY +
         render_priv->settings.top_margin;
 }
 static double y2scr(RenderContext *state, double y)
 {
     ASS_Renderer *render_priv = state->renderer;
     if (state->explicit || !render_priv->settings.use_margins)
-        return y2scr_pos(render_priv, y);
+        return y2scr_pos(state, y);
     return y * render_priv->fit_height /
-        render_priv->track->PlayResY +
+        state->track->PlayResY +
         (render_priv->height - render_priv->fit_height) * 0.5;
 }
 
@@ -288,21 +351,84 @@ static double y2scr_top(RenderContext *state, double y)
 {
     ASS_Renderer *render_priv = state->renderer;
     if (state->explicit || !render_priv->settings.use_margins)
-        return y2scr_pos(render_priv, y);
+        return y2scr_pos(state, y);
     return y * render_priv->fit_height /
-        render_priv->track->PlayResY;
+        state->track->PlayResY;
 }
 // the same for subtitles
 static double y2scr_sub(RenderContext *state, double y)
 {
     ASS_Renderer *render_priv = state->renderer;
     if (state->explicit || !render_priv->settings.use_margins)
-        return y2scr_pos(render_priv, y);
+        return y2scr_pos(state, y);
     return y * render_priv->fit_height /
-        render_priv->track->PlayResY +
+        state->track->PlayResY +
         (render_priv->height - render_priv->fit_height);
 }
 
+/**
+ * \brief Emit visible part of a bitmap with the inverse clip rectangle
+ * masked out, as one image or two for karaoke
+ * \param visible visible part of the bitmap, in bitmap coordinates
+ * \param clip inverse clip rectangle, in bitmap coordinates
+ * The masked bitmap is kept in the clip cache.
+ */
+static ASS_Image **render_glyph_masked(RenderContext *state,
+                                       Bitmap *bm, int dst_x, int dst_y,
+                                       uint32_t color, uint32_t color2, int brk,
+                                       ASS_Image **tail, unsigned type,
+                                       CompositeHashValue *source,
+                                       const Rect *visible, const Rect *clip)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    int cx0 = FFMINMAX(clip->x0, visible->x0, visible->x1);
+    int cy0 = FFMINMAX(clip->y0, visible->y0, visible->y1);
+    int cx1 = FFMINMAX(clip->x1, cx0, visible->x1);
+    int cy1 = FFMINMAX(clip->y1, cy0, visible->y1);
+    ClipHashKey key = {
+        .source = source,
+        .bitmap = bm->buffer + visible->y0 * bm->stride + visible->x0,
+        .w = visible->x1 - visible->x0,
+        .h = visible->y1 - visible->y0,
+        .stride = bm->stride,
+        .clip = NULL,
+        .rect = { cx1 - cx0, cy1 - cy0 },
+        .offset = { visible->x0 - cx0, visible->y0 - cy0 },
+        .inverse = true,
+    };
+    Bitmap *masked = ass_cache_get(render_priv->cache.clip_cache, &key, state);
+    if (!masked || !masked->buffer)
+        return tail;
+
+    dst_x += visible->x0;
+    dst_y += visible->y0;
+    brk -= visible->x0;
+
+    // split up into left and right for karaoke, if needed
+    ASS_Image *img;
+    if (brk > 0) {
+        int lbrk = FFMIN(brk, masked->w);
+        img = my_draw_bitmap(masked->buffer, lbrk, masked->h, masked->stride,
+                             dst_x, dst_y, color, masked);
+        if (!img)
+            return tail;
+        img->type = type;
+        *tail = img;
+        tail = &img->next;
+    }
+    if (brk < masked->w) {
+        int rbrk = FFMAX(brk, 0);
+        img = my_draw_bitmap(masked->buffer + rbrk, masked->w - rbrk, masked->h,
+                             masked->stride, dst_x + rbrk, dst_y, color2, masked);
+        if (!img)
+            return tail;
+        img->type = type;
+        *tail = img;
+        tail = &img->next;
+    }
+    return tail;
+}
+
 /*
  * \brief Convert bitmap glyphs into ASS_Image list with inverse clipping
  *
@@ -315,6 +441,8 @@ static double y2scr_sub(RenderContext *state, double y)
  * Afterwards, they are clipped against the screen coordinates.
  * In an additional pass, the rectangles need to be split up left/right for
  * karaoke effects.  This can result in a lot of bitmaps (6 to be exact).
+ * Therefore, if more than one rectangle remains, the visible part of the
+ * bitmap is emitted as a whole with the clip rectangle masked out instead.
  */
 static ASS_Image **render_glyph_i(RenderContext *state,
                                   Bitmap *bm, int dst_x, int dst_y,
@@ -322,7 +450,6 @@ static ASS_Image **render_glyph_i(RenderContext *state,
                                   ASS_Image **tail, unsigned type,
                                   CompositeHashValue *source)
 {
-    ASS_Renderer *render_priv = state->renderer;
     int i, j, x0, y0, x1, y1, cx0, cy0, cx1, cy1, sx, sy, zx, zy;
     Rect r[4];
     ASS_Image *img;
@@ -332,10 +459,10 @@ static ASS_Image **render_glyph_i(RenderContext *state,
     brk -= dst_x;
 
     // we still need to clip against screen boundaries
-    zx = x2scr_pos_scaled(render_priv, 0);
-    zy = y2scr_pos(render_priv, 0);
-    sx = x2scr_pos_scaled(render_priv, render_priv->track->PlayResX);
-    sy = y2scr_pos(render_priv, render_priv->track->PlayResY);
+    zx = x2scr_pos_scaled(state, 0);
+    zy = y2scr_pos(state, 0);
+    sx = x2scr_pos_scaled(state, state->track->PlayResX);
+    sy = y2scr_pos(state, state->track->PlayResY);
 
     x0 = 0;
     y0 = 0;
@@ -370,11 +497,24 @@ static ASS_Image **render_glyph_i(RenderContext *state,
     if (r[i].x1 > r[i].x0 && r[i].y1 > r[i].y0) i++;
 
     // clip each rectangle to screen coordinates
+    int n_valid = 0;
     for (j = 0; j < i; j++) {
         r[j].x0 = (r[j].x0 + dst_x < zx) ? zx - dst_x : r[j].x0;
         r[j].y0 = (r[j].y0 + dst_y < zy) ? zy - dst_y : r[j].y0;
         r[j].x1 = (r[j].x1 + dst_x > sx) ? sx - dst_x : r[j].x1;
         r[j].y1 = (r[j].y1 + dst_y > sy) ? sy - dst_y : r[j].y1;
+        if (r[j].x1 > r[j].x0 && r[j].y1 > r[j].y0)
+            n_valid++;
+    }
+
+    if (n_valid > 1) {
+        Rect visible = {
+            FFMAX(x0, zx - dst_x), FFMAX(y0, zy - dst_y),
+            FFMIN(x1, sx - dst_x), FFMIN(y1, sy - dst_y),
+        };
+        Rect clip = { cx0, cy0, cx1, cy1 };
+        return render_glyph_masked(state, bm, dst_x, dst_y, color, color2,
+                                   brk, tail, type, source, &visible, &clip);
     }
 
     // draw the rectangles
@@ -645,6 +785,8 @@ static bool quantize_transform(double m[3][3], ASS_Vector *pos,
     key->matrix_x.x = qm[0][0];  key->matrix_x.y = qm[0][1];
     key->matrix_y.x = qm[1][0];  key->matrix_y.y = qm[1][1];
     key->matrix_z.x = qm[2][0];  key->matrix_z.y = qm[2][1];
+    key->window_min.x = key->window_min.y = INT32_MIN;
+    key->window_max.x = key->window_max.y = INT32_MAX;
     return true;
 }
 
@@ -686,6 +828,121 @@ static void restore_transform(double m[3][3], const BitmapHashKey *key)
         m[i][2] -= m[i][0] * x0 + m[i][1] * y0;
 }
 
+/**
+ * \brief Estimate pixel bounding box of a transformed rectangle
+ * \param m transform matrix with output in 1/64 pixel units
+ * \param box in: rectangle before transform; out: conservative bounding box
+ * after transform in full pixel units
+ * \return false if the transform isn't well-behaved enough for an estimate
+ */
+static bool transform_bbox(const double m[3][3], ASS_DRect *box)
+{
+    const double max_val = 1000000000;
+
+    // Projective transform with positive z maps the rectangle
+    // into the convex hull of its transformed corners
+    double x_min = INFINITY, y_min = INFINITY;
+    double x_max = -INFINITY, y_max = -INFINITY;
+    for (int i = 0; i < 4; i++) {
+        double x = i & 1 ? box->x_max : box->x_min;
+        double y = i & 2 ? box->y_max : box->y_min;
+        double z = m[2][0] * x + m[2][1] * y + m[2][2];
+        if (!(z > 0))
+            return false;
+        double w = 1 / (64 * z);
+        double px = (m[0][0] * x + m[0][1] * y + m[0][2]) * w;
+        double py = (m[1][0] * x + m[1][1] * y + m[1][2]) * w;
+        if (!(fabs(px) < max_val && fabs(py) < max_val))
+            return false;
+        x_min = FFMIN(x_min, px);
+        y_min = FFMIN(y_min, py);
+        x_max = FFMAX(x_max, px);
+        y_max = FFMAX(y_max, py);
+    }
+    // margin for rounding and bitmap enlargement in ass_outline_to_bitmap()
+    box->x_min = floor(x_min) - 2;
+    box->y_min = floor(y_min) - 2;
+    box->x_max = ceil(x_max) + 2;
+    box->y_max = ceil(y_max) + 2;
+    return true;
+}
+
+/**
+ * \brief Check whether a glyph with its border can reach the visible window
+ * \param window visible area (full pixel units)
+ * \param m glyph transform matrix before quantization
+ * \param bord_x, bord_y border size in the outline coordinates
+ * Cheap conservative test to skip invisible glyphs before stroking.
+ */
+static bool glyph_visible(const ASS_Rect *window, const double m[3][3],
+                          const ASS_Rect *cbox, double bord_x, double bord_y)
+{
+    if (window->x_min >= window->x_max || window->y_min >= window->y_max)
+        return false;
+    if (!(bord_x < OUTLINE_MAX && bord_y < OUTLINE_MAX))
+        return true;
+
+    bord_x = fabs(bord_x);
+    bord_y = fabs(bord_y);
+    ASS_DRect bbox = {
+        cbox->x_min - bord_x, cbox->y_min - bord_y,
+        cbox->x_max + bord_x, cbox->y_max + bord_y,
+    };
+    if (!transform_bbox(m, &bbox))
+        return true;
+    return bbox.x_max > window->x_min && bbox.y_max > window->y_min &&
+           bbox.x_min < window->x_max && bbox.y_min < window->y_max;
+}
+
+/**
+ * \brief Restrict bitmap to the visible part of the screen
+ * \param window visible area (full pixel units), NULL to keep entire bitmap
+ * \param pos bitmap position as returned by quantize_transform()
+ * \return false if the bitmap cannot be visible at all
+ * The window is stored in the key only if the bitmap doesn't fit into it,
+ * and it's aligned to a coarse grid, so that moving glyphs
+ * still get cache hits most of the time.
+ */
+static bool restrict_bitmap(const ASS_Rect *window, ASS_Vector pos,
+                            BitmapHashKey *key)
+{
+    if (!window)
+        return true;
+    if (window->x_min >= window->x_max || window->y_min >= window->y_max)
+        return false;
+
+    double m[3][3];
+    restore_transform(m, key);
+
+    const ASS_Rect *cbox = &key->outline->cbox;
+    ASS_DRect bbox = { cbox->x_min, cbox->y_min, cbox->x_max, cbox->y_max };
+    if (!transform_bbox(m, &bbox))
+        return true;
+
+    int64_t wx0 = (int64_t) window->x_min - pos.x;
+    int64_t wy0 = (int64_t) window->y_min - pos.y;
+    int64_t wx1 = (int64_t) window->x_max - pos.x;
+    int64_t wy1 = (int64_t) window->y_max - pos.y;
+    if (bbox.x_max <= wx0 || bbox.y_max <= wy0 ||
+            bbox.x_min >= wx1 || bbox.y_min >= wy1)
+        return false;
+
+    const int64_t mask = (1 << WINDOW_ALIGN_ORDER) - 1;
+    wx0 &= ~mask;
+    wy0 &= ~mask;
+    wx1 = (wx1 + mask) & ~mask;
+    wy1 = (wy1 + mask) & ~mask;
+    if (bbox.x_min >= wx0 && bbox.y_min >= wy0 &&
+            bbox.x_max <= wx1 && bbox.y_max <= wy1)
+        return true;
+
+    key->window_min.x = FFMAX(wx0, INT32_MIN);
+    key->window_min.y = FFMAX(wy0, INT32_MIN);
+    key->window_max.x = FFMIN(wx1, INT32_MAX);
+    key->window_max.y = FFMIN(wy1, INT32_MAX);
+    return true;
+}
+
 // Calculate bitmap memory footprint
 static inline size_t bitmap_size(const Bitmap *bm)
 {
@@ -694,8 +951,8 @@ static inline size_t bitmap_size(const Bitmap *bm)
 
 /**
  * Iterate through a list of bitmaps and blend with clip vector, if
- * applicable. The blended bitmaps are added to a free list which is freed
- * at the start of a new frame.
+ * applicable. The blended bitmaps are kept in the clip cache, so images
+ * that stay the same under an unchanged clip are reused across frames.
  */
 static void blend_vector_clip(RenderContext *state, ASS_Image *head)
 {
@@ -731,86 +988,100 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
 
     // Iterate through bitmaps and blend/clip them
     for (ASS_Image *cur = head; cur; cur = cur->next) {
-        int left, top, right, bottom, w, h;
-        int ax, ay, aw, ah, as;
-        int bx, by, bw, bh, bs;
-        int aleft, atop, bleft, btop;
-        unsigned char *abuffer, *bbuffer, *nbuffer;
-
-        abuffer = cur->bitmap;
-        bbuffer = clip_bm->buffer;
-        ax = cur->dst_x;
-        ay = cur->dst_y;
-        aw = cur->w;
-        ah = cur->h;
-        as = cur->stride;
-        bx = pos.x + clip_bm->left;
-        by = pos.y + clip_bm->top;
-        bw = clip_bm->w;
-        bh = clip_bm->h;
-        bs = clip_bm->stride;
-
-        // Calculate overlap coordinates
-        left = (ax > bx) ? ax : bx;
-        top = (ay > by) ? ay : by;
-        right = ((ax + aw) < (bx + bw)) ? (ax + aw) : (bx + bw);
-        bottom = ((ay + ah) < (by + bh)) ? (ay + ah) : (by + bh);
-        aleft = left - ax;
-        atop = top - ay;
-        w = right - left;
-        h = bottom - top;
-        bleft = left - bx;
-        btop = top - by;
-
-        unsigned align = 1 << render_priv->engine.align_order;
-        if (state->clip_drawing_mode) {
-            // Inverse clip
-            if (ax + aw < bx || ay + ah < by || ax > bx + bw ||
-                ay > by + bh || !h || !w) {
-                continue;
-            }
-
-            // Allocate new buffer and add to free list
-            nbuffer = ass_aligned_alloc(align, as * ah + align, false);
-            if (!nbuffer)
-                break;
-
-            // Blend together
-            memcpy(nbuffer, abuffer, ((ah - 1) * as) + aw);
-            render_priv->engine.imul_bitmaps(nbuffer + atop * as + aleft, as,
-                                             bbuffer + btop * bs + bleft, bs,
-                                             w, h);
-        } else {
-            // Regular clip
-            if (ax + aw < bx || ay + ah < by || ax > bx + bw ||
-                ay > by + bh || !h || !w) {
+        int ax = cur->dst_x, ay = cur->dst_y, aw = cur->w, ah = cur->h;
+        int bx = pos.x + clip_bm->left, by = pos.y + clip_bm->top;
+        int bw = clip_bm->w, bh = clip_bm->h;
+
+        // Skip images that do not overlap the clip
+        int w = FFMIN(ax + aw, bx + bw) - FFMAX(ax, bx);
+        int h = FFMIN(ay + ah, by + bh) - FFMAX(ay, by);
+        if (w <= 0 || h <= 0) {
+            // regular clip hides these, inverse clip leaves them intact
+            if (!state->clip_drawing_mode)
                 cur->w = cur->h = cur->stride = 0;
-                continue;
-            }
-
-            // Allocate new buffer and add to free list
-            unsigned ns = ass_align(align, w);
-            nbuffer = ass_aligned_alloc(align, ns * h + align, false);
-            if (!nbuffer)
-                break;
-
-            // Blend together
-            render_priv->engine.mul_bitmaps(nbuffer, ns,
-                                            abuffer + atop * as + aleft, as,
-                                            bbuffer + btop * bs + bleft, bs,
-                                            w, h);
-            cur->dst_x += aleft;
-            cur->dst_y += atop;
-            cur->w = w;
-            cur->h = h;
-            cur->stride = ns;
+            continue;
         }
 
         ASS_ImagePriv *priv = (ASS_ImagePriv *) cur;
-        priv->buffer = cur->bitmap = nbuffer;
+        ClipHashKey key = {
+            .source = priv->source,
+            .bitmap = cur->bitmap,
+            .w = aw,
+            .h = ah,
+            .stride = cur->stride,
+            .clip = clip_bm,
+            .offset = { ax - bx, ay - by },
+            .inverse = state->clip_drawing_mode,
+        };
+        Bitmap *bm = ass_cache_get(render_priv->cache.clip_cache, &key, state);
+        if (!bm || !bm->buffer)
+            break;
+
+        ass_cache_inc_ref(bm);
         ass_cache_dec_ref(priv->source);
-        priv->source = NULL;
+        priv->source = bm;
+        cur->bitmap = bm->buffer;
+        cur->dst_x += bm->left;
+        cur->dst_y += bm->top;
+        cur->w = bm->w;
+        cur->h = bm->h;
+        cur->stride = bm->stride;
+    }
+}
+
+/**
+ * \brief Multiply an image by a vector clip mask or mask out a rectangle
+ * The result is positioned relative to the original image.
+ */
+size_t ass_clip_construct(void *key, void *value, void *priv)
+{
+    RenderContext *state = priv;
+    ASS_Renderer *render_priv = state->renderer;
+    ClipHashKey *k = key;
+    Bitmap *bm = value;
+    const Bitmap *clip = k->clip;
+
+    // Overlap in image coordinates
+    int mask_w = clip ? clip->w : k->rect.x;
+    int mask_h = clip ? clip->h : k->rect.y;
+    int left   = FFMAX(0, -k->offset.x);
+    int top    = FFMAX(0, -k->offset.y);
+    int right  = FFMIN(k->w, mask_w - k->offset.x);
+    int bottom = FFMIN(k->h, mask_h - k->offset.y);
+    int w = right - left, h = bottom - top;
+
+    memset(bm, 0, sizeof(*bm));
+    if (k->inverse) {
+        if (!ass_alloc_bitmap(&render_priv->engine, bm, k->w, k->h, false))
+            return 1;
+        for (int y = 0; y < k->h; y++)
+            memcpy(bm->buffer + y * bm->stride, k->bitmap + y * k->stride, k->w);
+        if (w > 0 && h > 0) {
+            uint8_t *dst = bm->buffer + top * bm->stride + left;
+            if (clip) {
+                const uint8_t *bbuffer = clip->buffer +
+                    (top + k->offset.y) * clip->stride + left + k->offset.x;
+                render_priv->engine.imul_bitmaps(dst, bm->stride,
+                                                 bbuffer, clip->stride, w, h);
+            } else {
+                for (int y = 0; y < h; y++)
+                    memset(dst + y * bm->stride, 0, w);
+            }
+        }
+    } else {
+        const uint8_t *abuffer = k->bitmap + top * k->stride + left;
+        const uint8_t *bbuffer = clip->buffer +
+            (top + k->offset.y) * clip->stride + left + k->offset.x;
+        if (!ass_alloc_bitmap(&render_priv->engine, bm, w, h, false))
+            return 1;
+        bm->left = left;
+        bm->top = top;
+        render_priv->engine.mul_bitmaps(bm->buffer, bm->stride,
+                                        abuffer, k->stride,
+                                        bbuffer, clip->stride, w, h);
     }
+
+    return sizeof(ClipHashKey) + sizeof(Bitmap) + bitmap_size(bm);
 }
 
 /**
@@ -908,7 +1179,7 @@ static ASS_Style *handle_selective_style_overrides(RenderContext *state,
 {
     // The script style is the one the event was declared with.
     ASS_Renderer *render_priv = state->renderer;
-    ASS_Style *script = render_priv->track->styles +
+    ASS_Style *script = state->track->styles +
                         state->event->Style;
     // The user style was set with ass_set_selective_style_override().
     ASS_Style *user = &render_priv->user_override_style;
@@ -947,7 +1218,7 @@ static ASS_Style *handle_selective_style_overrides(RenderContext *state,
     // The user style is supposed to be independent of the script resolution.
     // Treat the user style's values as if they were specified for a script with
     // PlayResY=288, and rescale the values to the current script.
-    scale = render_priv->track->PlayResY / 288.0;
+    scale = state->track->PlayResY / 288.0;
 
     if (requested & ASS_OVERRIDE_BIT_FONT_SIZE_FIELDS) {
         new->FontSize = user->FontSize * scale;
@@ -1005,9 +1276,8 @@ static ASS_Style *handle_selective_style_overrides(RenderContext *state,
     return new;
 }
 
-ASS_Vector ass_layout_res(ASS_Renderer *render_priv)
+ASS_Vector ass_layout_res(ASS_Renderer *render_priv, ASS_Track *track)
 {
-    ASS_Track *track = render_priv->track;
     if (track->LayoutResX > 0 && track->LayoutResY > 0)
         return (ASS_Vector) { track->LayoutResX, track->LayoutResY };
 
@@ -1044,13 +1314,13 @@ static void init_font_scale(RenderContext *state)
         font_scr_h = render_priv->fit_height;
     }
 
-    state->screen_scale_x = font_scr_w / render_priv->track->PlayResX;
-    state->screen_scale_y = font_scr_h / render_priv->track->PlayResY;
+    state->screen_scale_x = font_scr_w / state->track->PlayResX;
+    state->screen_scale_y = font_scr_h / state->track->PlayResY;
 
-    ASS_Vector layout_res = ass_layout_res(render_priv);
+    ASS_Vector layout_res = ass_layout_res(render_priv, state->track);
     state->blur_scale_x = font_scr_w / layout_res.x;
     state->blur_scale_y = font_scr_h / layout_res.y;
-    if (render_priv->track->ScaledBorderAndShadow) {
+    if (state->track->ScaledBorderAndShadow) {
         state->border_scale_x = state->screen_scale_x;
         state->border_scale_y = state->screen_scale_y;
     } else {
@@ -1116,13 +1386,11 @@ void ass_reset_render_context(RenderContext *state, ASS_Style *style)
 static void
 init_render_context(RenderContext *state, ASS_Event *event)
 {
-    ASS_Renderer *render_priv = state->renderer;
-
     state->event = event;
     state->parsed_tags = 0;
     state->evt_type = EVENT_NORMAL;
 
-    state->wrap_style = render_priv->track->WrapStyle;
+    state->wrap_style = state->track->WrapStyle;
 
     state->pos_x = 0;
     state->pos_y = 0;
@@ -1131,8 +1399,8 @@ init_render_context(RenderContext *state, ASS_Event *event)
     state->have_origin = 0;
     state->clip_x0 = 0;
     state->clip_y0 = 0;
-    state->clip_x1 = render_priv->track->PlayResX;
-    state->clip_y1 = render_priv->track->PlayResY;
+    state->clip_x1 = state->track->PlayResX;
+    state->clip_y1 = state->track->PlayResY;
     state->clip_mode = 0;
     state->detect_collisions = 1;
     state->fade = 0;
@@ -1187,7 +1455,7 @@ get_outline_glyph(RenderContext *state, GlyphInfo *info)
 
         int32_t scale_base = lshiftwrapi(1, info->drawing_scale - 1);
         double w = scale_base > 0 ? (1.0 / scale_base) : 0;
-        scale.x = info->scale_x * w * state->screen_scale_x / priv->par_scale_x;
+        scale.x = info->scale_x * w * state->screen_scale_x / state->par_scale_x;
         scale.y = info->scale_y * w * state->screen_scale_y;
         desc = 64 * info->drawing_pbo;
         asc = val->asc - desc;
@@ -1203,6 +1471,7 @@ get_outline_glyph(RenderContext *state, GlyphInfo *info)
         k->bold = info->bold;
         k->italic = info->italic;
         k->flags = info->flags;
+        k->hinting = priv->settings.hinting;
 
         val = ass_cache_get(priv->cache.outline_cache, &key, priv);
         if (!val || !val->valid)
@@ -1244,7 +1513,7 @@ size_t ass_outline_construct(void *key, void *value, void *priv)
             GlyphHashKey *k = &outline_key->u.glyph;
             ass_face_set_size(k->font->faces[k->face_index], k->size);
             if (!ass_font_get_glyph(k->font, k->face_index, k->glyph_index,
-                                    render_priv->settings.hinting))
+                                    k->hinting))
                 return 1;
             if (!ass_get_glyph_outline(&v->outline[0], &v->advance,
                                        k->font->faces[k->face_index],
@@ -1326,8 +1595,6 @@ size_t ass_outline_construct(void *key, void *value, void *priv)
 static void calc_transform_matrix(RenderContext *state,
                                   GlyphInfo *info, double m[3][3])
 {
-    ASS_Renderer *render_priv = state->renderer;
-
     double frx = ASS_PI / 180 * info->frx;
     double fry = ASS_PI / 180 * info->fry;
     double frz = ASS_PI / 180 * info->frz;
@@ -1362,8 +1629,8 @@ static void calc_transform_matrix(RenderContext *state,
     double dist = 20000 * state->blur_scale_y;
     z4[2] += dist;
 
-    double scale_x = dist * render_priv->par_scale_x;
-    double offs_x = info->pos.x - info->shift.x * render_priv->par_scale_x;
+    double scale_x = dist * state->par_scale_x;
+    double offs_x = info->pos.x - info->shift.x * state->par_scale_x;
     double offs_y = info->pos.y - info->shift.y;
     for (int i = 0; i < 3; i++) {
         m[0][i] = z4[i] * offs_x + x4[i] * scale_x;
@@ -1379,12 +1646,15 @@ static void calc_transform_matrix(RenderContext *state,
  * If they can't be found, they are generated by rotating and rendering the glyph.
  * After that, bitmaps are added to the cache.
  * They are returned in info->bm (glyph), info->bm_o (outline).
+ * \param first true until a glyph of the run has been placed;
+ * also cleared here when a drawable glyph is culled by the window
  */
 static void
 get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
                  int32_t *leftmost_x,
                  ASS_Vector *pos, ASS_Vector *pos_o,
-                 ASS_DVector *offset, bool first, int flags)
+                 ASS_DVector *offset, bool *first, int flags,
+                 const ASS_Rect *window)
 {
     ASS_Renderer *render_priv = state->renderer;
 
@@ -1404,12 +1674,34 @@ get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
     if (info->effect_type == EF_KARAOKE_KF)
         ass_outline_update_min_transformed_x(&info->outline->outline[0], m, leftmost_x);
 
+    // The first glyph of a run fixes the subpixel offset of the whole run,
+    // so quantize before culling: output must not depend on the window.
     BitmapHashKey key;
     key.outline = info->outline;
-    if (!quantize_transform(m, pos, offset, first, &key))
+    if (!quantize_transform(m, pos, offset, *first, &key))
         return;
 
-    info->bm = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    bool drawn = info->outline->outline[0].n_points ||
+                 info->outline->outline[1].n_points;
+    if (window && !(flags & FILTER_BORDER_STYLE_3)) {
+        double bord_x = 0, bord_y = 0;
+        if (flags & FILTER_NONZERO_BORDER) {
+            bord_x = 64 * state->border_scale_x * info->border_x / tr->scale.x /
+                state->par_scale_x;
+            bord_y = 64 * state->border_scale_y * info->border_y / tr->scale.y;
+        }
+        if (!glyph_visible(window, m2, &info->outline->cbox, bord_x, bord_y)) {
+            if (drawn)
+                *first = false;
+            return;
+        }
+    }
+
+    info->bm = NULL;
+    if (restrict_bitmap(window, *pos, &key))
+        info->bm = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    else if (drawn)
+        *first = false;
     if (!info->bm || !info->bm->buffer)
         info->bm = NULL;
 
@@ -1424,7 +1716,7 @@ get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
 
         ASS_DVector bord = {
             64 * info->border_x * state->border_scale_x /
-                render_priv->par_scale_x,
+                state->par_scale_x,
             64 * info->border_y * state->border_scale_y,
         };
         double width = info->hspacing_scaled + info->advance.x;
@@ -1465,7 +1757,7 @@ get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
 
         double bord_x =
             64 * state->border_scale_x * info->border_x / tr->scale.x /
-                render_priv->par_scale_x;
+                state->par_scale_x;
         double bord_y =
             64 * state->border_scale_y * info->border_y / tr->scale.y;
 
@@ -1533,7 +1825,9 @@ get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
             !quantize_transform(m, pos_o, offset, false, &key))
         return;
 
-    info->bm_o = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    info->bm_o = NULL;
+    if (restrict_bitmap(window, *pos_o, &key))
+        info->bm_o = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
     if (!info->bm_o || !info->bm_o->buffer) {
         info->bm_o = NULL;
         *pos_o = *pos;
@@ -1546,12 +1840,52 @@ static inline size_t outline_size(const ASS_Outline* outline)
     return sizeof(ASS_Vector) * outline->n_points + outline->n_segments;
 }
 
+/**
+ * \brief Try to load the bitmaps of a cache value from the disk cache
+ * \param digest stable digest function of the cache key
+ * \param disk_key out: key for store_to_disk()
+ * \param start out: time to measure construction cost from
+ * \return true if loaded
+ */
+static bool load_from_disk(ASS_Renderer *render_priv, HashFunction digest,
+                           void *key, DiskCacheKey *disk_key, double *start,
+                           Bitmap *const *bm, size_t n_bm)
+{
+    DiskCache *disk_cache = render_priv->cache.disk_cache;
+    *start = 0;
+    if (!disk_cache)
+        return false;
+    ass_disk_cache_key(disk_cache, disk_key, digest, key);
+    if (ass_disk_cache_load(disk_cache, disk_key, &render_priv->engine, bm, n_bm))
+        return true;
+    *start = ass_thread_time();
+    return false;
+}
+
+/**
+ * \brief Store constructed bitmaps if they were costly to make
+ */
+static void store_to_disk(ASS_Renderer *render_priv,
+                          const DiskCacheKey *disk_key, double start,
+                          Bitmap *const *bm, size_t n_bm)
+{
+    DiskCache *disk_cache = render_priv->cache.disk_cache;
+    if (disk_cache && ass_thread_time() - start >= DISK_CACHE_MIN_COST)
+        ass_disk_cache_store(disk_cache, disk_key, bm, n_bm);
+}
+
 size_t ass_bitmap_construct(void *key, void *value, void *priv)
 {
     RenderContext *state = priv;
     BitmapHashKey *k = key;
     Bitmap *bm = value;
 
+    DiskCacheKey disk_key;
+    double start;
+    if (load_from_disk(state->renderer, ass_bitmap_digest, k,
+                       &disk_key, &start, &bm, 1))
+        goto done;
+
     double m[3][3];
     restore_transform(m, k);
 
@@ -1564,11 +1898,17 @@ size_t ass_bitmap_construct(void *key, void *value, void *priv)
         ass_outline_transform_2d(&outline[1], &k->outline->outline[1], m);
     }
 
-    if (!ass_outline_to_bitmap(state, bm, &outline[0], &outline[1]))
+    ASS_Rect window = {
+        k->window_min.x, k->window_min.y,
+        k->window_max.x, k->window_max.y,
+    };
+    if (!ass_outline_to_bitmap(state, bm, &outline[0], &outline[1], &window))
         memset(bm, 0, sizeof(*bm));
     ass_outline_free(&outline[0]);
     ass_outline_free(&outline[1]);
+    store_to_disk(state->renderer, &disk_key, start, &bm, 1);
 
+done:
     return sizeof(BitmapHashKey) + sizeof(Bitmap) + bitmap_size(bm) +
            sizeof(OutlineHashValue) + outline_size(&k->outline->outline[0]) + outline_size(&k->outline->outline[1]);
 }
@@ -1931,11 +2271,11 @@ wrap_lines_smart(RenderContext *state, double max_text_width)
 #ifdef CONFIG_UNIBREAK
     ASS_Renderer *render_priv = state->renderer;
     TextInfo *text_info = &state->text_info;
-    if (render_priv->track->parser_priv->feature_flags & FEATURE_MASK(ASS_FEATURE_WRAP_UNICODE)) {
+    if (state->track->parser_priv->feature_flags & FEATURE_MASK(ASS_FEATURE_WRAP_UNICODE)) {
         unibrks = text_info->breaks;
         set_linebreaks_utf32(
             text_info->event_text, text_info->length,
-            render_priv->track->Language, unibrks);
+            state->track->Language, unibrks);
 #if UNIBREAK_VERSION < 0x0500UL
         // Prior to 5.0 libunibreaks always ended text with LINE_BREAKMUSTBREAK, matching
         // Unicode spec, but messing with our text-overflow detection.
@@ -1944,7 +2284,7 @@ wrap_lines_smart(RenderContext *state, double max_text_width)
         unibrks[text_info->length - 1] = is_line_breakable(
             text_info->event_text[text_info->length - 1],
             ' ',
-            render_priv->track->Language
+            state->track->Language
         );
 #endif
     }
@@ -1964,7 +2304,7 @@ wrap_lines_smart(RenderContext *state, double max_text_width)
  * \param alignment alignment
  * \param bx, by out: base point coordinates
  */
-static void get_base_point(ASS_DRect *bbox, int alignment, double *bx, double *by)
+static void get_base_point(const ASS_DRect *bbox, int alignment, double *bx, double *by)
 {
     const int halign = alignment & 3;
     const int valign = alignment & 12;
@@ -2010,6 +2350,9 @@ fix_glyph_scaling(ASS_Renderer *priv, GlyphInfo *glyph)
     if (priv->settings.hinting == ASS_HINTING_NONE) {
         // arbitrary, not too small to prevent grid fitting rounding effects
         // XXX: this is a rather crude hack
+        // Since the size is the same for all glyphs, outlines, metrics
+        // and shaping results are shared between all font sizes and
+        // the actual size is applied through the glyph transform.
         ft_size = 256.0;
     } else {
         // If hinting is enabled, we want to pass the real font size
@@ -2182,7 +2525,7 @@ static bool parse_events(RenderContext *state, ASS_Event *event)
 
         if (!drawing_text.str) {
             info->hspacing_scaled = double_to_d6(info->hspacing *
-                    state->screen_scale_x / render_priv->par_scale_x *
+                    state->screen_scale_x / state->par_scale_x *
                     info->scale_x);
             fix_glyph_scaling(render_priv, info);
         }
@@ -2255,16 +2598,14 @@ static void preliminary_layout(RenderContext *state)
 }
 
 // Reorder text into visual order
-static void reorder_text(RenderContext *state)
+static bool reorder_text(RenderContext *state)
 {
     ASS_Renderer *render_priv = state->renderer;
     TextInfo *text_info = &state->text_info;
     FriBidiStrIndex *cmap = ass_shaper_reorder(state->shaper, text_info);
     if (!cmap) {
         ass_msg(render_priv->library, MSGL_ERR, "Failed to reorder text");
-        ass_shaper_cleanup(state->shaper, text_info);
-        free_render_context(state);
-        return;
+        return false;
     }
 
     // Reposition according to the map
@@ -2292,16 +2633,16 @@ static void reorder_text(RenderContext *state)
             info = info->next;
         }
     }
+    return true;
 }
 
 static void apply_baseline_shear(RenderContext *state)
 {
-    ASS_Renderer *render_priv = state->renderer;
     TextInfo *text_info = &state->text_info;
     FriBidiStrIndex *cmap = ass_shaper_get_reorder_map(state->shaper);
     int32_t shear = 0;
     bool whole_text_layout =
-        render_priv->track->parser_priv->feature_flags &
+        state->track->parser_priv->feature_flags &
         FEATURE_MASK(ASS_FEATURE_WHOLE_TEXT_LAYOUT);
     for (int i = 0; i < text_info->length; i++) {
         GlyphInfo *info = text_info->glyphs + cmap[i];
@@ -2391,14 +2732,300 @@ static void align_lines(RenderContext *state, double max_text_width)
     }
 }
 
-static void calculate_rotation_params(RenderContext *state, ASS_DRect *bbox,
-                                      double device_x, double device_y)
+/**
+ * \brief Shape, wrap and position event text
+ * Fills glyph outlines, positions and line breaks of text_info.
+ * \param bbox out: text bounding box before baseline shear
+ */
+static bool layout_text(RenderContext *state, double max_text_width,
+                        ASS_DRect *bbox)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    TextInfo *text_info = &state->text_info;
+
+    // Find shape runs and shape text; both use fonts of the database
+    // directly, which other renderers may be using at the same time
+    ass_shaper_set_base_direction(state->shaper,
+            ass_resolve_base_direction(state->font_encoding));
+    ass_font_database_lock(render_priv->fontdb);
+    ass_shaper_find_runs(state->shaper, render_priv, text_info->glyphs,
+            text_info->length);
+    bool shaped = ass_shaper_shape(state->shaper, text_info);
+    ass_font_database_unlock(render_priv->fontdb);
+    if (!shaped) {
+        ass_msg(render_priv->library, MSGL_ERR, "Failed to shape text");
+        return false;
+    }
+
+    retrieve_glyphs(state);
+
+    preliminary_layout(state);
+
+    // wrap lines
+    wrap_lines_smart(state, max_text_width);
+
+    // depends on glyph x coordinates being monotonous within runs, so it should be done before reorder
+    ass_process_karaoke_effects(state);
+
+    if (!reorder_text(state))
+        return false;
+
+    align_lines(state, max_text_width);
+
+    // determine text bounding box
+    compute_string_bbox(text_info, bbox);
+
+    apply_baseline_shear(state);
+    return true;
+}
+
+// per-glyph inputs of layout_text(), serialized into LayoutHashKey::glyphs
+// together with the drawing text that follows each of them
+typedef struct {
+    double font_size;
+    double scale_x, scale_y, scale_fix;
+    double fay;
+    double hspacing;
+    ASS_Font *font;
+    unsigned symbol;
+    unsigned bold, italic;
+    int flags;
+    int hspacing_scaled;
+    int drawing_scale, drawing_pbo;
+    size_t drawing_len;
+    bool starts_new_run;
+} LayoutGlyphKey;
+
+/**
+ * \brief Collect everything layout_text() depends on into a layout cache key
+ * Parameters that are only applied after layout, like colors, rotation,
+ * fade, blur or the event position, are deliberately left out.
+ * \return false if the layout of this event cannot be cached
+ */
+static bool build_layout_key(RenderContext *state, double max_text_width,
+                             LayoutHashKey *key)
 {
     ASS_Renderer *render_priv = state->renderer;
+    ASS_Track *track = state->track;
+    TextInfo *text_info = &state->text_info;
+
+    // karaoke timing is resolved against glyph positions mid-layout
+    size_t size = 0;
+    for (int i = 0; i < text_info->length; i++) {
+        GlyphInfo *info = text_info->glyphs + i;
+        if (info->effect_type != EF_NONE || info->effect_timing)
+            return false;
+        size += sizeof(LayoutGlyphKey) + info->drawing_text.len;
+    }
+    if (size > text_info->layout_key_size) {
+        char *buf = realloc(text_info->layout_key, size);
+        if (!buf)
+            return false;
+        text_info->layout_key = buf;
+        text_info->layout_key_size = size;
+    }
+
+    char *ptr = text_info->layout_key;
+    for (int i = 0; i < text_info->length; i++) {
+        GlyphInfo *info = text_info->glyphs + i;
+        LayoutGlyphKey glyph;
+        // padding is hashed and compared too
+        memset(&glyph, 0, sizeof(glyph));
+        glyph.font_size = info->font_size;
+        glyph.scale_x = info->scale_x;
+        glyph.scale_y = info->scale_y;
+        glyph.scale_fix = info->scale_fix;
+        glyph.fay = info->fay;
+        glyph.hspacing = info->hspacing;
+        glyph.font = info->font;
+        glyph.symbol = info->symbol;
+        glyph.bold = info->bold;
+        glyph.italic = info->italic;
+        glyph.flags = info->flags;
+        glyph.hspacing_scaled = info->hspacing_scaled;
+        glyph.drawing_scale = info->drawing_scale;
+        glyph.drawing_pbo = info->drawing_pbo;
+        glyph.drawing_len = info->drawing_text.len;
+        glyph.starts_new_run = info->starts_new_run;
+        memcpy(ptr, &glyph, sizeof(glyph));
+        ptr += sizeof(glyph);
+        if (info->drawing_text.len) {
+            memcpy(ptr, info->drawing_text.str, info->drawing_text.len);
+            ptr += info->drawing_text.len;
+        }
+    }
+
+    key->glyphs.str = text_info->layout_key;
+    key->glyphs.len = size;
+    key->language.str = track->Language ? track->Language : "";
+    key->language.len = strlen(key->language.str);
+    key->max_text_width = max_text_width;
+    key->screen_scale_x = state->screen_scale_x;
+    key->screen_scale_y = state->screen_scale_y;
+    key->par_scale_x = state->par_scale_x;
+    key->line_spacing = render_priv->settings.line_spacing;
+    key->shaper = render_priv->settings.shaper;
+    key->hinting = render_priv->settings.hinting;
+    key->kerning = track->Kerning;
+    key->feature_flags = track->parser_priv->feature_flags;
+    key->font_encoding = state->font_encoding;
+    key->wrap_style = state->wrap_style;
+    key->halign = state->alignment & 3;
+    key->justify = state->justify;
+    key->hscroll = !!(state->evt_type & EVENT_HSCROLL);
+    return true;
+}
+
+size_t ass_layout_construct(void *key, void *value, void *priv)
+{
+    RenderContext *state = priv;
+    LayoutHashKey *k = key;
+    LayoutHashValue *v = value;
+    TextInfo *text_info = &state->text_info;
+    memset(v, 0, sizeof(*v));
+
+    if (!layout_text(state, k->max_text_width, &v->bbox))
+        return 1;
+
+    int glyph_count = 0;
+    for (int i = 0; i < text_info->length; i++)
+        for (GlyphInfo *info = text_info->glyphs + i; info; info = info->next)
+            glyph_count++;
+
+    if (!ASS_REALLOC_ARRAY(v->glyphs, glyph_count) ||
+            !ASS_REALLOC_ARRAY(v->lines, text_info->n_lines)) {
+        free(v->glyphs);
+        v->glyphs = NULL;
+        return 1;
+    }
+
+    LayoutGlyph *out = v->glyphs;
+    for (int i = 0; i < text_info->length; i++) {
+        for (GlyphInfo *info = text_info->glyphs + i; info; info = info->next) {
+            out->outline = info->outline;
+            ass_cache_inc_ref(info->outline);
+            out->transform_scale = info->transform.scale;
+            out->transform_offset = info->transform.offset;
+            out->bbox = info->bbox;
+            out->pos = info->pos;
+            out->offset = info->offset;
+            out->advance = info->advance;
+            out->cluster_advance = info->cluster_advance;
+            out->face_index = info->face_index;
+            out->glyph_index = info->glyph_index;
+            out->script = info->script;
+            out->asc = info->asc;
+            out->desc = info->desc;
+            out->shape_run_id = info->shape_run_id;
+            out->linebreak = info->linebreak;
+            out->skip = info->skip;
+            out->is_trimmed_whitespace = info->is_trimmed_whitespace;
+            out->starts_new_run = info->starts_new_run;
+            out->cluster_end = !info->next;
+            out++;
+        }
+    }
+    v->glyph_count = glyph_count;
+
+    for (int i = 0; i < text_info->n_lines; i++) {
+        v->lines[i].offset = text_info->lines[i].offset;
+        v->lines[i].len = text_info->lines[i].len;
+    }
+    v->n_lines = text_info->n_lines;
+
+    v->valid = true;
+    return 1;
+}
+
+/**
+ * \brief Apply a cached layout to freshly parsed event text
+ * Glyphs keep their own rendering parameters; only the results
+ * of layout_text() are taken from the cache.
+ */
+static bool restore_layout(RenderContext *state, LayoutHashValue *layout)
+{
+    TextInfo *text_info = &state->text_info;
+
+    if (layout->n_lines > text_info->max_lines) {
+        if (!ASS_REALLOC_ARRAY(text_info->lines, layout->n_lines))
+            return false;
+        text_info->max_lines = layout->n_lines;
+    }
+    for (int i = 0; i < layout->n_lines; i++) {
+        text_info->lines[i].offset = layout->lines[i].offset;
+        text_info->lines[i].len = layout->lines[i].len;
+    }
+    text_info->n_lines = layout->n_lines;
+
+    LayoutGlyph *src = layout->glyphs;
+    for (int i = 0; i < text_info->length; i++) {
+        for (GlyphInfo *info = text_info->glyphs + i;; info = info->next) {
+            info->outline = src->outline;
+            info->transform.scale = src->transform_scale;
+            info->transform.offset = src->transform_offset;
+            info->bbox = src->bbox;
+            info->pos = src->pos;
+            info->offset = src->offset;
+            info->advance = src->advance;
+            info->cluster_advance = src->cluster_advance;
+            info->face_index = src->face_index;
+            info->glyph_index = src->glyph_index;
+            info->script = src->script;
+            info->asc = src->asc;
+            info->desc = src->desc;
+            info->shape_run_id = src->shape_run_id;
+            info->linebreak = src->linebreak;
+            info->skip = src->skip;
+            info->is_trimmed_whitespace = src->is_trimmed_whitespace;
+            info->starts_new_run = src->starts_new_run;
+            if ((src++)->cluster_end)
+                break;
+
+            // the text was just laid out if the cluster is already there
+            if (!info->next) {
+                info->next = malloc(sizeof(GlyphInfo));
+                if (!info->next)
+                    return false;
+                *info->next = *info;
+                info->next->next = NULL;
+            }
+        }
+    }
+
+    // border size does not affect layout but is accounted for here
+    measure_text(state);
+    return true;
+}
+
+/**
+ * \brief Lay out event text, reusing the layout of a previous frame if possible
+ * Animations that leave layout inputs intact, e.g. \move, \fad or \t
+ * with colors, rotation or border, only rerun the rendering stages.
+ * \param bbox out: text bounding box before baseline shear
+ */
+static bool layout_event_text(RenderContext *state, double max_text_width,
+                              ASS_DRect *bbox)
+{
+    LayoutHashKey key;
+    if (!build_layout_key(state, max_text_width, &key))
+        return layout_text(state, max_text_width, bbox);
+
+    LayoutHashValue *layout =
+        ass_cache_get(state->renderer->cache.layout_cache, &key, state);
+    if (!layout || !layout->valid)
+        return false;
+    *bbox = layout->bbox;
+    return restore_layout(state, layout);
+}
+
+static void calculate_rotation_params(RenderContext *state,
+                                      const ASS_DRect *bbox,
+                                      double device_x, double device_y)
+{
     ASS_DVector center;
     if (state->have_origin) {
-        center.x = x2scr_pos(render_priv, state->org_x);
-        center.y = y2scr_pos(render_priv, state->org_y);
+        center.x = x2scr_pos(state, state->org_x);
+        center.y = y2scr_pos(state, state->org_y);
     } else {
         double bx = 0., by = 0.;
         get_base_point(bbox, state->alignment, &bx, &by);
@@ -2412,7 +3039,7 @@ static void calculate_rotation_params(RenderContext *state, ASS_DRect *bbox,
         while (info) {
             info->shift.x = info->pos.x + double_to_d6(device_x - center.x +
                     info->shadow_x * state->border_scale_x /
-                    render_priv->par_scale_x);
+                    state->par_scale_x);
             info->shift.y = info->pos.y + double_to_d6(device_y - center.y +
                     info->shadow_y * state->border_scale_y);
             info = info->next;
@@ -2469,6 +3096,43 @@ static double restore_blur(int qblur)
     return sigma * sigma;
 }
 
+/**
+ * \brief Find the part of the screen that can affect visible output
+ * Bitmaps are clipped to the screen and the \clip rectangle in the end,
+ * but blur, \be and shadow offset can bring in pixels from further away.
+ */
+static void get_visible_window(RenderContext *state, const FilterDesc *filter,
+                               ASS_Rect *window)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    *window = (ASS_Rect) { 0, 0, render_priv->width, render_priv->height };
+    if (!state->clip_mode) {
+        window->x_min = FFMAX(window->x_min, state->clip_x0);
+        window->y_min = FFMAX(window->y_min, state->clip_y0);
+        window->x_max = FFMIN(window->x_max, state->clip_x1);
+        window->y_max = FFMIN(window->y_max, state->clip_y1);
+    }
+    if (window->x_min >= window->x_max || window->y_min >= window->y_max)
+        return;
+
+    int pad_x = filter->be, pad_y = filter->be;
+    double r2x = restore_blur(filter->blur_x);
+    double r2y = restore_blur(filter->blur_y);
+    if (r2x > 0.001 || r2y > 0.001) {
+        pad_x += ass_gaussian_blur_padding(r2x);
+        pad_y += ass_gaussian_blur_padding(r2y);
+    }
+    if (filter->flags & FILTER_NONZERO_SHADOW) {
+        // extra pixel for subpixel shift
+        pad_x += abs(filter->shadow.x >> 6) + 1;
+        pad_y += abs(filter->shadow.y >> 6) + 1;
+    }
+    window->x_min -= pad_x;
+    window->y_min -= pad_y;
+    window->x_max += pad_x;
+    window->y_max += pad_y;
+}
+
 // Convert glyphs to bitmaps, combine them, apply blur, generate shadows.
 static void render_and_combine_glyphs(RenderContext *state,
                                       double device_x, double device_y)
@@ -2476,12 +3140,14 @@ static void render_and_combine_glyphs(RenderContext *state,
     ASS_Renderer *render_priv = state->renderer;
     TextInfo *text_info = &state->text_info;
     int left = render_priv->settings.left_margin;
-    device_x = (device_x - left) * render_priv->par_scale_x + left;
+    device_x = (device_x - left) * state->par_scale_x + left;
     unsigned nb_bitmaps = 0;
-    bool new_run = true;
+    bool new_run = true, first = true;
     CombinedBitmapInfo *combined_info = text_info->combined_bitmaps;
     CombinedBitmapInfo *current_info = NULL;
     ASS_DVector offset;
+    ASS_Rect window;
+    bool visible = true;
     for (int i = 0; i < text_info->length; i++) {
         GlyphInfo *info = text_info->glyphs + i;
         if (info->starts_new_run) new_run = true;
@@ -2525,6 +3191,12 @@ static void render_and_combine_glyphs(RenderContext *state,
 
                 memcpy(&current_info->c, &info->c, sizeof(info->c));
                 ass_apply_fade(current_info->c, info->fade);
+                // a run with all colors fully transparent
+                // (e.g. at the ends of \fad) produces nothing visible
+                visible = false;
+                for (int j = 0; j < 4; j++)
+                    if (_a(current_info->c[j]) != 0xFF)
+                        visible = true;
 
                 current_info->effect_type = info->effect_type;
                 current_info->effect_timing = info->effect_timing;
@@ -2547,6 +3219,7 @@ static void render_and_combine_glyphs(RenderContext *state,
                     filter->shadow.y = (y + (shadow_mask_y >> 1)) & ~shadow_mask_y;
                 } else
                     filter->shadow.x = filter->shadow.y = 0;
+                get_visible_window(state, filter, &window);
 
                 current_info->x = current_info->y = INT_MAX;
                 current_info->bm = current_info->bm_o = current_info->bm_s = NULL;
@@ -2561,17 +3234,21 @@ static void render_and_combine_glyphs(RenderContext *state,
 
                 nb_bitmaps++;
                 new_run = false;
+                first = true;
             }
             assert(current_info);
 
             ASS_Vector pos, pos_o;
-            info->pos.x = double_to_d6(device_x + d6_to_double(info->pos.x) * render_priv->par_scale_x);
+            info->pos.x = double_to_d6(device_x + d6_to_double(info->pos.x) * state->par_scale_x);
             info->pos.y = double_to_d6(device_y) + info->pos.y;
+            if (!visible)
+                continue;
             get_bitmap_glyph(state, info, &current_info->leftmost_x, &pos, &pos_o,
-                             &offset, !current_info->bitmap_count, flags);
+                             &offset, &first, flags, &window);
 
             if (!info->bm && !info->bm_o)
                 continue;
+            first = false;
 
             if (current_info->bitmap_count >= current_info->max_bitmap_count) {
                 size_t new_size = 2 * current_info->max_bitmap_count;
@@ -2600,7 +3277,7 @@ static void render_and_combine_glyphs(RenderContext *state,
 
         if (info->effect_type == EF_KARAOKE_KF)
             info->effect_timing = lround(d6_to_double(info->leftmost_x) +
-                d6_to_double(info->effect_timing) * render_priv->par_scale_x);
+                d6_to_double(info->effect_timing) * state->par_scale_x);
 
         for (int j = 0; j < info->bitmap_count; j++) {
             info->bitmaps[j].pos.x -= info->x;
@@ -2613,7 +3290,7 @@ static void render_and_combine_glyphs(RenderContext *state,
         key.filter = info->filter;
         key.bitmap_count = info->bitmap_count;
         key.bitmaps = info->bitmaps;
-        CompositeHashValue *val = ass_cache_get(render_priv->cache.composite_cache, &key, render_priv);
+        CompositeHashValue *val = ass_cache_get(render_priv->cache.composite_cache, &key, state);
         if (!val)
             continue;
 
@@ -2667,11 +3344,19 @@ int ass_be_padding(int be)
 
 size_t ass_composite_construct(void *key, void *value, void *priv)
 {
-    ASS_Renderer *render_priv = priv;
+    RenderContext *state = priv;
+    ASS_Renderer *render_priv = state->renderer;
     CompositeHashKey *k = key;
     CompositeHashValue *v = value;
     memset(v, 0, sizeof(*v));
 
+    Bitmap *const bitmaps[] = { &v->bm, &v->bm_o, &v->bm_s };
+    DiskCacheKey disk_key;
+    double start;
+    if (load_from_disk(render_priv, ass_composite_digest, k,
+                       &disk_key, &start, bitmaps, 3))
+        goto done;
+
     ASS_Rect rect, rect_o;
     rectangle_reset(&rect);
     rectangle_reset(&rect_o);
@@ -2748,17 +3433,17 @@ size_t ass_composite_construct(void *key, void *value, void *priv)
     double r2x = restore_blur(k->filter.blur_x);
     double r2y = restore_blur(k->filter.blur_y);
     if (!(flags & FILTER_NONZERO_BORDER) || (flags & FILTER_BORDER_STYLE_3))
-        ass_synth_blur(&render_priv->engine, &v->bm, k->filter.be, r2x, r2y);
-    ass_synth_blur(&render_priv->engine, &v->bm_o, k->filter.be, r2x, r2y);
+        ass_synth_blur(&render_priv->engine, &state->filter, &v->bm, k->filter.be, r2x, r2y);
+    ass_synth_blur(&render_priv->engine, &state->filter, &v->bm_o, k->filter.be, r2x, r2y);
 
     if (!(flags & FILTER_FILL_IN_BORDER) && !(flags & FILTER_FILL_IN_SHADOW))
-        ass_fix_outline(&v->bm, &v->bm_o);
+        ass_fix_outline(&render_priv->engine, &v->bm, &v->bm_o);
 
     if (flags & FILTER_NONZERO_SHADOW) {
         if (flags & FILTER_NONZERO_BORDER) {
             ass_copy_bitmap(&render_priv->engine, &v->bm_s, &v->bm_o);
             if ((flags & FILTER_FILL_IN_BORDER) && !(flags & FILTER_FILL_IN_SHADOW))
-                ass_fix_outline(&v->bm, &v->bm_s);
+                ass_fix_outline(&render_priv->engine, &v->bm, &v->bm_s);
         } else if (flags & FILTER_BORDER_STYLE_3) {
             v->bm_s = v->bm_o;
             memset(&v->bm_o, 0, sizeof(v->bm_o));
@@ -2770,12 +3455,16 @@ size_t ass_composite_construct(void *key, void *value, void *priv)
         // '>>' rounds toward negative infinity, '&' returns correct remainder
         v->bm_s.left += k->filter.shadow.x >> 6;
         v->bm_s.top  += k->filter.shadow.y >> 6;
-        ass_shift_bitmap(&v->bm_s, k->filter.shadow.x & SUBPIXEL_MASK, k->filter.shadow.y & SUBPIXEL_MASK);
+        ass_shift_bitmap(&render_priv->engine, &v->bm_s,
+                         k->filter.shadow.x & SUBPIXEL_MASK,
+                         k->filter.shadow.y & SUBPIXEL_MASK);
     }
 
     if ((flags & FILTER_FILL_IN_SHADOW) && !(flags & FILTER_FILL_IN_BORDER))
-        ass_fix_outline(&v->bm, &v->bm_o);
+        ass_fix_outline(&render_priv->engine, &v->bm, &v->bm_o);
+    store_to_disk(render_priv, &disk_key, start, bitmaps, 3);
 
+done:
     return sizeof(CompositeHashKey) + sizeof(CompositeHashValue) +
         k->bitmap_count * sizeof(BitmapRef) +
         bitmap_size(&v->bm) + bitmap_size(&v->bm_o) + bitmap_size(&v->bm_s);
@@ -2812,18 +3501,28 @@ static void add_background(RenderContext *state, EventImages *event_images)
     }
 }
 
-/**
- * \brief Main ass rendering function, glues everything together
- * \param event event to render
- * \param event_images struct containing resulting images, will also be initialized
- * Process event, appending resulting ASS_Image's to images_root.
+// calculate max length of a line
+static double get_max_text_width(RenderContext *state)
+{
+    ASS_Event *event = state->event;
+    int MarginL =
+        (event->MarginL) ? event->MarginL : state->style->MarginL;
+    int MarginR =
+        (event->MarginR) ? event->MarginR : state->style->MarginR;
+    return x2scr_right(state, state->track->PlayResX - MarginR) -
+           x2scr_left(state, MarginL);
+}
+
+/**
+ * \brief Parse, shape and lay out the text of an event
+ * \param bbox out: text bounding box before baseline shear
+ * \return false if there is nothing to render, with the context freed
  */
-static bool
-ass_render_event(RenderContext *state, ASS_Event *event,
-                 EventImages *event_images)
+static bool layout_event(RenderContext *state, ASS_Event *event,
+                         ASS_DRect *bbox)
 {
     ASS_Renderer *render_priv = state->renderer;
-    if (event->Style >= render_priv->track->n_styles) {
+    if (event->Style >= state->track->n_styles) {
         ass_msg(render_priv->library, MSGL_WARN, "No style found");
         return false;
     }
@@ -2847,51 +3546,33 @@ ass_render_event(RenderContext *state, ASS_Event *event,
 
     split_style_runs(state);
 
-    // Find shape runs and shape text
-    ass_shaper_set_base_direction(state->shaper,
-            ass_resolve_base_direction(state->font_encoding));
-    ass_shaper_find_runs(state->shaper, render_priv, text_info->glyphs,
-            text_info->length);
-    if (!ass_shaper_shape(state->shaper, text_info)) {
-        ass_msg(render_priv->library, MSGL_ERR, "Failed to shape text");
+    if (!layout_event_text(state, get_max_text_width(state), bbox)) {
+        ass_shaper_cleanup(state->shaper, text_info);
         free_render_context(state);
         return false;
     }
+    return true;
+}
 
-    retrieve_glyphs(state);
-
-    preliminary_layout(state);
+/**
+ * \brief Position and render laid out event text, then free the context
+ * \param bbox text bounding box from layout_event()
+ * \param event_images struct containing resulting images, will also be initialized
+ */
+static void place_event(RenderContext *state, const ASS_DRect *bbox,
+                        EventImages *event_images)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    ASS_Event *event = state->event;
+    TextInfo *text_info = &state->text_info;
 
     int valign = state->alignment & 12;
 
     int MarginL =
         (event->MarginL) ? event->MarginL : state->style->MarginL;
-    int MarginR =
-        (event->MarginR) ? event->MarginR : state->style->MarginR;
     int MarginV =
         (event->MarginV) ? event->MarginV : state->style->MarginV;
 
-    // calculate max length of a line
-    double max_text_width =
-        x2scr_right(state, render_priv->track->PlayResX - MarginR) -
-        x2scr_left(state, MarginL);
-
-    // wrap lines
-    wrap_lines_smart(state, max_text_width);
-
-    // depends on glyph x coordinates being monotonous within runs, so it should be done before reorder
-    ass_process_karaoke_effects(state);
-
-    reorder_text(state);
-
-    align_lines(state, max_text_width);
-
-    // determine text bounding box
-    ASS_DRect bbox;
-    compute_string_bbox(text_info, &bbox);
-
-    apply_baseline_shear(state);
-
     // determine device coordinates for text
     double device_x = 0;
     double device_y = 0;
@@ -2901,24 +3582,24 @@ ass_render_event(RenderContext *state, ASS_Event *event,
     if (state->evt_type & EVENT_POSITIONED) {
         double base_x = 0;
         double base_y = 0;
-        get_base_point(&bbox, state->alignment, &base_x, &base_y);
+        get_base_point(bbox, state->alignment, &base_x, &base_y);
         device_x =
-            x2scr_pos(render_priv, state->pos_x) - base_x;
+            x2scr_pos(state, state->pos_x) - base_x;
         device_y =
-            y2scr_pos(render_priv, state->pos_y) - base_y;
+            y2scr_pos(state, state->pos_y) - base_y;
     }
 
     // x coordinate
     if (state->evt_type & EVENT_HSCROLL) {
         if (state->scroll_direction == SCROLL_RL)
             device_x =
-                x2scr_pos(render_priv,
-                      render_priv->track->PlayResX -
+                x2scr_pos(state,
+                      state->track->PlayResX -
                       state->scroll_shift);
         else if (state->scroll_direction == SCROLL_LR)
             device_x =
-                x2scr_pos(render_priv, state->scroll_shift) -
-                (bbox.x_max - bbox.x_min);
+                x2scr_pos(state, state->scroll_shift) -
+                (bbox->x_max - bbox->x_min);
     } else if (!(state->evt_type & EVENT_POSITIONED)) {
         device_x = x2scr_left(state, MarginL);
     }
@@ -2930,13 +3611,13 @@ ass_render_event(RenderContext *state, ASS_Event *event,
                 y2scr(state,
                       state->scroll_y0 +
                       state->scroll_shift) -
-                bbox.y_max;
+                bbox->y_max;
         else if (state->scroll_direction == SCROLL_BT)
             device_y =
                 y2scr(state,
                       state->scroll_y1 -
                       state->scroll_shift) -
-                bbox.y_min;
+                bbox->y_min;
     } else if (!(state->evt_type & EVENT_POSITIONED)) {
         if (valign == VALIGN_TOP) {     // toptitle
             device_y =
@@ -2944,8 +3625,8 @@ ass_render_event(RenderContext *state, ASS_Event *event,
                           MarginV) + text_info->lines[0].asc;
         } else if (valign == VALIGN_CENTER) {   // midtitle
             double scr_y =
-                y2scr(state, render_priv->track->PlayResY / 2.0);
-            device_y = scr_y - (bbox.y_max + bbox.y_min) / 2.0;
+                y2scr(state, state->track->PlayResY / 2.0);
+            device_y = scr_y - (bbox->y_max + bbox->y_min) / 2.0;
         } else {                // subtitle
             double line_pos = state->explicit ?
                 0 : render_priv->settings.line_position;
@@ -2955,7 +3636,7 @@ ass_render_event(RenderContext *state, ASS_Event *event,
                        "Invalid valign, assuming 0 (subtitle)");
             scr_bottom =
                 y2scr_sub(state,
-                          render_priv->track->PlayResY - MarginV);
+                          state->track->PlayResY - MarginV);
             scr_top = y2scr_top(state, 0); //xxx not always 0?
             device_y = scr_bottom + (scr_top - scr_bottom) * line_pos / 100.0;
             device_y -= text_info->height;
@@ -2973,13 +3654,13 @@ ass_render_event(RenderContext *state, ASS_Event *event,
     // fix clip coordinates
     if (state->explicit || !render_priv->settings.use_margins) {
         state->clip_x0 =
-            lround(x2scr_pos_scaled(render_priv, state->clip_x0));
+            lround(x2scr_pos_scaled(state, state->clip_x0));
         state->clip_x1 =
-            lround(x2scr_pos_scaled(render_priv, state->clip_x1));
+            lround(x2scr_pos_scaled(state, state->clip_x1));
         state->clip_y0 =
-            lround(y2scr_pos(render_priv, state->clip_y0));
+            lround(y2scr_pos(state, state->clip_y0));
         state->clip_y1 =
-            lround(y2scr_pos(render_priv, state->clip_y1));
+            lround(y2scr_pos(state, state->clip_y1));
 
         if (state->explicit) {
             // we still need to clip against screen boundaries
@@ -3002,14 +3683,14 @@ ass_render_event(RenderContext *state, ASS_Event *event,
     }
 
     if (state->evt_type & EVENT_VSCROLL) {
-        int y0 = lround(y2scr_pos(render_priv, state->scroll_y0));
-        int y1 = lround(y2scr_pos(render_priv, state->scroll_y1));
+        int y0 = lround(y2scr_pos(state, state->scroll_y0));
+        int y1 = lround(y2scr_pos(state, state->scroll_y1));
 
         state->clip_y0 = FFMAX(state->clip_y0, y0);
         state->clip_y1 = FFMIN(state->clip_y1, y1);
     }
 
-    calculate_rotation_params(state, &bbox, device_x, device_y);
+    calculate_rotation_params(state, bbox, device_x, device_y);
 
     render_and_combine_glyphs(state, device_x, device_y);
 
@@ -3020,9 +3701,9 @@ ass_render_event(RenderContext *state, ASS_Event *event,
     event_images->height =
         text_info->height + text_info->border_bottom + text_info->border_top;
     event_images->left =
-        (device_x + bbox.x_min) * render_priv->par_scale_x - text_info->border_x + 0.5;
+        (device_x + bbox->x_min) * state->par_scale_x - text_info->border_x + 0.5;
     event_images->width =
-        (bbox.x_max - bbox.x_min) * render_priv->par_scale_x
+        (bbox->x_max - bbox->x_min) * state->par_scale_x
         + 2 * text_info->border_x + 0.5;
     event_images->detect_collisions = state->detect_collisions;
     event_images->shift_direction = (valign == VALIGN_SUB) ? -1 : 1;
@@ -3034,27 +3715,272 @@ ass_render_event(RenderContext *state, ASS_Event *event,
 
     ass_shaper_cleanup(state->shaper, text_info);
     free_render_context(state);
+}
+
+// largest mismatch of size ratios for which an event layout is shared
+#define LAYOUT_SHARE_TOLERANCE (1.0 / 256)
+
+static inline bool similar_ratio(double a, double b, double ratio)
+{
+    return fabs(a - b * ratio) <= LAYOUT_SHARE_TOLERANCE * fabs(b * ratio);
+}
 
+static inline int32_t scale_d6(int32_t x, double ratio)
+{
+    return ass_lrint(x * ratio);
+}
+
+/**
+ * \brief Rescale the output dimensions of a laid out glyph
+ */
+static void scale_glyph(GlyphInfo *info, double ratio)
+{
+    info->transform.scale.x *= ratio;
+    info->transform.scale.y *= ratio;
+    info->transform.offset.x *= ratio;
+    info->transform.offset.y *= ratio;
+    info->bbox.x_min = scale_d6(info->bbox.x_min, ratio);
+    info->bbox.y_min = scale_d6(info->bbox.y_min, ratio);
+    info->bbox.x_max = scale_d6(info->bbox.x_max, ratio);
+    info->bbox.y_max = scale_d6(info->bbox.y_max, ratio);
+    info->pos.x = scale_d6(info->pos.x, ratio);
+    info->pos.y = scale_d6(info->pos.y, ratio);
+    info->offset.x = scale_d6(info->offset.x, ratio);
+    info->offset.y = scale_d6(info->offset.y, ratio);
+    info->advance.x = scale_d6(info->advance.x, ratio);
+    info->advance.y = scale_d6(info->advance.y, ratio);
+    info->cluster_advance.x = scale_d6(info->cluster_advance.x, ratio);
+    info->cluster_advance.y = scale_d6(info->cluster_advance.y, ratio);
+    info->asc = scale_d6(info->asc, ratio);
+    info->desc = scale_d6(info->desc, ratio);
+    info->hspacing_scaled = scale_d6(info->hspacing_scaled, ratio);
+
+    // the output size of font glyphs is part of their scale,
+    // see fix_glyph_scaling()
+    if (!info->drawing_text.str) {
+        info->scale_x *= ratio;
+        info->scale_y *= ratio;
+        info->scale_fix /= ratio;
+    }
+
+    // karaoke timing is a distance after ass_process_karaoke_effects()
+    if (info->effect_type != EF_NONE)
+        info->effect_timing = ass_lrint(
+            FFMINMAX(info->effect_timing * ratio, -100000000, 100000000));
+}
+
+/**
+ * \brief Take over the layout of an event from another renderer
+ * Without hinting, glyph outlines, metrics and shaping results are the same
+ * at every size, so the layout done by layout_event() for src only needs
+ * to be rescaled by the ratio of the output sizes. Positioning and
+ * rendering are left to place_event(), at this renderer's own size.
+ * Line breaks are those of src, and positions are rounded at its size, so
+ * the result may differ slightly from a layout done at this size.
+ * \param bbox in: text bounding box of src, out: rescaled for this context
+ * \return false if the output sizes do not scale uniformly, or on failure
+ */
+static bool share_layout(RenderContext *state, RenderContext *src,
+                         ASS_DRect *bbox)
+{
+    free_render_context(state);
+
+    // event data used from positioning on
+    state->event = src->event;
+    state->style = src->style;
+    if (src->style == &src->override_style_temp_storage) {
+        state->override_style_temp_storage = src->override_style_temp_storage;
+        state->style = &state->override_style_temp_storage;
+    }
+    state->alignment = src->alignment;
+    state->evt_type = src->evt_type;
+    state->explicit = src->explicit;
+    state->apply_font_scale = src->apply_font_scale;
+    state->detect_collisions = src->detect_collisions;
+    state->border_style = src->border_style;
+    memcpy(state->c, src->c, sizeof(state->c));
+    state->shadow_x = src->shadow_x;
+    state->shadow_y = src->shadow_y;
+    state->pos_x = src->pos_x;
+    state->pos_y = src->pos_y;
+    state->org_x = src->org_x;
+    state->org_y = src->org_y;
+    state->have_origin = src->have_origin;
+    state->clip_x0 = src->clip_x0;
+    state->clip_y0 = src->clip_y0;
+    state->clip_x1 = src->clip_x1;
+    state->clip_y1 = src->clip_y1;
+    state->clip_mode = src->clip_mode;
+    state->clip_drawing_text = src->clip_drawing_text;
+    state->clip_drawing_scale = src->clip_drawing_scale;
+    state->clip_drawing_mode = src->clip_drawing_mode;
+    state->scroll_direction = src->scroll_direction;
+    state->scroll_shift = src->scroll_shift;
+    state->scroll_y0 = src->scroll_y0;
+    state->scroll_y1 = src->scroll_y1;
+    init_font_scale(state);
+
+    // glyph sizes follow the vertical scale, see parse_events()
+    double ratio = state->screen_scale_y / src->screen_scale_y;
+    if (!similar_ratio(state->screen_scale_x, src->screen_scale_x, ratio) ||
+            !similar_ratio(state->par_scale_x, src->par_scale_x, 1) ||
+            !similar_ratio(get_max_text_width(state),
+                           get_max_text_width(src), ratio) ||
+            !similar_ratio(state->renderer->settings.line_spacing,
+                           src->renderer->settings.line_spacing, ratio)) {
+        free_render_context(state);
+        return false;
+    }
+
+    TextInfo *text_info = &state->text_info;
+    TextInfo *src_info = &src->text_info;
+    if (src_info->length > text_info->max_glyphs) {
+        if (!ASS_REALLOC_ARRAY(text_info->glyphs, src_info->length) ||
+                !ASS_REALLOC_ARRAY(text_info->event_text, src_info->length) ||
+                !ASS_REALLOC_ARRAY(text_info->breaks, src_info->length))
+            goto fail;
+        text_info->max_glyphs = src_info->length;
+    }
+    if (src_info->n_lines > text_info->max_lines) {
+        if (!ASS_REALLOC_ARRAY(text_info->lines, src_info->n_lines))
+            goto fail;
+        text_info->max_lines = src_info->n_lines;
+    }
+
+    for (int i = 0; i < src_info->length; i++) {
+        GlyphInfo *info = text_info->glyphs + i;
+        *info = src_info->glyphs[i];
+        text_info->length = i + 1;
+        for (; info; info = info->next) {
+            if (info->next) {
+                GlyphInfo *next = malloc(sizeof(GlyphInfo));
+                if (!next) {
+                    info->next = NULL;
+                    goto fail;
+                }
+                *next = *info->next;
+                info->next = next;
+            }
+            scale_glyph(info, ratio);
+        }
+    }
+    for (int i = 0; i < src_info->n_lines; i++) {
+        text_info->lines[i].offset = src_info->lines[i].offset;
+        text_info->lines[i].len = src_info->lines[i].len;
+    }
+    text_info->n_lines = src_info->n_lines;
+
+    // border size is that of this renderer
+    measure_text(state);
+
+    bbox->x_min *= ratio;
+    bbox->y_min *= ratio;
+    bbox->x_max *= ratio;
+    bbox->y_max *= ratio;
     return true;
+
+fail:
+    ass_shaper_cleanup(state->shaper, text_info);
+    free_render_context(state);
+    return false;
 }
 
 /**
- * \brief Check cache limits and reset cache if they are exceeded
+ * \brief Main ass rendering function, glues everything together
+ * \param event event to render
+ * \param event_images struct containing resulting images, will also be initialized
+ * Process event, appending resulting ASS_Image's to images_root.
  */
-static void check_cache_limits(ASS_Renderer *priv, CacheStore *cache)
+static bool
+ass_render_event(RenderContext *state, ASS_Event *event,
+                 EventImages *event_images)
+{
+    ASS_DRect bbox;
+    if (!layout_event(state, event, &bbox))
+        return false;
+    place_event(state, &bbox, event_images);
+    return true;
+}
+
+/**
+ * \brief Split the memory budget between caches according to their load
+ * The load of a cache is the time it spent constructing values, weighted
+ * by its hit rate. A cache that often rebuilds entries it has held before
+ * gains memory; rebuilding entries that are new every frame counts little,
+ * since more memory would not save that work. Loads are smoothed over
+ * frames, and every cache keeps a minimum share.
+ */
+static void rebalance_cache_budget(CacheStore *cache)
+{
+    Cache *caches[BUDGET_CACHE_COUNT] = {
+        [BUDGET_OUTLINE]   = cache->outline_cache,
+        [BUDGET_BITMAP]    = cache->bitmap_cache,
+        [BUDGET_COMPOSITE] = cache->composite_cache,
+    };
+
+    double total = 0;
+    for (int i = 0; i < BUDGET_CACHE_COUNT; i++) {
+        CacheStats stats;
+        ass_cache_take_stats(caches[i], &stats);
+        if (i == BUDGET_COMPOSITE) {
+            CacheStats clip_stats;
+            ass_cache_take_stats(cache->clip_cache, &clip_stats);
+            stats.hits += clip_stats.hits;
+            stats.misses += clip_stats.misses;
+            stats.construct_time += clip_stats.construct_time;
+        }
+        size_t lookups = stats.hits + stats.misses;
+        double load = lookups ? stats.construct_time * stats.hits / lookups : 0;
+        cache->budget_load[i] += BUDGET_SMOOTHING * (load - cache->budget_load[i]);
+        total += cache->budget_load[i];
+    }
+
+    size_t size[BUDGET_CACHE_COUNT];
+    for (int i = 0; i < BUDGET_CACHE_COUNT; i++) {
+        double share = total > 0 ? cache->budget_load[i] / total :
+                                   1.0 / BUDGET_CACHE_COUNT;
+        share = BUDGET_MIN_SHARE + (1 - BUDGET_CACHE_COUNT * BUDGET_MIN_SHARE) * share;
+        size[i] = cache->budget * share;
+    }
+    // the outline cache is limited by item count
+    cache->glyph_max = size[BUDGET_OUTLINE] / BUDGET_OUTLINE_SIZE;
+    cache->bitmap_max_size = size[BUDGET_BITMAP];
+    cache->clip_max_size = size[BUDGET_COMPOSITE] / (CLIP_CACHE_RATIO + 1);
+    cache->composite_max_size = size[BUDGET_COMPOSITE] - cache->clip_max_size;
+}
+
+static void cut_caches(CacheStore *cache)
 {
+    ass_cache_cut(cache->layout_cache, LAYOUT_CACHE_MAX);
+    ass_cache_cut(cache->clip_cache, cache->clip_max_size);
     ass_cache_cut(cache->composite_cache, cache->composite_max_size);
     ass_cache_cut(cache->bitmap_cache, cache->bitmap_max_size);
     ass_cache_cut(cache->outline_cache, cache->glyph_max);
+    ass_cache_cut(cache->shape_cache, SHAPE_CACHE_MAX);
+    ass_cache_cut(cache->hb_font_cache, HB_FONT_CACHE_MAX);
 }
 
-static void setup_shaper(ASS_Shaper *shaper, ASS_Renderer *render_priv)
+/**
+ * \brief Check cache limits and reset cache if they are exceeded
+ */
+static void check_cache_limits(ASS_Renderer *priv, CacheStore *cache)
 {
-    ASS_Track *track = render_priv->track;
+    // the limits are read by the job of ass_prefetch()
+    ass_cache_group_lock(cache->group);
+    if (cache->budget)
+        rebalance_cache_budget(cache);
+    cut_caches(cache);
+    ass_cache_group_unlock(cache->group);
+}
+
+static void setup_shaper(RenderContext *state)
+{
+    ASS_Shaper *shaper = state->shaper;
+    ASS_Track *track = state->track;
 
     ass_shaper_set_kerning(shaper, track->Kerning);
     ass_shaper_set_language(shaper, track->Language);
-    ass_shaper_set_level(shaper, render_priv->settings.shaper);
+    ass_shaper_set_level(shaper, state->renderer->settings.shaper);
 #ifdef USE_FRIBIDI_EX_API
     ass_shaper_set_bidi_brackets(shaper,
             track->parser_priv->feature_flags & FEATURE_MASK(ASS_FEATURE_BIDI_BRACKETS));
@@ -3064,17 +3990,19 @@ static void setup_shaper(ASS_Shaper *shaper, ASS_Renderer *render_priv)
 }
 
 /**
- * \brief Start a new frame
+ * \brief Set up frame-global data of a render context for rendering
+ * events at now
  */
 static bool
-ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
-                long long now)
+prepare_frame(RenderContext *state, ASS_Track *track, long long now)
 {
+    ASS_Renderer *render_priv = state->renderer;
     if (!render_priv->settings.frame_width
         && !render_priv->settings.frame_height)
         return false;               // library not initialized
 
-    if (!render_priv->fontselect)
+    ASS_FontDatabase *fontdb = render_priv->fontdb;
+    if (!fontdb->fontselect)
         return false;
 
     if (render_priv->library != track->library)
@@ -3083,18 +4011,20 @@ ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
     if (track->n_events == 0)
         return false;               // nothing to do
 
-    render_priv->track = track;
-    render_priv->time = now;
+    state->track = track;
+    state->time = now;
 
-    ass_lazy_track_init(render_priv->library, render_priv->track);
+    ass_lazy_track_init(render_priv->library, state->track);
 
-    if (render_priv->library->num_fontdata != render_priv->num_emfonts) {
-        assert(render_priv->library->num_fontdata > render_priv->num_emfonts);
-        render_priv->num_emfonts = ass_update_embedded_fonts(
-            render_priv->fontselect, render_priv->num_emfonts);
+    ass_font_database_lock(fontdb);
+    if (render_priv->library->num_fontdata != fontdb->num_emfonts) {
+        assert(render_priv->library->num_fontdata > fontdb->num_emfonts);
+        fontdb->num_emfonts = ass_update_embedded_fonts(
+            fontdb->fontselect, fontdb->num_emfonts);
     }
+    ass_font_database_unlock(fontdb);
 
-    setup_shaper(render_priv->state.shaper, render_priv);
+    setup_shaper(state);
 
     // PAR correction
     double par = render_priv->settings.par;
@@ -3104,13 +4034,25 @@ ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
                 (render_priv->settings.storage_width && render_priv->settings.storage_height))) {
             double dar = ((double) render_priv->frame_content_width) /
                          render_priv->frame_content_height;
-            ASS_Vector layout_res = ass_layout_res(render_priv);
+            ASS_Vector layout_res = ass_layout_res(render_priv, track);
             double sar = ((double) layout_res.x) / layout_res.y;
             par = dar / sar;
         } else
             par = 1.0;
     }
-    render_priv->par_scale_x = par;
+    state->par_scale_x = par;
+    return true;
+}
+
+/**
+ * \brief Start a new frame
+ */
+static bool
+ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
+                long long now)
+{
+    if (!prepare_frame(&render_priv->state, track, now))
+        return false;
 
     render_priv->prev_images_root = render_priv->images_root;
     render_priv->images_root = NULL;
@@ -3135,20 +4077,119 @@ static int cmp_event_layer(const void *p1, const void *p2)
     return 0;
 }
 
-static ASS_RenderPriv *get_render_priv(ASS_Renderer *render_priv,
-                                       ASS_Event *event)
+static inline size_t event_state_hash(const RenderPriv *key)
 {
-    if (!event->render_priv) {
-        event->render_priv = calloc(1, sizeof(ASS_RenderPriv));
-        if (!event->render_priv)
-            return NULL;
+    uint64_t hash = (uint64_t) key->start * 0x9E3779B97F4A7C15 ^
+        (uint64_t) key->duration * 0xC2B2AE3D27D4EB4F ^
+        (uint64_t) (unsigned) key->read_order * 0x165667B19E3779F9 ^
+        (unsigned) key->layer;
+    return hash ^ hash >> 32;
+}
+
+static RenderPriv *find_event_state(RenderPriv *states, size_t mask,
+                                    const RenderPriv *key)
+{
+    size_t pos = event_state_hash(key) & mask;
+    while (states[pos].used) {
+        RenderPriv *state = states + pos;
+        if (state->start == key->start && state->duration == key->duration &&
+                state->read_order == key->read_order &&
+                state->layer == key->layer)
+            break;
+        pos = (pos + 1) & mask;
     }
-    if (render_priv->render_id != event->render_priv->render_id) {
-        memset(event->render_priv, 0, sizeof(ASS_RenderPriv));
-        event->render_priv->render_id = render_priv->render_id;
+    return states + pos;
+}
+
+/**
+ * \brief Make room for another event state, dropping those of events
+ * that have ended, as they are unlikely to be shown again
+ */
+static bool grow_event_states(ASS_Renderer *render_priv)
+{
+    RenderPriv *old = render_priv->event_states;
+    size_t old_size = old ? render_priv->event_states_mask + 1 : 0;
+
+    size_t count = 0;
+    for (size_t i = 0; i < old_size; i++)
+        if (old[i].used && old[i].start + old[i].duration > render_priv->state.time)
+            count++;
+
+    // keep at most half of the slots in use
+    size_t size = 64;
+    while (2 * (count + 1) > size)
+        size *= 2;
+    RenderPriv *states = calloc(size, sizeof(RenderPriv));
+    if (!states)
+        return false;
+
+    count = 0;
+    for (size_t i = 0; i < old_size; i++) {
+        if (!old[i].used || old[i].start + old[i].duration <= render_priv->state.time)
+            continue;
+        *find_event_state(states, size - 1, old + i) = old[i];
+        count++;
     }
+    free(old);
+    render_priv->event_states = states;
+    render_priv->event_states_mask = size - 1;
+    render_priv->event_states_count = count;
+    return true;
+}
 
-    return event->render_priv;
+/**
+ * \brief Forget all event states if the track or settings have changed
+ */
+static void check_event_states(ASS_Renderer *render_priv)
+{
+    if (render_priv->event_track == render_priv->state.track &&
+            render_priv->event_render_id == render_priv->render_id)
+        return;
+    render_priv->event_track = render_priv->state.track;
+    render_priv->event_render_id = render_priv->render_id;
+
+    if (!render_priv->event_states_count)
+        return;
+    memset(render_priv->event_states, 0,
+           (render_priv->event_states_mask + 1) * sizeof(RenderPriv));
+    render_priv->event_states_count = 0;
+}
+
+/**
+ * \brief Get the collision state of an event
+ * The state is kept by the renderer, so that several renderers can
+ * render the same track at once. The returned pointer is valid until
+ * the next call.
+ */
+static RenderPriv *get_render_priv(ASS_Renderer *render_priv,
+                                   ASS_Event *event)
+{
+    RenderPriv key = {
+        .start = event->Start,
+        .duration = event->Duration,
+        .read_order = event->ReadOrder,
+        .layer = event->Layer,
+        .used = true,
+    };
+
+    RenderPriv *state = NULL;
+    if (render_priv->event_states) {
+        state = find_event_state(render_priv->event_states,
+                                 render_priv->event_states_mask, &key);
+        if (state->used)
+            return state;
+    }
+
+    if (!state || 2 * (render_priv->event_states_count + 1) >
+                  render_priv->event_states_mask + 1) {
+        if (!grow_event_states(render_priv))
+            return NULL;
+        state = find_event_state(render_priv->event_states,
+                                 render_priv->event_states_mask, &key);
+    }
+    *state = key;
+    render_priv->event_states_count++;
+    return state;
 }
 
 static int overlap(Rect *s1, Rect *s2)
@@ -3233,7 +4274,7 @@ fix_collisions(ASS_Renderer *render_priv, EventImages *imgs, int cnt)
 
     // fill used[] with fixed events
     for (i = 0; i < cnt; ++i) {
-        ASS_RenderPriv *priv;
+        RenderPriv *priv;
         // VSFilter considers events colliding if their intersections area is non-zero,
         // zero-area events are therefore effectively fixed as well
         if (!imgs[i].detect_collisions || !imgs[i].height  || !imgs[i].width)
@@ -3274,7 +4315,7 @@ fix_collisions(ASS_Renderer *render_priv, EventImages *imgs, int cnt)
 
     // try to fit other events in free spaces
     for (i = 0; i < cnt; ++i) {
-        ASS_RenderPriv *priv;
+        RenderPriv *priv;
         if (!imgs[i].detect_collisions || !imgs[i].height  || !imgs[i].width)
             continue;
         priv = get_render_priv(render_priv, imgs[i].event);
@@ -3362,41 +4403,51 @@ static int ass_detect_change(ASS_Renderer *priv)
     return diff;
 }
 
+static inline bool event_active(const ASS_Event *event, long long now)
+{
+    return event->Start <= now && now < event->Start + event->Duration;
+}
+
 /**
- * \brief render a frame
- * \param priv library handle
- * \param track track
- * \param now current video timestamp (ms)
- * \param detect_change a value describing how the new images differ from the previous ones will be written here:
- *        0 if identical, 1 if different positions, 2 if different content.
- *        Can be NULL, in that case no detection is performed.
+ * \brief Start rendering a frame
+ * Cache values are used without references while the frame is built,
+ * which is safe as long as the context is registered with the cache groups.
+ * \return false if nothing can be rendered
  */
-ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
-                            long long now, int *detect_change)
+static bool begin_frame(ASS_Renderer *priv, ASS_Track *track, long long now)
 {
-    // init frame
-    if (!ass_start_frame(priv, track, now)) {
-        if (detect_change)
-            *detect_change = 2;
-        return NULL;
-    }
+    if (!ass_start_frame(priv, track, now))
+        return false;
+    check_event_states(priv);
 
-    // render events separately
-    int cnt = 0;
-    for (int i = 0; i < track->n_events; i++) {
-        ASS_Event *event = track->events + i;
-        if ((event->Start <= now)
-            && (now < (event->Start + event->Duration))) {
-            if (cnt >= priv->eimg_size) {
-                priv->eimg_size += 100;
-                priv->eimg =
-                    realloc(priv->eimg,
-                            priv->eimg_size * sizeof(EventImages));
-            }
-            if (ass_render_event(&priv->state, event, priv->eimg + cnt))
-                cnt++;
-        }
+    RenderContext *state = &priv->state;
+    ass_cache_group_enter(priv->cache.group, &state->cache_reader);
+    ass_cache_group_enter(priv->fontdb->cache_group, &state->fontdb_reader);
+    return true;
+}
+
+/**
+ * \brief Get the slot for the images of the next rendered event
+ * \param cnt number of events rendered so far
+ */
+static EventImages *next_event_images(ASS_Renderer *priv, int cnt)
+{
+    if (cnt >= priv->eimg_size) {
+        priv->eimg_size += 100;
+        priv->eimg =
+            realloc(priv->eimg,
+                    priv->eimg_size * sizeof(EventImages));
     }
+    return priv->eimg + cnt;
+}
+
+/**
+ * \brief Combine the rendered events into the frame
+ * \param cnt number of rendered events
+ */
+static void end_frame(ASS_Renderer *priv, int cnt, int *detect_change)
+{
+    RenderContext *state = &priv->state;
 
     // sort by layer
     if (cnt > 0)
@@ -3422,40 +4473,791 @@ ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
             cur = cur->next;
         }
     }
+    if (priv->images_root) {
+        ASS_ImagePriv *head = (ASS_ImagePriv *) priv->images_root;
+        head->fontdb = priv->fontdb;
+        ass_font_database_ref(priv->fontdb);
+    }
     ass_frame_ref(priv->images_root);
 
+    ass_cache_group_leave(priv->fontdb->cache_group, &state->fontdb_reader);
+    ass_cache_group_leave(priv->cache.group, &state->cache_reader);
+
     if (detect_change)
         *detect_change = ass_detect_change(priv);
 
     // free the previous image list
     ass_frame_unref(priv->prev_images_root);
     priv->prev_images_root = NULL;
+}
 
+/**
+ * \brief Render a frame
+ * \return false if nothing could be rendered
+ */
+static bool render_frame(ASS_Renderer *priv, ASS_Track *track, long long now,
+                         int *detect_change)
+{
+    // init frame
+    if (!begin_frame(priv, track, now)) {
+        if (detect_change)
+            *detect_change = 2;
+        return false;
+    }
+
+    // render events separately
+    int cnt = 0;
+    for (int i = 0; i < track->n_events; i++) {
+        ASS_Event *event = track->events + i;
+        if (event_active(event, now) &&
+                ass_render_event(&priv->state, event,
+                                 next_event_images(priv, cnt)))
+            cnt++;
+    }
+
+    end_frame(priv, cnt, detect_change);
+    return true;
+}
+
+static void prune_track(ASS_Track *track, long long now)
+{
     if (track->parser_priv->prune_delay >= 0)
         ass_prune_events(track, now - track->parser_priv->prune_delay);
+}
 
+/**
+ * \brief render a frame
+ * \param priv library handle
+ * \param track track
+ * \param now current video timestamp (ms)
+ * \param detect_change a value describing how the new images differ from the previous ones will be written here:
+ *        0 if identical, 1 if different positions, 2 if different content.
+ *        Can be NULL, in that case no detection is performed.
+ */
+ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
+                            long long now, int *detect_change)
+{
+    bool rendered = render_frame(priv, track, now, detect_change);
+    if (!rendered)
+        return NULL;
+    prune_track(track, now);
     return priv->images_root;
 }
 
 /**
- * \brief Add reference to a frame image list.
- * \param image_list image list returned by ass_render_frame()
+ * \brief Check whether a renderer can take over event layouts from another
+ * They have to use the same fonts, unhinted, and shape alike.
+ * Size-dependent parameters are checked for each event by share_layout().
  */
-void ass_frame_ref(ASS_Image *img)
+static bool can_share_layout(ASS_Renderer *priv, ASS_Renderer *src)
 {
-    if (!img)
+    ASS_Settings *settings = &priv->settings;
+    ASS_Settings *src_settings = &src->settings;
+    return priv->fontdb == src->fontdb &&
+        settings->hinting == ASS_HINTING_NONE &&
+        src_settings->hinting == ASS_HINTING_NONE &&
+        settings->shaper == src_settings->shaper &&
+        !settings->selective_style_overrides &&
+        !src_settings->selective_style_overrides;
+}
+
+// state of a renderer in ass_render_frame_multi()
+typedef struct {
+    int cnt;                    // rendered events, -1 if the frame is not started
+    bool share;                 // whether it takes over layouts of the first one
+} MultiTarget;
+
+/**
+ * \brief Render a frame with several renderers, e.g. at several sizes
+ * Events are parsed, shaped and laid out once by the first renderer that
+ * renders at all. The others take over that layout where share_layout()
+ * allows, leaving them positioning, rasterization and compositing.
+ */
+void ass_render_frame_multi(ASS_Renderer *const *renderers, int n,
+                            ASS_Track *track, long long now,
+                            ASS_Image **images, int *detect_change)
+{
+    MultiTarget *targets = ass_realloc_array(NULL, n, sizeof(MultiTarget));
+    if (!targets) {
+        for (int i = 0; i < n; i++)
+            images[i] = ass_render_frame(renderers[i], track, now,
+                                         detect_change ? detect_change + i : NULL);
         return;
-    ((ASS_ImagePriv *) img)->ref_count++;
+    }
+
+    // events are laid out by the first renderer that renders at all
+    int lead = -1;
+    for (int i = 0; i < n; i++) {
+        targets[i].cnt = begin_frame(renderers[i], track, now) ? 0 : -1;
+        targets[i].share = false;
+        if (targets[i].cnt < 0)
+            continue;
+        if (lead < 0)
+            lead = i;
+        else
+            targets[i].share = can_share_layout(renderers[i], renderers[lead]);
+    }
+
+    for (int i = 0; lead >= 0 && i < track->n_events; i++) {
+        ASS_Event *event = track->events + i;
+        if (!event_active(event, now))
+            continue;
+
+        RenderContext *lead_state = &renderers[lead]->state;
+        ASS_DRect lead_bbox;
+        bool laid_out = layout_event(lead_state, event, &lead_bbox);
+        for (int j = lead + 1; j < n; j++) {
+            ASS_Renderer *priv = renderers[j];
+            if (targets[j].cnt < 0)
+                continue;
+            EventImages *event_images = next_event_images(priv, targets[j].cnt);
+            ASS_DRect bbox = lead_bbox;
+            if (laid_out && targets[j].share &&
+                    share_layout(&priv->state, lead_state, &bbox)) {
+                place_event(&priv->state, &bbox, event_images);
+                targets[j].cnt++;
+            } else if (ass_render_event(&priv->state, event, event_images)) {
+                targets[j].cnt++;
+            }
+        }
+
+        // last, as positioning converts the clip rectangle in place
+        if (laid_out) {
+            ASS_Renderer *priv = renderers[lead];
+            place_event(lead_state, &lead_bbox,
+                        next_event_images(priv, targets[lead].cnt++));
+        }
+    }
+
+    bool rendered = false;
+    for (int i = 0; i < n; i++) {
+        ASS_Renderer *priv = renderers[i];
+        int *change = detect_change ? detect_change + i : NULL;
+        if (targets[i].cnt < 0) {
+            images[i] = NULL;
+            if (change)
+                *change = 2;
+            continue;
+        }
+        end_frame(priv, targets[i].cnt, change);
+        images[i] = priv->images_root;
+        rendered = true;
+    }
+    free(targets);
+
+    if (rendered)
+        prune_track(track, now);
+}
+
+// shared state of ass_render_frames()
+typedef struct {
+    ASS_Mutex *lock;
+    ASS_Cond *cond;                 // signaled whenever a frame is rendered or delivered
+
+    ASS_Track *track;
+    const long long *times;
+    int n_frames;
+    ASS_Image **images;
+    ASS_Renderer **owner;           // renderer of each finished frame, NULL until then
+    int delivered;                  // frames passed to the callback so far
+    int window;                     // how far rendering may run ahead of delivery
+
+    // frames are rendered in segments, each by a single renderer
+    const int *segment_start;       // n_segments + 1 entries
+    int n_segments, next_segment;
+
+    ASS_FrameCallback callback;
+    void *data;
+} FrameBatch;
+
+typedef struct {
+    FrameBatch *batch;
+    ASS_Renderer *renderer;         // see ASS_Renderer.workers
+    ASS_Thread *thread;
+} BatchWorker;
+
+static int search_time(const long long *times, int n, long long time)
+{
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (times[mid] < time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
 }
 
 /**
- * \brief Release reference to a frame image list.
- * \param image_list image list returned by ass_render_frame()
+ * \brief Split a batch where renderers can take over from each other
+ * Collision handling depends on the frames rendered before, but only through
+ * events that are still displayed and take part in it, so a split is possible
+ * wherever no such event is displayed on both adjacent frames. Positioned
+ * events never do. This needs non-decreasing timestamps.
+ * \param blocked scratch array of n + 1 entries
+ * \param segment_start filled with the first frame of each segment and n
+ * \return number of segments
  */
-void ass_frame_unref(ASS_Image *img)
+static int split_batch(const ASS_Track *track, const long long *times, int n,
+                       int min_length, int *blocked, int *segment_start)
+{
+    segment_start[0] = 0;
+    segment_start[1] = n;
+    for (int i = 1; i < n; i++)
+        if (times[i] < times[i - 1])
+            return 1;
+
+    // count events displayed on both sides of each split point
+    memset(blocked, 0, (n + 1) * sizeof(int));
+    for (int i = 0; i < track->n_events; i++) {
+        const ASS_Event *event = track->events + i;
+        if (ass_event_is_positioned(event->Text))
+            continue;
+        int first = search_time(times, n, event->Start);
+        int end = search_time(times, n, event->Start + event->Duration);
+        if (end - first >= 2) {
+            blocked[first + 1]++;
+            blocked[end]--;
+        }
+    }
+
+    int n_segments = 1, count = 0;
+    for (int i = 1; i < n; i++) {
+        count += blocked[i];
+        if (!count && i - segment_start[n_segments - 1] >= min_length)
+            segment_start[n_segments++] = i;
+    }
+    segment_start[n_segments] = n;
+    return n_segments;
+}
+
+static ASS_Image *batch_render(ASS_Renderer *priv, ASS_Track *track,
+                               long long now)
 {
-    if (!img || --((ASS_ImagePriv *) img)->ref_count)
+    // the renderer frees its images with the next frame, keep them for delivery
+    ASS_Image *img = ass_render_frame(priv, track, now, NULL);
+    ass_frame_ref(img);
+    return img;
+}
+
+/**
+ * \brief Render frames of the batch until there is nothing left to do
+ * \param consumer whether this is the calling thread, which delivers frames
+ * in order and returns once all of them are delivered
+ */
+static void batch_run(FrameBatch *batch, ASS_Renderer *priv, bool consumer)
+{
+    int cur = 0, end = 0;
+    if (consumer)
+        end = batch->segment_start[1];
+
+    ass_mutex_lock(batch->lock);
+    while (true) {
+        int next = batch->delivered;
+        if (consumer && next < batch->n_frames && batch->owner[next]) {
+            ASS_Image *img = batch->images[next];
+            batch->delivered++;
+            ass_cond_broadcast(batch->cond);
+            ass_mutex_unlock(batch->lock);
+
+            batch->callback(batch->data, next, img);
+            ass_frame_unref(img);
+
+            ass_mutex_lock(batch->lock);
+            continue;
+        }
+        if (consumer && next == batch->n_frames)
+            break;
+
+        if (cur == end && batch->next_segment < batch->n_segments) {
+            int segment = batch->next_segment++;
+            cur = batch->segment_start[segment];
+            end = batch->segment_start[segment + 1];
+            continue;
+        }
+        if (cur < end && cur < next + batch->window) {
+            ass_mutex_unlock(batch->lock);
+            ASS_Image *img = batch_render(priv, batch->track, batch->times[cur]);
+            ass_mutex_lock(batch->lock);
+
+            batch->images[cur] = img;
+            batch->owner[cur] = priv;
+            cur++;
+            ass_cond_broadcast(batch->cond);
+            continue;
+        }
+        if (!consumer && cur == end)
+            break;
+        ass_cond_wait(batch->cond, batch->lock);
+    }
+    ass_mutex_unlock(batch->lock);
+}
+
+static void batch_worker(void *priv, int index)
+{
+    BatchWorker *worker = priv;
+    batch_run(worker->batch, worker->renderer, false);
+}
+
+static void swap_event_states(ASS_Renderer *a, ASS_Renderer *b)
+{
+    ASS_RenderPriv *states = a->event_states;
+    size_t mask = a->event_states_mask, count = a->event_states_count;
+    a->event_states = b->event_states;
+    a->event_states_mask = b->event_states_mask;
+    a->event_states_count = b->event_states_count;
+    b->event_states = states;
+    b->event_states_mask = mask;
+    b->event_states_count = count;
+}
+
+/**
+ * \brief Get up to n worker renderers with the current settings
+ * Workers are created on first use and kept for later batches.
+ * \return number of workers available
+ */
+static int get_workers(ASS_Renderer *priv, int n)
+{
+    if (n > priv->n_workers) {
+        ASS_Renderer **workers =
+            ass_realloc_array(priv->workers, n, sizeof(ASS_Renderer *));
+        if (workers) {
+            priv->workers = workers;
+            for (; priv->n_workers < n; priv->n_workers++) {
+                ASS_Renderer *worker = ass_renderer_clone(priv);
+                if (!worker)
+                    break;
+                workers[priv->n_workers] = worker;
+            }
+        }
+    }
+    n = FFMIN(n, priv->n_workers);
+    for (int i = 0; i < n; i++)
+        ass_renderer_sync(priv->workers[i], priv);
+    return n;
+}
+
+/**
+ * \brief Render a batch of frames with the help of worker threads
+ * Workers render with renderers of their own, which share the font database
+ * but have their own caches. Frames are delivered in order to the callback
+ * in the calling thread, with the same result as ass_render_frame().
+ */
+void ass_render_frames(ASS_Renderer *priv, ASS_Track *track,
+                       const long long *times, int n,
+                       ASS_FrameCallback callback, void *data)
+{
+    if (n <= 0)
         return;
+
+    // pruning would modify the track while workers read it
+    int n_workers = priv->n_threads - 1;
+    if (track->parser_priv->prune_delay >= 0)
+        n_workers = 0;
+
+    FrameBatch batch = {
+        .track = track,
+        .times = times,
+        .n_frames = n,
+        .callback = callback,
+        .data = data,
+    };
+    int *segment_start = NULL, *blocked = NULL;
+    BatchWorker *workers = NULL;
+    if (n_workers > 0) {
+        segment_start = ass_realloc_array(NULL, n + 1, sizeof(int));
+        blocked = ass_realloc_array(NULL, n + 1, sizeof(int));
+        if (segment_start && blocked) {
+            int min_length = FFMAX(1, n / (8 * (n_workers + 1)));
+            batch.n_segments = split_batch(track, times, n, min_length,
+                                           blocked, segment_start);
+            n_workers = FFMIN(n_workers, batch.n_segments - 1);
+        } else {
+            n_workers = 0;
+        }
+        free(blocked);
+    }
+    if (n_workers > 0) {
+        batch.lock = ass_mutex_create();
+        batch.cond = ass_cond_create();
+        batch.images = ass_realloc_array(NULL, n, sizeof(ASS_Image *));
+        batch.owner = calloc(n, sizeof(ASS_Renderer *));
+        workers = calloc(n_workers, sizeof(BatchWorker));
+        if (!batch.lock || !batch.cond || !batch.images ||
+                !batch.owner || !workers)
+            n_workers = 0;
+    }
+
+    if (!n_workers) {
+        for (int i = 0; i < n; i++)
+            callback(data, i, ass_render_frame(priv, track, times[i], NULL));
+        goto done;
+    }
+
+    // the calling renderer keeps its collision state for the first segment
+    batch.segment_start = segment_start;
+    batch.next_segment = 1;
+    batch.window = 2 * (n_workers + 1);
+    int available = get_workers(priv, n_workers);
+    int started = 0;
+    for (; started < available; started++) {
+        BatchWorker *worker = workers + started;
+        worker->batch = &batch;
+        worker->renderer = priv->workers[started];
+        worker->thread = ass_thread_create(batch_worker, worker);
+        if (!worker->thread)
+            break;
+    }
+    if (started < n_workers)
+        ass_msg(priv->library, MSGL_V,
+                "Rendering with %d of %d workers", started, n_workers);
+
+    batch_run(&batch, priv, true);
+    for (int i = 0; i < started; i++)
+        ass_thread_join(workers[i].thread);
+
+    // continue from the last frame as if it had been rendered here
+    ASS_Renderer *last = batch.owner[n - 1];
+    if (last != priv) {
+        swap_event_states(priv, last);
+        priv->event_track = track;
+        priv->event_render_id = priv->render_id;
+        ass_render_frame(priv, track, times[n - 1], NULL);
+    }
+
+done:
+    free(workers);
+    free(batch.owner);
+    free(batch.images);
+    ass_cond_destroy(batch.cond);
+    ass_mutex_destroy(batch.lock);
+    free(segment_start);
+}
+
+typedef struct {
+    long long time;             // first time the event is displayed in the window
+    int event;
+} PrefetchItem;
+
+// background job of ass_prefetch()
+typedef struct prefetch {
+    ASS_Renderer *renderer;
+    ASS_Track *track;           // copy of the events to prefetch, see ass_copy_track()
+    PrefetchItem *items;
+    int n_items;
+    RenderContext state;        // the renderer's own is used by ass_render_frame()
+    bool cancel;                // set with the renderer's cache group locked
+    ASS_Thread *thread;
+} Prefetch;
+
+static int cmp_prefetch_item(const void *p1, const void *p2)
+{
+    const PrefetchItem *a = p1, *b = p2;
+    if (a->time != b->time)
+        return a->time < b->time ? -1 : 1;
+    return a->event - b->event;
+}
+
+static void budget_cache_sizes(CacheStore *cache, size_t size[BUDGET_CACHE_COUNT])
+{
+    size[BUDGET_OUTLINE] = ass_cache_size(cache->outline_cache);
+    size[BUDGET_BITMAP] = ass_cache_size(cache->bitmap_cache);
+    size[BUDGET_COMPOSITE] = ass_cache_size(cache->composite_cache) +
+        ass_cache_size(cache->clip_cache);
+}
+
+/**
+ * \brief Render the events of the window one by one, in order of display
+ * This runs alongside ass_render_frame(), sharing the caches, which lock
+ * themselves. Prefetching stops once it has filled a cache up to its limit,
+ * as going on would only evict what has just been prefetched.
+ */
+static void prefetch_run(void *priv, int index)
+{
+    Prefetch *prefetch = priv;
+    ASS_Renderer *render_priv = prefetch->renderer;
+    CacheStore *cache = &render_priv->cache;
+    RenderContext *state = &prefetch->state;
+
+    size_t added[BUDGET_CACHE_COUNT] = {0};
+    for (int i = 0; i < prefetch->n_items; i++) {
+        // the limits change with the cache budget of the rendered frames
+        ass_cache_group_lock(cache->group);
+        size_t limit[BUDGET_CACHE_COUNT] = {
+            [BUDGET_OUTLINE]   = cache->glyph_max,
+            [BUDGET_BITMAP]    = cache->bitmap_max_size,
+            [BUDGET_COMPOSITE] = cache->composite_max_size + cache->clip_max_size,
+        };
+        bool cancel = prefetch->cancel;
+        ass_cache_group_unlock(cache->group);
+
+        bool full = false;
+        for (int j = 0; j < BUDGET_CACHE_COUNT; j++)
+            if (added[j] >= limit[j])
+                full = true;
+        if (cancel || full)
+            break;
+
+        size_t size[BUDGET_CACHE_COUNT];
+        budget_cache_sizes(cache, size);
+
+        const PrefetchItem *item = prefetch->items + i;
+        ASS_Event *event = prefetch->track->events + item->event;
+        ass_cache_group_enter(cache->group, &state->cache_reader);
+        ass_cache_group_enter(render_priv->fontdb->cache_group,
+                              &state->fontdb_reader);
+        EventImages eimg;
+        if (prepare_frame(state, prefetch->track, item->time) &&
+                ass_render_event(state, event, &eimg)) {
+            // only the cached parts are of interest
+            ass_frame_ref(eimg.imgs);
+            ass_frame_unref(eimg.imgs);
+        }
+        ass_cache_group_leave(render_priv->fontdb->cache_group,
+                              &state->fontdb_reader);
+        ass_cache_group_leave(cache->group, &state->cache_reader);
+
+        size_t new_size[BUDGET_CACHE_COUNT];
+        budget_cache_sizes(cache, new_size);
+        for (int j = 0; j < BUDGET_CACHE_COUNT; j++)
+            if (new_size[j] > size[j])
+                added[j] += new_size[j] - size[j];
+        ass_cache_group_lock(cache->group);
+        cut_caches(cache);
+        ass_cache_group_unlock(cache->group);
+    }
+}
+
+static void prefetch_free(Prefetch *prefetch)
+{
+    if (!prefetch)
+        return;
+    render_context_done(&prefetch->state);
+    ass_free_track(prefetch->track);
+    free(prefetch->items);
+    free(prefetch);
+}
+
+/**
+ * \brief Stop the job of ass_prefetch() and wait for it to finish
+ * Called before anything the job depends on is changed.
+ */
+void ass_cancel_prefetch(ASS_Renderer *priv)
+{
+    Prefetch *prefetch = priv->prefetch;
+    if (!prefetch)
+        return;
+
+    ass_cache_group_lock(priv->cache.group);
+    prefetch->cancel = true;
+    ass_cache_group_unlock(priv->cache.group);
+    ass_thread_join(prefetch->thread);
+
+    priv->prefetch = NULL;
+    prefetch_free(prefetch);
+}
+
+/**
+ * \brief Fill the caches for events displayed in [start, end) on a
+ * background thread, so that rendering them later is faster
+ */
+void ass_prefetch(ASS_Renderer *priv, ASS_Track *track,
+                  long long start, long long end)
+{
+    ass_cancel_prefetch(priv);
+    if (start >= end || !track->n_events)
+        return;
+
+    Prefetch *prefetch = calloc(1, sizeof(Prefetch));
+    if (!prefetch)
+        return;
+    prefetch->renderer = priv;
+    prefetch->items = ass_realloc_array(NULL, track->n_events,
+                                        sizeof(PrefetchItem));
+    int *events = ass_realloc_array(NULL, track->n_events, sizeof(int));
+    if (!prefetch->items || !events)
+        goto fail;
+
+    for (int i = 0; i < track->n_events; i++) {
+        ASS_Event *event = track->events + i;
+        long long time = FFMAX(event->Start, start);
+        if (time < end && event_active(event, time)) {
+            PrefetchItem *item = prefetch->items + prefetch->n_items;
+            item->time = time;
+            item->event = prefetch->n_items;
+            events[prefetch->n_items++] = i;
+        }
+    }
+    if (!prefetch->n_items)
+        goto fail;
+    qsort(prefetch->items, prefetch->n_items, sizeof(PrefetchItem),
+          cmp_prefetch_item);
+
+    // the caller may go on to modify the track, e.g. after a seek
+    prefetch->track = ass_copy_track(track, events, prefetch->n_items);
+    free(events);
+    events = NULL;
+    if (!prefetch->track)
+        goto fail;
+
+    if (!render_context_init(&prefetch->state, priv))
+        goto fail;
+    prefetch->thread = ass_thread_create(prefetch_run, prefetch);
+    if (!prefetch->thread)
+        goto fail;
+    priv->prefetch = prefetch;
+    return;
+
+fail:
+    free(events);
+    prefetch_free(prefetch);
+}
+
+// job of ass_render_frame_async(), rendered by a thread of its own
+typedef struct async_render {
+    ASS_Renderer *renderer;
+    ASS_Mutex *lock;
+    ASS_Cond *cond;             // signaled when a frame is queued or finished
+    ASS_Thread *thread;         // NULL if frames are rendered synchronously
+
+    ASS_Track *track;
+    long long now;
+    bool queued, busy, quit;
+
+    ASS_Image *images;          // result of the last frame
+    int detect_change;
+} AsyncRender;
+
+static void async_render_run(void *priv, int index)
+{
+    AsyncRender *async = priv;
+    ass_mutex_lock(async->lock);
+    while (true) {
+        while (!async->queued && !async->quit)
+            ass_cond_wait(async->cond, async->lock);
+        if (!async->queued)
+            break;
+        async->queued = false;
+        ASS_Track *track = async->track;
+        long long now = async->now;
+        ass_mutex_unlock(async->lock);
+
+        int detect_change;
+        ASS_Image *images =
+            ass_render_frame(async->renderer, track, now, &detect_change);
+
+        ass_mutex_lock(async->lock);
+        async->images = images;
+        async->detect_change = detect_change;
+        async->busy = false;
+        ass_cond_broadcast(async->cond);
+    }
+    ass_mutex_unlock(async->lock);
+}
+
+static AsyncRender *async_render_create(ASS_Renderer *priv)
+{
+    AsyncRender *async = calloc(1, sizeof(AsyncRender));
+    if (!async)
+        return NULL;
+    async->renderer = priv;
+    async->lock = ass_mutex_create();
+    async->cond = ass_cond_create();
+    if (!async->lock || !async->cond) {
+        ass_cond_destroy(async->cond);
+        ass_mutex_destroy(async->lock);
+        free(async);
+        return NULL;
+    }
+    async->thread = ass_thread_create(async_render_run, async);
+    return async;
+}
+
+static void async_render_wait(AsyncRender *async)
+{
+    ass_mutex_lock(async->lock);
+    while (async->busy)
+        ass_cond_wait(async->cond, async->lock);
+    ass_mutex_unlock(async->lock);
+}
+
+/**
+ * \brief Finish the frame of ass_render_frame_async() and stop the thread
+ */
+void ass_stop_async_render(ASS_Renderer *priv)
+{
+    AsyncRender *async = priv->async;
+    if (!async)
+        return;
+    if (async->thread) {
+        ass_mutex_lock(async->lock);
+        async->quit = true;
+        ass_cond_broadcast(async->cond);
+        ass_mutex_unlock(async->lock);
+        ass_thread_join(async->thread);
+    }
+    ass_cond_destroy(async->cond);
+    ass_mutex_destroy(async->lock);
+    free(async);
+    priv->async = NULL;
+}
+
+/**
+ * \brief Start rendering a frame on the renderer's own thread
+ * Waits for the previous frame first, one frame is rendered at a time.
+ * Without threading support the frame is rendered right away.
+ */
+int ass_render_frame_async(ASS_Renderer *priv, ASS_Track *track,
+                           long long now)
+{
+    if (!priv->async && !(priv->async = async_render_create(priv)))
+        return -1;
+    AsyncRender *async = priv->async;
+    async_render_wait(async);
+
+    if (!async->thread) {
+        async->images =
+            ass_render_frame(priv, track, now, &async->detect_change);
+        return 0;
+    }
+
+    ass_mutex_lock(async->lock);
+    async->track = track;
+    async->now = now;
+    async->queued = async->busy = true;
+    ass_cond_broadcast(async->cond);
+    ass_mutex_unlock(async->lock);
+    return 0;
+}
+
+int ass_render_frame_ready(ASS_Renderer *priv)
+{
+    AsyncRender *async = priv->async;
+    if (!async)
+        return 1;
+    ass_mutex_lock(async->lock);
+    bool ready = !async->busy;
+    ass_mutex_unlock(async->lock);
+    return ready;
+}
+
+ASS_Image *ass_render_frame_wait(ASS_Renderer *priv, int *detect_change)
+{
+    AsyncRender *async = priv->async;
+    if (!async) {
+        if (detect_change)
+            *detect_change = 2;
+        return NULL;
+    }
+    async_render_wait(async);
+    if (detect_change)
+        *detect_change = async->detect_change;
+    return async->images;
+}
+
+static void free_frame(ASS_Image *img)
+{
     do {
         ASS_ImagePriv *priv = (ASS_ImagePriv *) img;
         img = img->next;
@@ -3464,3 +5266,33 @@ void ass_frame_unref(ASS_Image *img)
         free(priv);
     } while (img);
 }
+
+/**
+ * \brief Add reference to a frame image list.
+ * \param image_list image list returned by ass_render_frame()
+ */
+void ass_frame_ref(ASS_Image *img)
+{
+    if (!img)
+        return;
+    ass_atomic_inc(&((ASS_ImagePriv *) img)->ref_count);
+}
+
+/**
+ * \brief Release reference to a frame image list.
+ * \param image_list image list returned by ass_render_frame()
+ * The caches lock themselves, so the last reference frees the frame
+ * right away, in whatever thread drops it.
+ */
+void ass_frame_unref(ASS_Image *img)
+{
+    if (!img)
+        return;
+    ASS_ImagePriv *head = (ASS_ImagePriv *) img;
+    if (ass_atomic_dec(&head->ref_count))
+        return;
+
+    ASS_FontDatabase *fontdb = head->fontdb;
+    free_frame(img);
+    ass_font_database_unref(fontdb);
+}
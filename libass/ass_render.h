@@ -33,27 +33,42 @@
 #include "ass_font.h"
 #include "ass_bitmap.h"
 #include "ass_cache.h"
+#include "ass_disk_cache.h"
+#include "ass_font_database.h"
 #include "ass_utils.h"
 #include "ass_fontselect.h"
 #include "ass_library.h"
 #include "ass_drawing.h"
 #include "ass_bitmap.h"
 #include "ass_rasterizer.h"
+#include "ass_threading.h"
 
 #define GLYPH_CACHE_MAX 10000
+#define SHAPE_CACHE_MAX 2000
+#define HB_FONT_CACHE_MAX 500
+#define LAYOUT_CACHE_MAX 200
 #define MEGABYTE (1024 * 1024)
 #define BITMAP_CACHE_MAX_SIZE (128 * MEGABYTE)
 #define COMPOSITE_CACHE_RATIO 2
 #define COMPOSITE_CACHE_MAX_SIZE (BITMAP_CACHE_MAX_SIZE / COMPOSITE_CACHE_RATIO)
+#define CLIP_CACHE_RATIO 4
+#define CLIP_CACHE_MAX_SIZE (COMPOSITE_CACHE_MAX_SIZE / CLIP_CACHE_RATIO)
+#define BUDGET_MIN_SHARE 0.1    // smallest part of the cache budget given to a cache
+#define BUDGET_SMOOTHING 0.05   // weight of the latest frame in cache loads
+#define DISK_CACHE_MIN_COST 1e-4  // construction time worth storing, in seconds
+#define BUDGET_OUTLINE_SIZE 2048  // typical memory use of a cached outline, in bytes
 
 #define PARSED_FADE (1<<0)
 #define PARSED_A    (1<<1)
 
 typedef struct {
     ASS_Image result;
-    CompositeHashValue *source;
+    void *source;               // cache value owning the bitmap, if any
     unsigned char *buffer;
-    size_t ref_count;
+    volatile long ref_count;    // atomic, see ass_frame_unref()
+
+    // set on the first image of a frame only
+    ASS_FontDatabase *fontdb;   // referenced by the frame
 } ASS_ImagePriv;
 
 typedef struct {
@@ -201,17 +216,63 @@ typedef struct {
     int max_glyphs;
     int max_lines;
     unsigned max_bitmaps;
+    char *layout_key;           // serialized glyph parameters for the layout cache
+    size_t layout_key_size;
 } TextInfo;
 
+// caches sharing the memory budget set with ass_set_cache_budget()
+enum {
+    BUDGET_OUTLINE,
+    BUDGET_BITMAP,
+    BUDGET_COMPOSITE,   // together with the clip cache
+    BUDGET_CACHE_COUNT
+};
+
+typedef struct {
+    // those of the font database, see ass_attach_font_database()
+    Cache *font_cache;
+    Cache *outline_cache;
+    Cache *face_size_metrics_cache;
+    Cache *metrics_cache;
+    Cache *hb_font_cache;
+    Cache *shape_plan_cache;
+    Cache *shape_cache;
+    Cache *lookup_coverage_cache;
+
+    // the renderer's own, locked before the font database where both are
+    CacheGroup *group;
+    Cache *bitmap_cache;
+    Cache *composite_cache;
+    Cache *clip_cache;
+    Cache *layout_cache;
+    DiskCache *disk_cache;      // see ass_set_disk_cache(), NULL if unused
+    size_t glyph_max;
+    size_t bitmap_max_size;
+    size_t composite_max_size;
+    size_t clip_max_size;
+    size_t budget;              // total size of budgeted caches, 0 if unused
+    double budget_load[BUDGET_CACHE_COUNT];  // see rebalance_cache_budget()
+} CacheStore;
+
 #include "ass_shaper.h"
 
 // Renderer state.
 // Values like current font face, color, screen position, clipping and so on are stored here.
 struct render_context {
     ASS_Renderer *renderer;
+
+    // frame-global data, see prepare_frame() in ass_render.c
+    ASS_Track *track;
+    long long time;             // frame's timestamp, ms
+    double par_scale_x;         // x scale applied to all glyphs to preserve text aspect ratio
+
+    // registered with both cache groups while rendering
+    CacheReader fontdb_reader, cache_reader;
+
     TextInfo text_info;
     ASS_Shaper *shaper;
     RasterizerData rasterizer;
+    FilterContext filter;
 
     ASS_Event *event;
     ASS_Style *style;
@@ -297,23 +358,9 @@ struct render_context {
 
 typedef struct render_context RenderContext;
 
-typedef struct {
-    Cache *font_cache;
-    Cache *outline_cache;
-    Cache *bitmap_cache;
-    Cache *composite_cache;
-    Cache *face_size_metrics_cache;
-    Cache *metrics_cache;
-    size_t glyph_max;
-    size_t bitmap_max_size;
-    size_t composite_max_size;
-} CacheStore;
-
 struct ass_renderer {
     ASS_Library *library;
-    FT_Library ftlibrary;
-    ASS_FontSelector *fontselect;
-    size_t num_emfonts;
+    ASS_FontDatabase *fontdb;       // see ass_attach_font_database()
     ASS_Settings settings;
     int render_id;
 
@@ -329,21 +376,39 @@ struct ass_renderer {
     int frame_content_width;    // content frame width ( = screen width - API margins )
     double fit_height;          // content frame height without zoom & pan (fit to screen & letterboxed)
     double fit_width;           // content frame width without zoom & pan (fit to screen & letterboxed)
-    ASS_Track *track;
-    long long time;             // frame's timestamp, ms
-    double par_scale_x;        // x scale applied to all glyphs to preserve text aspect ratio
 
     RenderContext state;
     CacheStore cache;
 
     BitmapEngine engine;
+    int n_threads;              // see ass_set_threads()
+    ASS_ThreadPool *pool;       // helpers of the renderer's own context, NULL if none
 
     ASS_Style user_override_style;
+
+    // open addressing table of RenderPriv, valid for event_track
+    // and render_id only; events themselves are never modified
+    ASS_RenderPriv *event_states;
+    size_t event_states_mask, event_states_count;
+    ASS_Track *event_track;
+    int event_render_id;
+
+    // renderers of ass_render_frames() workers, kept for later batches
+    ASS_Renderer **workers;
+    int n_workers;
+
+    struct prefetch *prefetch;  // job of ass_prefetch(), NULL if none
+    struct async_render *async; // see ass_render_frame_async(), NULL if unused
 };
 
+// collision state of an event, see get_render_priv() in ass_render.c
 typedef struct render_priv {
-    int top, height, left, width;
-    int render_id;
+    // identifies the event, whose address changes as the track grows
+    long long start, duration;
+    int read_order, layer;
+    bool used;
+
+    int top, height, left, width;   // height is 0 until the event is fixed
 } RenderPriv;
 
 typedef struct {
@@ -354,11 +419,15 @@ typedef struct {
 } Rect;
 
 void ass_reset_render_context(RenderContext *state, ASS_Style *style);
-void ass_frame_ref(ASS_Image *img);
-void ass_frame_unref(ASS_Image *img);
-ASS_Vector ass_layout_res(ASS_Renderer *render_priv);
+void ass_attach_font_database(ASS_Renderer *priv, ASS_FontDatabase *db);
+ASS_Renderer *ass_renderer_clone(ASS_Renderer *priv);
+void ass_renderer_sync(ASS_Renderer *clone, ASS_Renderer *priv);
+void ass_cancel_prefetch(ASS_Renderer *priv);
+void ass_stop_async_render(ASS_Renderer *priv);
+ASS_Vector ass_layout_res(ASS_Renderer *render_priv, ASS_Track *track);
 
 // XXX: this is actually in ass.c, includes should be fixed later on
 void ass_lazy_track_init(ASS_Library *lib, ASS_Track *track);
+ASS_Track *ass_copy_track(ASS_Track *track, const int *events, int n_events);
 
 #endif /* LIBASS_RENDER_H */
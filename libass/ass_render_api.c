@@ -24,16 +24,29 @@
 #include <stdint.h>
 
 #include "ass_render.h"
+#include "ass_threading.h"
 #include "ass_utils.h"
 
-static void ass_reconfigure(ASS_Renderer *priv)
+/**
+ * \brief Apply changed settings
+ * \param rescaled whether the change affects the output scale
+ * Cache keys fully describe their values, so no cache becomes invalid.
+ * If the output scale changes, layouts and bitmaps, which are in output
+ * pixels, will mostly not be reused and are dropped to free memory at once.
+ * Outlines of glyphs and drawings, metrics and shaping results don't
+ * depend on the output scale and are kept.
+ */
+static void ass_reconfigure(ASS_Renderer *priv, bool rescaled)
 {
     ASS_Settings *settings = &priv->settings;
 
     priv->render_id++;
-    ass_cache_empty(priv->cache.composite_cache);
-    ass_cache_empty(priv->cache.bitmap_cache);
-    ass_cache_empty(priv->cache.outline_cache);
+    if (rescaled) {
+        ass_cache_empty(priv->cache.layout_cache);
+        ass_cache_empty(priv->cache.clip_cache);
+        ass_cache_empty(priv->cache.composite_cache);
+        ass_cache_empty(priv->cache.bitmap_cache);
+    }
 
     priv->width = settings->frame_width;
     priv->height = settings->frame_height;
@@ -58,9 +71,10 @@ void ass_set_frame_size(ASS_Renderer *priv, int w, int h)
     if (w <= 0 || h <= 0 || w > FFMIN(INT_MAX, SIZE_MAX) / h)
         w = h = 0;
     if (priv->settings.frame_width != w || priv->settings.frame_height != h) {
+        ass_cancel_prefetch(priv);
         priv->settings.frame_width = w;
         priv->settings.frame_height = h;
-        ass_reconfigure(priv);
+        ass_reconfigure(priv, true);
     }
 }
 
@@ -70,36 +84,43 @@ void ass_set_storage_size(ASS_Renderer *priv, int w, int h)
         w = h = 0;
     if (priv->settings.storage_width != w ||
         priv->settings.storage_height != h) {
+        ass_cancel_prefetch(priv);
         priv->settings.storage_width = w;
         priv->settings.storage_height = h;
-        ass_reconfigure(priv);
+        ass_reconfigure(priv, true);
     }
 }
 
 void ass_set_shaper(ASS_Renderer *priv, ASS_ShapingLevel level)
 {
     // select the complex shaper for illegal values
-    if (level == ASS_SHAPING_SIMPLE || level == ASS_SHAPING_COMPLEX)
+    if (level != ASS_SHAPING_SIMPLE && level != ASS_SHAPING_COMPLEX)
+        level = ASS_SHAPING_COMPLEX;
+    if (priv->settings.shaper != level) {
+        ass_cancel_prefetch(priv);
         priv->settings.shaper = level;
-    else
-        priv->settings.shaper = ASS_SHAPING_COMPLEX;
+    }
 }
 
 void ass_set_margins(ASS_Renderer *priv, int t, int b, int l, int r)
 {
     if (priv->settings.left_margin != l || priv->settings.right_margin != r ||
         priv->settings.top_margin != t || priv->settings.bottom_margin != b) {
+        ass_cancel_prefetch(priv);
         priv->settings.left_margin = l;
         priv->settings.right_margin = r;
         priv->settings.top_margin = t;
         priv->settings.bottom_margin = b;
-        ass_reconfigure(priv);
+        ass_reconfigure(priv, true);
     }
 }
 
 void ass_set_use_margins(ASS_Renderer *priv, int use)
 {
-    priv->settings.use_margins = use;
+    if (priv->settings.use_margins != use) {
+        ass_cancel_prefetch(priv);
+        priv->settings.use_margins = use;
+    }
 }
 
 void ass_set_aspect_ratio(ASS_Renderer *priv, double dar, double sar)
@@ -111,37 +132,44 @@ void ass_set_pixel_aspect(ASS_Renderer *priv, double par)
 {
     if (par < 0) par = 0;
     if (priv->settings.par != par) {
+        ass_cancel_prefetch(priv);
         priv->settings.par = par;
-        ass_reconfigure(priv);
+        ass_reconfigure(priv, true);
     }
 }
 
 void ass_set_font_scale(ASS_Renderer *priv, double font_scale)
 {
     if (priv->settings.font_size_coeff != font_scale) {
+        ass_cancel_prefetch(priv);
         priv->settings.font_size_coeff = font_scale;
-        ass_reconfigure(priv);
+        ass_reconfigure(priv, true);
     }
 }
 
 void ass_set_hinting(ASS_Renderer *priv, ASS_Hinting ht)
 {
     if (priv->settings.hinting != ht) {
+        ass_cancel_prefetch(priv);
         priv->settings.hinting = ht;
-        ass_reconfigure(priv);
+        ass_reconfigure(priv, true);
     }
 }
 
 void ass_set_line_spacing(ASS_Renderer *priv, double line_spacing)
 {
-    priv->settings.line_spacing = line_spacing;
+    if (priv->settings.line_spacing != line_spacing) {
+        ass_cancel_prefetch(priv);
+        priv->settings.line_spacing = line_spacing;
+    }
 }
 
 void ass_set_line_position(ASS_Renderer *priv, double line_position)
 {
     if (priv->settings.line_position != line_position) {
+        ass_cancel_prefetch(priv);
         priv->settings.line_position = line_position;
-        ass_reconfigure(priv);
+        ass_reconfigure(priv, false);
     }
 }
 
@@ -149,38 +177,56 @@ void ass_set_fonts(ASS_Renderer *priv, const char *default_font,
                    const char *default_family, int dfp,
                    const char *config, int update)
 {
+    ass_cancel_prefetch(priv);
     free(priv->settings.default_font);
     free(priv->settings.default_family);
     priv->settings.default_font = default_font ? strdup(default_font) : 0;
     priv->settings.default_family =
         default_family ? strdup(default_family) : 0;
 
-    ass_reconfigure(priv);
-
-    ass_cache_empty(priv->cache.font_cache);
-    ass_cache_empty(priv->cache.metrics_cache);
+    // a private database, so that other renderers keep their fonts
+    ASS_FontDatabase *fontdb = ass_font_database_init(priv->library,
+            default_font, default_family, dfp, config);
+    if (!fontdb) {
+        ass_msg(priv->library, MSGL_ERR, "Failed to set up fonts");
+        return;
+    }
+    ass_attach_font_database(priv, fontdb);
+    ass_font_database_unref(fontdb);
+    ass_reconfigure(priv, false);
+}
 
-    if (priv->fontselect)
-        ass_fontselect_free(priv->fontselect);
-    priv->fontselect = ass_fontselect_init(priv->library, priv->ftlibrary,
-            &priv->num_emfonts, default_family, default_font, config, dfp);
+void ass_set_font_database(ASS_Renderer *priv, ASS_FontDatabase *db)
+{
+    ass_cancel_prefetch(priv);
+    if (db->library != priv->library) {
+        ass_msg(priv->library, MSGL_ERR,
+                "Font database belongs to another library");
+        return;
+    }
+    if (db == priv->fontdb)
+        return;
+    ass_attach_font_database(priv, db);
+    ass_reconfigure(priv, false);
 }
 
 void ass_set_selective_style_override_enabled(ASS_Renderer *priv, int bits)
 {
     if (priv->settings.selective_style_overrides != bits) {
+        ass_cancel_prefetch(priv);
         priv->settings.selective_style_overrides = bits;
-        ass_reconfigure(priv);
+        ass_reconfigure(priv, false);
     }
 }
 
 void ass_set_selective_style_override(ASS_Renderer *priv, ASS_Style *style)
 {
+    ass_cancel_prefetch(priv);
     ASS_Style *user_style = &priv->user_override_style;
     free(user_style->FontName);
     *user_style = *style;
     user_style->FontName = strdup(user_style->FontName);
-    ass_reconfigure(priv);
+    ass_reconfigure(priv, false);
 }
 
 int ass_fonts_update(ASS_Renderer *render_priv)
@@ -189,27 +235,229 @@ int ass_fonts_update(ASS_Renderer *render_priv)
     return 1;
 }
 
+/**
+ * \brief Set the cache budget, timing the constructors of budgeted caches
+ * while there is one, see rebalance_cache_budget()
+ */
+static void set_budget(CacheStore *cache, size_t budget)
+{
+    if (!cache->budget != !budget) {
+        bool timed = budget;
+        ass_cache_request_timing(cache->outline_cache, timed);
+        ass_cache_request_timing(cache->bitmap_cache, timed);
+        ass_cache_request_timing(cache->composite_cache, timed);
+        ass_cache_request_timing(cache->clip_cache, timed);
+    }
+    cache->budget = budget;
+}
+
 void ass_set_cache_limits(ASS_Renderer *render_priv, int glyph_max,
                           int bitmap_max)
 {
+    ass_cancel_prefetch(render_priv);
     render_priv->cache.glyph_max = glyph_max ? glyph_max : GLYPH_CACHE_MAX;
 
-    size_t bitmap_cache, composite_cache;
+    size_t bitmap_cache, composite_cache, clip_cache;
     if (bitmap_max) {
         bitmap_cache = MEGABYTE * (size_t) bitmap_max;
         composite_cache = bitmap_cache / (COMPOSITE_CACHE_RATIO + 1);
         bitmap_cache -= composite_cache;
+        clip_cache = composite_cache / (CLIP_CACHE_RATIO + 1);
+        composite_cache -= clip_cache;
     } else {
         bitmap_cache = BITMAP_CACHE_MAX_SIZE;
         composite_cache = COMPOSITE_CACHE_MAX_SIZE;
+        clip_cache = CLIP_CACHE_MAX_SIZE;
     }
     render_priv->cache.bitmap_max_size = bitmap_cache;
     render_priv->cache.composite_max_size = composite_cache;
+    render_priv->cache.clip_max_size = clip_cache;
+    set_budget(&render_priv->cache, 0);
+}
+
+void ass_set_cache_budget(ASS_Renderer *priv, int max_size)
+{
+    ass_cancel_prefetch(priv);
+    if (max_size <= 0) {
+        ass_set_cache_limits(priv, 0, 0);
+        return;
+    }
+
+    // start from an even split, see rebalance_cache_budget()
+    CacheStore *cache = &priv->cache;
+    set_budget(cache, MEGABYTE * (size_t) max_size);
+    for (int i = 0; i < BUDGET_CACHE_COUNT; i++)
+        cache->budget_load[i] = 0;
+    size_t share = cache->budget / BUDGET_CACHE_COUNT;
+    cache->glyph_max = share / BUDGET_OUTLINE_SIZE;
+    cache->bitmap_max_size = share;
+    cache->clip_max_size = share / (CLIP_CACHE_RATIO + 1);
+    cache->composite_max_size = share - cache->clip_max_size;
+}
+
+void ass_set_cache_policy(ASS_Renderer *priv, ASS_CachePolicy policy)
+{
+    ass_cancel_prefetch(priv);
+    CachePolicy cache_policy;
+    switch (policy) {
+    case ASS_CACHE_POLICY_SCAN_RESISTANT:
+        cache_policy = CACHE_POLICY_2Q;
+        break;
+    case ASS_CACHE_POLICY_COST:
+        cache_policy = CACHE_POLICY_COST;
+        break;
+    default:
+        cache_policy = CACHE_POLICY_LRU;
+    }
+
+    CacheStore *cache = &priv->cache;
+    ass_cache_set_policy(cache->outline_cache, cache_policy);
+    ass_cache_set_policy(cache->bitmap_cache, cache_policy);
+    ass_cache_set_policy(cache->composite_cache, cache_policy);
+    ass_cache_set_policy(cache->clip_cache, cache_policy);
+}
+
+int ass_set_disk_cache(ASS_Renderer *priv, const char *dir)
+{
+    ass_cancel_prefetch(priv);
+    ass_disk_cache_done(priv->cache.disk_cache);
+    priv->cache.disk_cache = NULL;
+    if (!dir)
+        return 0;
+
+    priv->cache.disk_cache =
+        ass_disk_cache_create(priv->library, priv->fontdb->ftlibrary, dir);
+    return priv->cache.disk_cache ? 0 : -1;
+}
+
+void ass_renderer_trim(ASS_Renderer *priv)
+{
+    // a prefetch job would only fill the caches again
+    ass_cancel_prefetch(priv);
+
+    // drop everything not used by images still held by the caller,
+    // starting with caches whose entries reference other caches
+    CacheStore *cache = &priv->cache;
+    ass_cache_cut(cache->layout_cache, 0);
+    ass_cache_cut(cache->clip_cache, 0);
+    ass_cache_cut(cache->composite_cache, 0);
+    ass_cache_cut(cache->bitmap_cache, 0);
+    ass_cache_cut(cache->outline_cache, 0);
+    ass_cache_cut(cache->shape_cache, 0);
+    ass_cache_cut(cache->shape_plan_cache, 0);
+    ass_cache_cut(cache->lookup_coverage_cache, 0);
+    ass_cache_cut(cache->hb_font_cache, 0);
+    ass_cache_cut(cache->metrics_cache, 0);
+    ass_cache_cut(cache->face_size_metrics_cache, 0);
+
+    // blur scratch memory is allocated again on demand
+    FilterContext *filter = &priv->state.filter;
+    ass_filter_context_done(filter);
+    ass_filter_context_init(filter);
+    filter->pool = priv->pool;
+
+    // frames of ass_render_frame_async() are rendered with the context above,
+    // workers of ass_render_frames() have caches and contexts of their own
+    for (int i = 0; i < priv->n_workers; i++)
+        ass_renderer_trim(priv->workers[i]);
+}
+
+void ass_set_threads(ASS_Renderer *priv, int threads)
+{
+    if (threads <= 0)
+        threads = ass_cpu_count();
+    priv->n_threads = threads;
+
+    // threads are started once here, not for every parallel fill
+    ass_thread_pool_free(priv->pool);
+    priv->pool = NULL;
+    if (threads > 1) {
+        priv->pool = ass_thread_pool_create(threads - 1);
+        if (ass_thread_pool_size(priv->pool) < threads - 1)
+            ass_msg(priv->library, MSGL_WARN, "Started %d of %d threads",
+                    ass_thread_pool_size(priv->pool), threads - 1);
+    }
+
+    if (!ass_rasterizer_set_threads(&priv->engine, &priv->state.rasterizer, priv->pool)) {
+        ass_msg(priv->library, MSGL_WARN, "Failed to set up %d rasterizer threads", threads);
+        ass_rasterizer_set_threads(&priv->engine, &priv->state.rasterizer, NULL);
+    }
+    priv->state.filter.pool = priv->pool;
 }
 
 ASS_FontProvider *
 ass_create_font_provider(ASS_Renderer *priv, ASS_FontProviderFuncs *funcs,
                          void *data)
 {
-    return ass_font_provider_new(priv->fontselect, funcs, data);
+    ASS_FontDatabase *fontdb = priv->fontdb;
+    ass_font_database_lock(fontdb);
+    ASS_FontProvider *provider =
+        ass_font_provider_new(fontdb->fontselect, funcs, data);
+    ass_font_database_unlock(fontdb);
+    return provider;
+}
+
+static bool same_scale(const ASS_Settings *a, const ASS_Settings *b)
+{
+    return a->frame_width == b->frame_width &&
+           a->frame_height == b->frame_height &&
+           a->storage_width == b->storage_width &&
+           a->storage_height == b->storage_height &&
+           a->left_margin == b->left_margin &&
+           a->right_margin == b->right_margin &&
+           a->top_margin == b->top_margin &&
+           a->bottom_margin == b->bottom_margin &&
+           a->par == b->par &&
+           a->font_size_coeff == b->font_size_coeff &&
+           a->hinting == b->hinting;
+}
+
+/**
+ * \brief Give a clone the current settings and fonts of its renderer
+ */
+void ass_renderer_sync(ASS_Renderer *clone, ASS_Renderer *priv)
+{
+    if (clone->fontdb != priv->fontdb)
+        ass_attach_font_database(clone, priv->fontdb);
+
+    ASS_Settings *settings = &clone->settings;
+    bool rescaled = !same_scale(settings, &priv->settings);
+    free(settings->default_font);
+    free(settings->default_family);
+    *settings = priv->settings;
+    settings->default_font = NULL;
+    settings->default_family = NULL;
+    if (priv->settings.default_font)
+        settings->default_font = strdup(priv->settings.default_font);
+    if (priv->settings.default_family)
+        settings->default_family = strdup(priv->settings.default_family);
+
+    ASS_Style *user_style = &clone->user_override_style;
+    free(user_style->FontName);
+    *user_style = priv->user_override_style;
+    if (user_style->FontName)
+        user_style->FontName = strdup(user_style->FontName);
+
+    CacheStore *cache = &clone->cache;
+    cache->glyph_max = priv->cache.glyph_max;
+    cache->bitmap_max_size = priv->cache.bitmap_max_size;
+    cache->composite_max_size = priv->cache.composite_max_size;
+    cache->clip_max_size = priv->cache.clip_max_size;
+    set_budget(cache, priv->cache.budget);
+    for (int i = 0; i < BUDGET_CACHE_COUNT; i++)
+        cache->budget_load[i] = priv->cache.budget_load[i];
+
+    ass_reconfigure(clone, rescaled);
+}
+
+/**
+ * \brief Create a renderer sharing the font database, with caches and
+ * frame state of its own, so that both can render at the same time
+ */
+ASS_Renderer *ass_renderer_clone(ASS_Renderer *priv)
+{
+    ASS_Renderer *clone = ass_renderer_init(priv->library);
+    if (clone)
+        ass_renderer_sync(clone, priv);
+    return clone;
 }
@@ -30,6 +30,7 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_TRUETYPE_TABLES_H
+#include <hb-ot.h>
 enum {
     VERT = 0,
     VKNA,
@@ -66,6 +67,15 @@ struct ass_shaper {
     Cache *face_size_metrics_cache;
     Cache *metrics_cache;
 
+    // HarfBuzz fonts and shape plans, to avoid setting them up for every run
+    Cache *hb_font_cache;
+    Cache *shape_plan_cache;
+
+    // Cache of shaped runs, to avoid calling HarfBuzz repeatedly
+    Cache *shape_cache;
+    // Glyphs affected by OpenType lookups, to bypass HarfBuzz for trivial runs
+    Cache *lookup_coverage_cache;
+
     hb_font_funcs_t *font_funcs;
     hb_buffer_t *buf;
 
@@ -458,41 +468,61 @@ bool ass_create_hb_font(ASS_Font *font, int index)
 }
 
 /**
- * \brief Create HarfBuzz sub-font for current face and size.
- * \param info glyph cluster
- * \return HarfBuzz font
+ * \brief Create HarfBuzz sub-font for given face and size.
+ * Construction function for the HarfBuzz font cache.
+ * \param priv shaper instance
  */
-static hb_font_t *get_hb_font(ASS_Shaper *shaper, GlyphInfo *info)
+size_t ass_hb_font_construct(void *key, void *value, void *priv)
 {
-    ASS_Font *font = info->font;
+    FaceSizeMetricsHashKey *k = key;
+    hb_font_t **v = value;
+    ASS_Shaper *shaper = priv;
 
-    FaceSizeMetricsHashKey key = {
-        .font = info->font,
-        .face_index = info->face_index,
-        .size = info->font_size,
-    };
-    FT_Size_Metrics *m = ass_cache_get(shaper->face_size_metrics_cache, &key, NULL);
+    *v = NULL;
+
+    FT_Size_Metrics *m = ass_cache_get(shaper->face_size_metrics_cache, k, NULL);
     if (!m)
-        return NULL;
+        return 1;
 
-    hb_font_t *hb_font = hb_font_create_sub_font(font->hb_fonts[info->face_index]);
+    hb_font_t *hb_font = hb_font_create_sub_font(k->font->hb_fonts[k->face_index]);
     if (hb_font_is_immutable(hb_font))
-        return NULL;
+        return 1;
 
     // set up cached metrics access
     struct ass_shaper_metrics_data *metrics = calloc(1, sizeof(struct ass_shaper_metrics_data));
     if (!metrics) {
         hb_font_destroy(hb_font);
-        return NULL;
+        return 1;
     }
     metrics->metrics_cache = shaper->metrics_cache;
-    metrics->hash_key = key;
+    metrics->hash_key = *k;
 
     hb_font_set_funcs(hb_font, shaper->font_funcs, metrics, free);
 
-    update_hb_size(hb_font, font->faces[info->face_index], m);
+    update_hb_size(hb_font, k->font->faces[k->face_index], m);
 
-    return hb_font;
+    *v = hb_font;
+    return 1;
+}
+
+/**
+ * \brief Get HarfBuzz sub-font for given face and size.
+ * The font is owned by the HarfBuzz font cache.
+ * \param font font
+ * \param face_index face index in font
+ * \param size font size
+ * \return HarfBuzz font
+ */
+static hb_font_t *get_hb_font(ASS_Shaper *shaper, ASS_Font *font,
+                              int face_index, double size)
+{
+    FaceSizeMetricsHashKey key = {
+        .font = font,
+        .face_index = face_index,
+        .size = size,
+    };
+    hb_font_t **hb_font = ass_cache_get(shaper->hb_font_cache, &key, shaper);
+    return hb_font ? *hb_font : NULL;
 }
 
 /**
@@ -504,6 +534,30 @@ static inline bool is_shaping_control(unsigned symbol) {
     return symbol == 0x200C /* ZWNJ */ || symbol == 0x200D /* ZWJ */;
 }
 
+/**
+ * \brief Determine whether HarfBuzz ignores any font-provided glyph
+ * for this Unicode codepoint and replaces it with a zero-width glyph.
+ * Matches hb_unicode_funcs_t::is_default_ignorable in hb-unicode.hh.
+ * The affected codepoints are a subset of Unicode's Default_Ignorable list.
+ */
+static inline bool is_harfbuzz_ignorable(unsigned symbol) {
+    switch (symbol >> 8) {
+        case 0x00: return symbol == 0x00AD;
+        case 0x03: return symbol == 0x034F;
+        case 0x06: return symbol == 0x061C;
+        case 0x17: return symbol >= 0x17B4 && symbol <= 0x17B5;
+        case 0x18: return symbol >= 0x180B && symbol <= 0x180E;
+        case 0x20: return (symbol >= 0x200B && symbol <= 0x200F) ||
+                          (symbol >= 0x202A && symbol <= 0x202E) ||
+                          (symbol >= 0x2060 && symbol <= 0x206F);
+        case 0xFE: return (symbol >= 0xFE00 && symbol <= 0xFE0F) ||
+                          symbol == 0xFEFF;
+        case 0xFF: return symbol >= 0xFFF0 && symbol <= 0xFFF8;
+        case 0x1D1: return symbol >= 0x1D173 && symbol <= 0x1D17A;
+        default: return symbol >= 0xE0000 && symbol <= 0xE0FFF;
+    }
+}
+
 /**
  * \brief Map script to default language.
  *
@@ -605,23 +659,400 @@ hb_shaper_get_run_language(ASS_Shaper *shaper, hb_script_t script)
     return lang;
 }
 
+/**
+ * \brief Get enabled OpenType features as a bitmask
+ * suitable for ShapeHashKey::features.
+ */
+static unsigned get_feature_mask(ASS_Shaper *shaper)
+{
+    unsigned mask = 0;
+    for (int i = 0; i < shaper->n_features; i++)
+        if (shaper->features[i].value)
+            mask |= 1u << i;
+    return mask;
+}
+
+/**
+ * \brief Check whether a face has any AAT layout tables,
+ * which HarfBuzz may apply instead of or on top of OpenType lookups.
+ */
+static bool has_aat_tables(FT_Face face)
+{
+    static const FT_ULong tags[] = {
+        FT_MAKE_TAG('m', 'o', 'r', 'x'),
+        FT_MAKE_TAG('m', 'o', 'r', 't'),
+        FT_MAKE_TAG('k', 'e', 'r', 'x'),
+        FT_MAKE_TAG('t', 'r', 'a', 'k'),
+    };
+    for (int i = 0; i < sizeof(tags) / sizeof(tags[0]); i++) {
+        FT_ULong len = 0;
+        if (FT_Load_Sfnt_Table(face, tags[i], 0, NULL, &len) == FT_Err_Ok)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * \brief Add the lookups of all required features of a layout table.
+ * HarfBuzz applies these regardless of the requested features.
+ */
+static void collect_required_lookups(hb_face_t *face, hb_tag_t table,
+                                     hb_set_t *lookups)
+{
+    unsigned n_scripts =
+        hb_ot_layout_table_get_script_tags(face, table, 0, NULL, NULL);
+    for (unsigned script = 0; script < n_scripts; script++) {
+        unsigned n_langs = hb_ot_layout_script_get_language_tags(face,
+                table, script, 0, NULL, NULL);
+        // the last iteration covers the default language system
+        for (unsigned i = 0; i <= n_langs; i++) {
+            unsigned lang = i < n_langs ? i : HB_OT_LAYOUT_DEFAULT_LANGUAGE_INDEX;
+            unsigned feature;
+            if (!hb_ot_layout_language_get_required_feature_index(face,
+                        table, script, lang, &feature))
+                continue;
+
+            unsigned offset = 0, count;
+            do {
+                unsigned indexes[32];
+                count = sizeof(indexes) / sizeof(indexes[0]);
+                hb_ot_layout_feature_get_lookups(face, table, feature,
+                        offset, &count, indexes);
+                for (unsigned j = 0; j < count; j++)
+                    hb_set_add(lookups, indexes[j]);
+                offset += count;
+            } while (count);
+        }
+    }
+}
+
+/**
+ * \brief Collect all glyphs that OpenType lookups HarfBuzz applies
+ * to horizontal LTR text by default may act upon.
+ * Construction function for the lookup coverage cache.
+ *
+ * The coverage is deliberately conservative: lookups of all scripts and
+ * language systems are considered, along with all input glyphs of
+ * contextual lookups. A run none of whose glyphs are covered is
+ * guaranteed to be left alone by every lookup.
+ */
+size_t ass_lookup_coverage_construct(void *key, void *value, void *priv)
+{
+    LookupCoverageHashKey *k = key;
+    LookupCoverageHashValue *v = value;
+
+    v->simple = false;
+    v->glyphs = NULL;
+
+    FT_Face face = k->font->faces[k->face_index];
+    if ((k->features & (1u << VERT | 1u << VKNA)) || has_aat_tables(face))
+        return 1;
+
+    // HarfBuzz falls back to the legacy 'kern' table
+    // if GPOS has no kerning, which we cannot easily tell
+    bool kern = k->features & (1u << KERN);
+    if (kern && FT_HAS_KERNING(face))
+        return 1;
+
+    hb_tag_t features[] = {
+        // common
+        HB_TAG('a', 'b', 'v', 'm'),
+        HB_TAG('b', 'l', 'w', 'm'),
+        HB_TAG('c', 'c', 'm', 'p'),
+        HB_TAG('l', 'o', 'c', 'l'),
+        HB_TAG('m', 'a', 'r', 'k'),
+        HB_TAG('m', 'k', 'm', 'k'),
+        HB_TAG('r', 'l', 'i', 'g'),
+        HB_TAG('r', 'v', 'r', 'n'),
+        HB_TAG('r', 'a', 'n', 'd'),
+        // horizontal
+        HB_TAG('c', 'a', 'l', 't'),
+        HB_TAG('c', 'u', 'r', 's'),
+        HB_TAG('d', 'i', 's', 't'),
+        HB_TAG('r', 'c', 'l', 't'),
+        // LTR
+        HB_TAG('l', 't', 'r', 'a'),
+        HB_TAG('l', 't', 'r', 'm'),
+        // optional, filled in below
+        HB_TAG_NONE,
+        HB_TAG_NONE,
+        HB_TAG_NONE,
+        HB_TAG_NONE,
+    };
+    int n_features = 15;
+    if (kern)
+        features[n_features++] = HB_TAG('k', 'e', 'r', 'n');
+    if (k->features & (1u << LIGA))
+        features[n_features++] = HB_TAG('l', 'i', 'g', 'a');
+    if (k->features & (1u << CLIG))
+        features[n_features++] = HB_TAG('c', 'l', 'i', 'g');
+
+    hb_face_t *hb_face = hb_font_get_face(k->font->hb_fonts[k->face_index]);
+    hb_set_t *lookups = hb_set_create();
+    v->glyphs = hb_set_create();
+
+    static const hb_tag_t tables[] = { HB_OT_TAG_GSUB, HB_OT_TAG_GPOS };
+    for (int i = 0; i < sizeof(tables) / sizeof(tables[0]); i++) {
+        hb_set_clear(lookups);
+        hb_ot_layout_collect_lookups(hb_face, tables[i],
+                NULL, NULL, features, lookups);
+        collect_required_lookups(hb_face, tables[i], lookups);
+
+        hb_codepoint_t lookup = HB_SET_VALUE_INVALID;
+        while (hb_set_next(lookups, &lookup))
+            hb_ot_layout_lookup_collect_glyphs(hb_face, tables[i], lookup,
+                    NULL, v->glyphs, NULL, NULL);
+    }
+
+    v->simple = hb_set_allocation_successful(lookups) &&
+        hb_set_allocation_successful(v->glyphs);
+    hb_set_destroy(lookups);
+    return 1;
+}
+
+/**
+ * \brief Check whether a script is shaped by HarfBuzz' default shaper
+ * and never needs reordering or contextual forms on its own.
+ */
+static bool is_simple_script(hb_script_t script)
+{
+    switch (script) {
+    case HB_SCRIPT_COMMON:
+    case HB_SCRIPT_LATIN:
+    case HB_SCRIPT_GREEK:
+    case HB_SCRIPT_CYRILLIC:
+    case HB_SCRIPT_ARMENIAN:
+    case HB_SCRIPT_GEORGIAN:
+    case HB_SCRIPT_HAN:
+    case HB_SCRIPT_HIRAGANA:
+    case HB_SCRIPT_KATAKANA:
+    case HB_SCRIPT_BOPOMOFO:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * \brief Check whether HarfBuzz may treat a codepoint specially
+ * even if no font lookups apply: combining marks and other grapheme
+ * extenders are merged into clusters and may be repositioned,
+ * fraction slashes enable numerator/denominator features.
+ */
+static bool needs_harfbuzz(hb_unicode_funcs_t *ufuncs, unsigned symbol)
+{
+    switch (hb_unicode_general_category(ufuncs, symbol)) {
+    case HB_UNICODE_GENERAL_CATEGORY_NON_SPACING_MARK:
+    case HB_UNICODE_GENERAL_CATEGORY_SPACING_MARK:
+    case HB_UNICODE_GENERAL_CATEGORY_ENCLOSING_MARK:
+        return true;
+    default:
+        break;
+    }
+    return is_harfbuzz_ignorable(symbol) || is_shaping_control(symbol) ||
+        symbol == 0x2044 /* FRACTION SLASH */ ||
+        symbol == 0x2215 /* DIVISION SLASH */ ||
+        (symbol >= 0xFF9E && symbol <= 0xFF9F) ||  // halfwidth sound marks
+        (symbol >= 0x1F1E6 && symbol <= 0x1F1FF) ||  // regional indicators
+        (symbol >= 0x1F3FB && symbol <= 0x1F3FF);  // emoji modifiers
+}
+
+/**
+ * \brief Shape a run without HarfBuzz if doing so provably gives
+ * the same result: every character maps to its nominal glyph
+ * and is advanced by that glyph's advance width.
+ * \return whether the run was trivial and has been shaped
+ */
+static bool shape_trivial(ASS_Shaper *shaper, ShapeHashKey *k,
+                          ShapeHashValue *v)
+{
+    if (k->direction != HB_DIRECTION_LTR || !is_simple_script(k->script))
+        return false;
+
+    LookupCoverageHashKey coverage_key = {
+        .font = k->font,
+        .face_index = k->face_index,
+        .features = k->features,
+    };
+    LookupCoverageHashValue *coverage =
+        ass_cache_get(shaper->lookup_coverage_cache, &coverage_key, NULL);
+    if (!coverage || !coverage->simple)
+        return false;
+
+    const uint32_t *text = (const uint32_t *) k->text.str + k->item_offset;
+    FT_Face face = k->font->faces[k->face_index];
+    hb_face_t *hb_face = hb_font_get_face(k->font->hb_fonts[k->face_index]);
+    hb_unicode_funcs_t *ufuncs = hb_unicode_funcs_get_default();
+
+    // check everything before allocating anything
+    for (unsigned i = 0; i < k->item_length; i++) {
+        if (needs_harfbuzz(ufuncs, text[i]))
+            return false;
+        unsigned glyph = ass_font_index_magic(face, text[i]);
+        if (glyph)
+            glyph = FT_Get_Char_Index(face, glyph);
+        if (!glyph || hb_set_has(coverage->glyphs, glyph) ||
+                hb_ot_layout_get_glyph_class(hb_face, glyph) ==
+                    HB_OT_LAYOUT_GLYPH_CLASS_MARK)
+            return false;
+    }
+
+    if (k->item_length &&
+            !(v->glyphs = malloc(k->item_length * sizeof(ShapedGlyph))))
+        return true;
+
+    struct ass_shaper_metrics_data metrics = {
+        .metrics_cache = shaper->metrics_cache,
+        .hash_key = {
+            .font = k->font,
+            .face_index = k->face_index,
+            .size = k->size,
+        },
+    };
+    for (unsigned i = 0; i < k->item_length; i++) {
+        ShapedGlyph *glyph = v->glyphs + i;
+        glyph->glyph_index = ass_font_index_magic(face, text[i]);
+        glyph->glyph_index = FT_Get_Char_Index(face, glyph->glyph_index);
+        glyph->cluster = k->item_offset + i;
+
+        FT_Glyph_Metrics *m =
+            get_cached_metrics(&metrics, text[i], glyph->glyph_index);
+        glyph->x_advance = m ? m->horiAdvance : 0;
+        glyph->y_advance = 0;
+        glyph->x_offset = glyph->y_offset = 0;
+    }
+    v->glyph_count = k->item_length;
+    v->valid = true;
+    return true;
+}
+
+/**
+ * \brief Expand a ShapeHashKey::features bitmask into a feature list.
+ */
+static void get_features(ASS_Shaper *shaper, unsigned mask,
+                         hb_feature_t features[NUM_FEATURES])
+{
+    assert(shaper->n_features == NUM_FEATURES);
+    memcpy(features, shaper->features, NUM_FEATURES * sizeof(hb_feature_t));
+    for (int i = 0; i < NUM_FEATURES; i++)
+        features[i].value = (mask >> i) & 1;
+}
+
+/**
+ * \brief Create a HarfBuzz shape plan for given segment properties
+ * and features. Construction function for the shape plan cache.
+ * \param priv shaper instance
+ */
+size_t ass_shape_plan_construct(void *key, void *value, void *priv)
+{
+    ShapePlanHashKey *k = key;
+    hb_shape_plan_t **v = value;
+    ASS_Shaper *shaper = priv;
+
+    hb_segment_properties_t props = HB_SEGMENT_PROPERTIES_DEFAULT;
+    props.direction = k->direction;
+    props.script = k->script;
+    props.language = k->language;
+
+    hb_feature_t features[NUM_FEATURES];
+    get_features(shaper, k->features, features);
+
+    hb_face_t *face = hb_font_get_face(k->font->hb_fonts[k->face_index]);
+    *v = hb_shape_plan_create_cached(face, &props,
+            features, NUM_FEATURES, NULL);
+    return 1;
+}
+
+/**
+ * \brief Shape a run of text with HarfBuzz and store the result.
+ * Construction function for the shape cache.
+ * \param priv shaper instance
+ */
+size_t ass_shape_construct(void *key, void *value, void *priv)
+{
+    ShapeHashKey *k = key;
+    ShapeHashValue *v = value;
+    ASS_Shaper *shaper = priv;
+
+    v->valid = false;
+    v->glyph_count = 0;
+    v->glyphs = NULL;
+
+    if (shape_trivial(shaper, k, v))
+        return 1;
+
+    hb_font_t *font = get_hb_font(shaper, k->font, k->face_index, k->size);
+    if (!font)
+        return 1;
+
+    ShapePlanHashKey plan_key = {
+        .font = k->font,
+        .face_index = k->face_index,
+        .script = k->script,
+        .language = k->language,
+        .direction = k->direction,
+        .features = k->features,
+    };
+    hb_shape_plan_t **plan = ass_cache_get(shaper->shape_plan_cache, &plan_key, shaper);
+    if (!plan || !*plan)
+        return 1;
+
+    hb_feature_t features[NUM_FEATURES];
+    get_features(shaper, k->features, features);
+
+    hb_buffer_t *buf = shaper->buf;
+    hb_buffer_pre_allocate(buf, k->item_length);
+    hb_buffer_add_utf32(buf, (const uint32_t *) k->text.str,
+            k->text.len / sizeof(uint32_t), k->item_offset, k->item_length);
+
+    hb_segment_properties_t props = HB_SEGMENT_PROPERTIES_DEFAULT;
+    props.direction = k->direction;
+    props.script = k->script;
+    props.language = k->language;
+    hb_buffer_set_segment_properties(buf, &props);
+
+    if (!hb_shape_plan_execute(*plan, font, buf, features, NUM_FEATURES)) {
+        hb_buffer_reset(buf);
+        return 1;
+    }
+
+    unsigned num_glyphs = hb_buffer_get_length(buf);
+    hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(buf, NULL);
+    hb_glyph_position_t *pos    = hb_buffer_get_glyph_positions(buf, NULL);
+
+    if (num_glyphs && !(v->glyphs = malloc(num_glyphs * sizeof(ShapedGlyph)))) {
+        hb_buffer_reset(buf);
+        return 1;
+    }
+    for (unsigned j = 0; j < num_glyphs; j++) {
+        ShapedGlyph *glyph = v->glyphs + j;
+        glyph->glyph_index = glyph_info[j].codepoint;
+        glyph->cluster     = glyph_info[j].cluster;
+        glyph->x_advance   = pos[j].x_advance;
+        glyph->y_advance   = pos[j].y_advance;
+        glyph->x_offset    = pos[j].x_offset;
+        glyph->y_offset    = pos[j].y_offset;
+    }
+    v->glyph_count = num_glyphs;
+    v->valid = true;
+
+    hb_buffer_reset(buf);
+    return 1;
+}
+
 /**
  * \brief Feed a run of shaped characters into the GlyphInfo array.
  *
  * \param glyphs GlyphInfo array
- * \param buf buffer of shaped run
+ * \param run shaped run
  * \param offset offset into GlyphInfo array
  */
 static void
-shape_harfbuzz_process_run(GlyphInfo *glyphs, hb_buffer_t *buf, int offset)
+shape_harfbuzz_process_run(GlyphInfo *glyphs, ShapeHashValue *run, int offset)
 {
-    int j;
-    int num_glyphs = hb_buffer_get_length(buf);
-    hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(buf, NULL);
-    hb_glyph_position_t *pos    = hb_buffer_get_glyph_positions(buf, NULL);
-
-    for (j = 0; j < num_glyphs; j++) {
-        unsigned idx = glyph_info[j].cluster + offset;
+    for (unsigned j = 0; j < run->glyph_count; j++) {
+        ShapedGlyph *glyph = run->glyphs + j;
+        unsigned idx = glyph->cluster + offset;
         GlyphInfo *info = glyphs + idx;
         GlyphInfo *root = info;
 
@@ -640,11 +1071,11 @@ shape_harfbuzz_process_run(GlyphInfo *glyphs, hb_buffer_t *buf, int offset)
 
         // set position and advance
         info->skip = false;
-        info->glyph_index = glyph_info[j].codepoint;
-        info->offset.x    = ass_lrint(pos[j].x_offset * info->scale_x);
-        info->offset.y    = ass_lrint(-pos[j].y_offset * info->scale_y);
-        info->advance.x   = ass_lrint(pos[j].x_advance * info->scale_x);
-        info->advance.y   = ass_lrint(-pos[j].y_advance * info->scale_y);
+        info->glyph_index = glyph->glyph_index;
+        info->offset.x    = ass_lrint(glyph->x_offset * info->scale_x);
+        info->offset.y    = ass_lrint(-glyph->y_offset * info->scale_y);
+        info->advance.x   = ass_lrint(glyph->x_advance * info->scale_x);
+        info->advance.y   = ass_lrint(-glyph->y_advance * info->scale_y);
 
         // accumulate advance in the root glyph
         root->cluster_advance.x += info->advance.x;
@@ -654,14 +1085,13 @@ shape_harfbuzz_process_run(GlyphInfo *glyphs, hb_buffer_t *buf, int offset)
 
 /**
  * \brief Shape event text with HarfBuzz. Full OpenType shaping.
+ * Shaped runs are looked up in and stored to the shape cache.
  * \param glyphs glyph clusters
  * \param len number of clusters
  */
 static bool shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
 {
     int i;
-    hb_buffer_t *buf = shaper->buf;
-    hb_segment_properties_t props = HB_SEGMENT_PROPERTIES_DEFAULT;
 
     // Initialize: skip all glyphs, this is undone later as needed
     for (i = 0; i < len; i++)
@@ -674,9 +1104,6 @@ static bool shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
         }
 
         int offset = i;
-        hb_font_t *font = get_hb_font(shaper, glyphs + offset);
-        if (!font)
-            return false;
         int run_id = glyphs[offset].shape_run_id;
         int level = shaper->emblevels[offset];
 
@@ -685,12 +1112,22 @@ static bool shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
                 level == shaper->emblevels[i + 1])
             i++;
 
-        hb_buffer_pre_allocate(buf, i - offset + 1);
+        ShapeHashKey key = {
+            .font = glyphs[offset].font,
+            .size = glyphs[offset].font_size,
+            .face_index = glyphs[offset].face_index,
+            .script = glyphs[offset].script,
+            .direction = FRIBIDI_LEVEL_IS_RTL(level) ?
+                HB_DIRECTION_RTL : HB_DIRECTION_LTR,
+            .item_length = i - offset + 1,
+        };
+        key.language = hb_shaper_get_run_language(shaper, key.script);
 
         int lead_context = 0, trail_context = 0;
         if (shaper->whole_text_layout) {
-            hb_buffer_add_utf32(buf, shaper->event_text, len,
-                    offset, i - offset + 1);
+            key.text.str = (const char *) shaper->event_text;
+            key.text.len = len * sizeof(FriBidiChar);
+            key.item_offset = offset;
         } else {
             if (offset > 0 && !glyphs[offset].starts_new_run &&
                     is_shaping_control(glyphs[offset - 1].symbol))
@@ -699,26 +1136,21 @@ static bool shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
                     is_shaping_control(glyphs[i + 1].symbol))
                 trail_context = 1;
 
-            hb_buffer_add_utf32(buf,
-                    shaper->event_text + offset - lead_context,
-                    i - offset + 1 + lead_context + trail_context,
-                    lead_context, i - offset + 1);
+            key.text.str = (const char *) (shaper->event_text + offset - lead_context);
+            key.text.len = (i - offset + 1 + lead_context + trail_context) *
+                sizeof(FriBidiChar);
+            key.item_offset = lead_context;
         }
 
-        props.direction = FRIBIDI_LEVEL_IS_RTL(level) ?
-            HB_DIRECTION_RTL : HB_DIRECTION_LTR;
-        props.script = glyphs[offset].script;
-        props.language  = hb_shaper_get_run_language(shaper, props.script);
-        hb_buffer_set_segment_properties(buf, &props);
-
         set_run_features(shaper, glyphs + offset);
-        hb_shape(font, buf, shaper->features, shaper->n_features);
+        key.features = get_feature_mask(shaper);
 
-        shape_harfbuzz_process_run(glyphs, buf,
-                shaper->whole_text_layout ? 0 : offset - lead_context);
-        hb_buffer_reset(buf);
+        ShapeHashValue *run = ass_cache_get(shaper->shape_cache, &key, shaper);
+        if (!run || !run->valid)
+            return false;
 
-        hb_font_destroy(font);
+        shape_harfbuzz_process_run(glyphs, run,
+                shaper->whole_text_layout ? 0 : offset - lead_context);
     }
 
     return true;
@@ -813,30 +1245,6 @@ void ass_shaper_set_kerning(ASS_Shaper *shaper, bool kern)
     shaper->features[KERN].value = kern;
 }
 
-/**
- * \brief Determine whether HarfBuzz ignores any font-provided glyph
- * for this Unicode codepoint and replaces it with a zero-width glyph.
- * Matches hb_unicode_funcs_t::is_default_ignorable in hb-unicode.hh.
- * The affected codepoints are a subset of Unicode's Default_Ignorable list.
- */
-static inline bool is_harfbuzz_ignorable(unsigned symbol) {
-    switch (symbol >> 8) {
-        case 0x00: return symbol == 0x00AD;
-        case 0x03: return symbol == 0x034F;
-        case 0x06: return symbol == 0x061C;
-        case 0x17: return symbol >= 0x17B4 && symbol <= 0x17B5;
-        case 0x18: return symbol >= 0x180B && symbol <= 0x180E;
-        case 0x20: return (symbol >= 0x200B && symbol <= 0x200F) ||
-                          (symbol >= 0x202A && symbol <= 0x202E) ||
-                          (symbol >= 0x2060 && symbol <= 0x206F);
-        case 0xFE: return (symbol >= 0xFE00 && symbol <= 0xFE0F) ||
-                          symbol == 0xFEFF;
-        case 0xFF: return symbol >= 0xFFF0 && symbol <= 0xFFF8;
-        case 0x1D1: return symbol >= 0x1D173 && symbol <= 0x1D17A;
-        default: return symbol >= 0xE0000 && symbol <= 0xE0FFF;
-    }
-}
-
 /**
   * \brief Remove all zero-width invisible characters from the text.
   */
@@ -866,7 +1274,7 @@ void ass_shaper_find_runs(ASS_Shaper *shaper, ASS_Renderer *render_priv,
         GlyphInfo *info = glyphs + i;
         if (!info->drawing_text.str && !info->skip) {
             // get font face and glyph index
-            ass_font_get_index(render_priv->fontselect, info->font,
+            ass_font_get_index(render_priv->fontdb->fontselect, info->font,
                     info->symbol, &info->face_index, &info->glyph_index);
         }
         if (i > 0) {
@@ -1014,12 +1422,25 @@ bool ass_shaper_shape(ASS_Shaper *shaper, TextInfo *text_info)
     }
 }
 
+/**
+ * \brief Use the caches of a renderer, e.g. after a font database change
+ */
+void ass_shaper_set_caches(ASS_Shaper *shaper, CacheStore *cache)
+{
+    shaper->face_size_metrics_cache = cache->face_size_metrics_cache;
+    shaper->metrics_cache = cache->metrics_cache;
+    shaper->hb_font_cache = cache->hb_font_cache;
+    shaper->shape_plan_cache = cache->shape_plan_cache;
+    shaper->shape_cache = cache->shape_cache;
+    shaper->lookup_coverage_cache = cache->lookup_coverage_cache;
+}
+
 /**
  * \brief Create a new shaper instance
  */
-ASS_Shaper *ass_shaper_new(Cache *metrics_cache, Cache *face_size_metrics_cache)
+ASS_Shaper *ass_shaper_new(CacheStore *cache)
 {
-    assert(metrics_cache);
+    assert(cache->metrics_cache);
 
     ASS_Shaper *shaper = calloc(1, sizeof(*shaper));
     if (!shaper)
@@ -1029,8 +1450,7 @@ ASS_Shaper *ass_shaper_new(Cache *metrics_cache, Cache *face_size_metrics_cache)
 
     if (!init_features(shaper))
         goto error;
-    shaper->face_size_metrics_cache = face_size_metrics_cache;
-    shaper->metrics_cache = metrics_cache;
+    ass_shaper_set_caches(shaper, cache);
 
     hb_font_funcs_t *funcs = shaper->font_funcs = hb_font_funcs_create();
     if (hb_font_funcs_is_immutable(funcs))
@@ -0,0 +1,526 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "ass_threading.h"
+
+#define MAX_THREADS  64
+
+
+typedef struct {
+    ParallelJobFunc *func;
+    void *priv;
+    int index;
+} ParallelJob;
+
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+
+#include <windows.h>
+
+typedef HANDLE ThreadHandle;
+
+int ass_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    DWORD count = info.dwNumberOfProcessors;
+    if (count > 0)
+        return count < MAX_THREADS ? count : MAX_THREADS;
+    return 1;
+}
+
+static DWORD WINAPI thread_entry(LPVOID arg)
+{
+    ParallelJob *job = arg;
+    job->func(job->priv, job->index);
+    return 0;
+}
+
+static bool thread_start(ThreadHandle *thread, ParallelJob *job)
+{
+    *thread = CreateThread(NULL, 0, thread_entry, job, 0, NULL);
+    return *thread;
+}
+
+static void thread_join(ThreadHandle thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+struct ass_mutex {
+    CRITICAL_SECTION cs;
+};
+
+ASS_Mutex *ass_mutex_create(void)
+{
+    ASS_Mutex *mutex = malloc(sizeof(*mutex));
+    if (mutex)
+        InitializeCriticalSection(&mutex->cs);
+    return mutex;
+}
+
+// critical sections can always be entered again by their owner
+ASS_Mutex *ass_mutex_create_recursive(void)
+{
+    return ass_mutex_create();
+}
+
+void ass_mutex_lock(ASS_Mutex *mutex)
+{
+    EnterCriticalSection(&mutex->cs);
+}
+
+void ass_mutex_unlock(ASS_Mutex *mutex)
+{
+    LeaveCriticalSection(&mutex->cs);
+}
+
+void ass_mutex_destroy(ASS_Mutex *mutex)
+{
+    if (!mutex)
+        return;
+    DeleteCriticalSection(&mutex->cs);
+    free(mutex);
+}
+
+struct ass_cond {
+    CONDITION_VARIABLE cv;
+};
+
+ASS_Cond *ass_cond_create(void)
+{
+    ASS_Cond *cond = malloc(sizeof(*cond));
+    if (cond)
+        InitializeConditionVariable(&cond->cv);
+    return cond;
+}
+
+void ass_cond_wait(ASS_Cond *cond, ASS_Mutex *mutex)
+{
+    SleepConditionVariableCS(&cond->cv, &mutex->cs, INFINITE);
+}
+
+void ass_cond_broadcast(ASS_Cond *cond)
+{
+    WakeAllConditionVariable(&cond->cv);
+}
+
+void ass_cond_destroy(ASS_Cond *cond)
+{
+    free(cond);
+}
+
+long ass_atomic_inc(volatile long *value)
+{
+    return InterlockedIncrement(value);
+}
+
+long ass_atomic_dec(volatile long *value)
+{
+    return InterlockedDecrement(value);
+}
+
+#elif CONFIG_PTHREAD
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_t ThreadHandle;
+
+int ass_cpu_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0)
+        return count < MAX_THREADS ? count : MAX_THREADS;
+#endif
+    return 1;
+}
+
+static void *thread_entry(void *arg)
+{
+    ParallelJob *job = arg;
+    job->func(job->priv, job->index);
+    return NULL;
+}
+
+static bool thread_start(ThreadHandle *thread, ParallelJob *job)
+{
+    return !pthread_create(thread, NULL, thread_entry, job);
+}
+
+static void thread_join(ThreadHandle thread)
+{
+    pthread_join(thread, NULL);
+}
+
+struct ass_mutex {
+    pthread_mutex_t mutex;
+};
+
+ASS_Mutex *ass_mutex_create(void)
+{
+    ASS_Mutex *mutex = malloc(sizeof(*mutex));
+    if (mutex && pthread_mutex_init(&mutex->mutex, NULL)) {
+        free(mutex);
+        return NULL;
+    }
+    return mutex;
+}
+
+ASS_Mutex *ass_mutex_create_recursive(void)
+{
+    pthread_mutexattr_t attr;
+    if (pthread_mutexattr_init(&attr))
+        return NULL;
+    ASS_Mutex *mutex = NULL;
+    if (!pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE))
+        mutex = malloc(sizeof(*mutex));
+    if (mutex && pthread_mutex_init(&mutex->mutex, &attr)) {
+        free(mutex);
+        mutex = NULL;
+    }
+    pthread_mutexattr_destroy(&attr);
+    return mutex;
+}
+
+void ass_mutex_lock(ASS_Mutex *mutex)
+{
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void ass_mutex_unlock(ASS_Mutex *mutex)
+{
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+void ass_mutex_destroy(ASS_Mutex *mutex)
+{
+    if (!mutex)
+        return;
+    pthread_mutex_destroy(&mutex->mutex);
+    free(mutex);
+}
+
+struct ass_cond {
+    pthread_cond_t cond;
+};
+
+ASS_Cond *ass_cond_create(void)
+{
+    ASS_Cond *cond = malloc(sizeof(*cond));
+    if (cond && pthread_cond_init(&cond->cond, NULL)) {
+        free(cond);
+        return NULL;
+    }
+    return cond;
+}
+
+void ass_cond_wait(ASS_Cond *cond, ASS_Mutex *mutex)
+{
+    pthread_cond_wait(&cond->cond, &mutex->mutex);
+}
+
+void ass_cond_broadcast(ASS_Cond *cond)
+{
+    pthread_cond_broadcast(&cond->cond);
+}
+
+void ass_cond_destroy(ASS_Cond *cond)
+{
+    if (!cond)
+        return;
+    pthread_cond_destroy(&cond->cond);
+    free(cond);
+}
+
+#if CONFIG_ATOMIC_BUILTINS
+long ass_atomic_inc(volatile long *value)
+{
+    return __atomic_add_fetch(value, 1, __ATOMIC_RELAXED);
+}
+
+long ass_atomic_dec(volatile long *value)
+{
+    // whoever drops the last reference must see all writes of the others
+    return __atomic_sub_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+#else
+// the compiler has no atomic builtins, a mutex provides the same ordering
+static pthread_mutex_t atomic_lock = PTHREAD_MUTEX_INITIALIZER;
+
+long ass_atomic_inc(volatile long *value)
+{
+    pthread_mutex_lock(&atomic_lock);
+    long result = ++*value;
+    pthread_mutex_unlock(&atomic_lock);
+    return result;
+}
+
+long ass_atomic_dec(volatile long *value)
+{
+    pthread_mutex_lock(&atomic_lock);
+    long result = --*value;
+    pthread_mutex_unlock(&atomic_lock);
+    return result;
+}
+#endif
+
+#else
+
+typedef int ThreadHandle;
+
+int ass_cpu_count(void)
+{
+    return 1;
+}
+
+static bool thread_start(ThreadHandle *thread, ParallelJob *job)
+{
+    return false;
+}
+
+static void thread_join(ThreadHandle thread)
+{
+}
+
+struct ass_mutex {
+    char unused;
+};
+
+ASS_Mutex *ass_mutex_create(void)
+{
+    return malloc(sizeof(ASS_Mutex));
+}
+
+ASS_Mutex *ass_mutex_create_recursive(void)
+{
+    return malloc(sizeof(ASS_Mutex));
+}
+
+void ass_mutex_lock(ASS_Mutex *mutex)
+{
+}
+
+void ass_mutex_unlock(ASS_Mutex *mutex)
+{
+}
+
+void ass_mutex_destroy(ASS_Mutex *mutex)
+{
+    free(mutex);
+}
+
+// without threads nobody else could wake up a waiter,
+// so callers never wait if ass_thread_create() fails
+struct ass_cond {
+    char unused;
+};
+
+ASS_Cond *ass_cond_create(void)
+{
+    return malloc(sizeof(ASS_Cond));
+}
+
+void ass_cond_wait(ASS_Cond *cond, ASS_Mutex *mutex)
+{
+}
+
+void ass_cond_broadcast(ASS_Cond *cond)
+{
+}
+
+void ass_cond_destroy(ASS_Cond *cond)
+{
+    free(cond);
+}
+
+long ass_atomic_inc(volatile long *value)
+{
+    return ++*value;
+}
+
+long ass_atomic_dec(volatile long *value)
+{
+    return --*value;
+}
+
+#endif
+
+
+struct ass_thread {
+    ThreadHandle handle;
+    ParallelJob job;
+};
+
+ASS_Thread *ass_thread_create(ParallelJobFunc *func, void *priv)
+{
+    ASS_Thread *thread = malloc(sizeof(*thread));
+    if (!thread)
+        return NULL;
+    thread->job = (ParallelJob) { func, priv, 0 };
+    if (!thread_start(&thread->handle, &thread->job)) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void ass_thread_join(ASS_Thread *thread)
+{
+    if (!thread)
+        return;
+    thread_join(thread->handle);
+    free(thread);
+}
+
+
+// jobs of one ass_thread_pool_run() call
+typedef struct parallel_batch {
+    ParallelJobFunc *func;
+    void *priv;
+    int count;
+    int next;       // first job not claimed yet
+    int finished;
+    struct parallel_batch *next_batch;
+} ParallelBatch;
+
+struct ass_thread_pool {
+    ASS_Mutex *lock;
+    ASS_Cond *cond;             // signaled when jobs are queued or finished
+    ParallelBatch *batches;     // with unclaimed jobs, oldest first
+    bool quit;
+
+    int n_threads;
+    ASS_Thread *threads[MAX_THREADS];
+};
+
+/**
+ * \brief Claim the next job of a batch and run it
+ * Called and returns with the pool locked.
+ */
+static void run_batch_job(ASS_ThreadPool *pool, ParallelBatch *batch)
+{
+    int index = batch->next++;
+    if (batch->next == batch->count) {
+        ParallelBatch **ptr = &pool->batches;
+        while (*ptr != batch)
+            ptr = &(*ptr)->next_batch;
+        *ptr = batch->next_batch;
+    }
+    ass_mutex_unlock(pool->lock);
+
+    batch->func(batch->priv, index);
+
+    ass_mutex_lock(pool->lock);
+    if (++batch->finished == batch->count)
+        ass_cond_broadcast(pool->cond);
+}
+
+static void pool_thread(void *priv, int index)
+{
+    ASS_ThreadPool *pool = priv;
+    ass_mutex_lock(pool->lock);
+    while (true) {
+        if (pool->batches)
+            run_batch_job(pool, pool->batches);
+        else if (pool->quit)
+            break;
+        else
+            ass_cond_wait(pool->cond, pool->lock);
+    }
+    ass_mutex_unlock(pool->lock);
+}
+
+ASS_ThreadPool *ass_thread_pool_create(int n_threads)
+{
+    ASS_ThreadPool *pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->lock = ass_mutex_create();
+    pool->cond = ass_cond_create();
+    if (!pool->lock || !pool->cond) {
+        ass_thread_pool_free(pool);
+        return NULL;
+    }
+
+    n_threads = n_threads < MAX_THREADS ? n_threads : MAX_THREADS;
+    for (; pool->n_threads < n_threads; pool->n_threads++) {
+        ASS_Thread *thread = ass_thread_create(pool_thread, pool);
+        if (!thread)
+            break;
+        pool->threads[pool->n_threads] = thread;
+    }
+    return pool;
+}
+
+void ass_thread_pool_free(ASS_ThreadPool *pool)
+{
+    if (!pool)
+        return;
+    if (pool->n_threads) {
+        ass_mutex_lock(pool->lock);
+        pool->quit = true;
+        ass_cond_broadcast(pool->cond);
+        ass_mutex_unlock(pool->lock);
+        for (int i = 0; i < pool->n_threads; i++)
+            ass_thread_join(pool->threads[i]);
+    }
+    ass_cond_destroy(pool->cond);
+    ass_mutex_destroy(pool->lock);
+    free(pool);
+}
+
+int ass_thread_pool_size(const ASS_ThreadPool *pool)
+{
+    return pool ? pool->n_threads : 0;
+}
+
+void ass_thread_pool_run(ASS_ThreadPool *pool,
+                         ParallelJobFunc *func, void *priv, int count)
+{
+    if (!pool || !pool->n_threads || count < 2) {
+        for (int i = 0; i < count; i++)
+            func(priv, i);
+        return;
+    }
+
+    ParallelBatch batch = { func, priv, count, 0, 0, NULL };
+    ass_mutex_lock(pool->lock);
+    ParallelBatch **last = &pool->batches;
+    while (*last)
+        last = &(*last)->next_batch;
+    *last = &batch;
+    ass_cond_broadcast(pool->cond);
+
+    // run jobs here as well instead of waiting idly
+    while (batch.next < batch.count)
+        run_batch_job(pool, &batch);
+    while (batch.finished < batch.count)
+        ass_cond_wait(pool->cond, pool->lock);
+    ass_mutex_unlock(pool->lock);
+}
+
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_THREADING_H
+#define LIBASS_THREADING_H
+
+/**
+ * \brief Number of processors available to this process, at least 1
+ */
+int ass_cpu_count(void);
+
+typedef void ParallelJobFunc(void *priv, int index);
+
+typedef struct ass_thread_pool ASS_ThreadPool;
+
+/**
+ * \brief Start threads that run jobs of ass_thread_pool_run() until freed
+ * \param n_threads number of threads besides those submitting jobs
+ * \return pool or NULL on allocation failure; the pool may have fewer
+ * threads or none, e.g. without threading support
+ */
+ASS_ThreadPool *ass_thread_pool_create(int n_threads);
+void ass_thread_pool_free(ASS_ThreadPool *pool);
+int ass_thread_pool_size(const ASS_ThreadPool *pool);
+
+/**
+ * \brief Run count independent jobs on the pool and wait for all of them
+ * \param func job function, called once with each index in [0, count)
+ * \param priv opaque data passed to func
+ * The calling thread runs jobs alongside the pool's threads, so every job
+ * gets executed even if the pool has no threads. Several threads may run
+ * jobs on the same pool at once. With a NULL pool, all jobs run in the
+ * calling thread.
+ */
+void ass_thread_pool_run(ASS_ThreadPool *pool,
+                         ParallelJobFunc *func, void *priv, int count);
+
+typedef struct ass_mutex ASS_Mutex;
+
+/**
+ * \brief Create a mutex, a no-op one if there is no threading support
+ * \return mutex or NULL on allocation failure
+ */
+ASS_Mutex *ass_mutex_create(void);
+/**
+ * \brief Create a mutex that its owner may lock again, once per unlock
+ * Condition variables may only wait on it while it is locked once.
+ */
+ASS_Mutex *ass_mutex_create_recursive(void);
+void ass_mutex_lock(ASS_Mutex *mutex);
+void ass_mutex_unlock(ASS_Mutex *mutex);
+void ass_mutex_destroy(ASS_Mutex *mutex);
+
+typedef struct ass_cond ASS_Cond;
+
+ASS_Cond *ass_cond_create(void);
+void ass_cond_wait(ASS_Cond *cond, ASS_Mutex *mutex);
+void ass_cond_broadcast(ASS_Cond *cond);
+void ass_cond_destroy(ASS_Cond *cond);
+
+/**
+ * \brief Atomically increment or decrement a counter
+ * \return the new value
+ */
+long ass_atomic_inc(volatile long *value);
+long ass_atomic_dec(volatile long *value);
+
+typedef struct ass_thread ASS_Thread;
+
+/**
+ * \brief Run func(priv, 0) in a new thread
+ * \return thread handle, NULL on failure or if there is no threading support
+ */
+ASS_Thread *ass_thread_create(ParallelJobFunc *func, void *priv);
+void ass_thread_join(ASS_Thread *thread);
+
+#endif /* LIBASS_THREADING_H */
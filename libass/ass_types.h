@@ -101,6 +101,7 @@ typedef struct ass_renderer ASS_Renderer;
 typedef struct render_priv ASS_RenderPriv;
 typedef struct parser_priv ASS_ParserPriv;
 typedef struct ass_library ASS_Library;
+typedef struct ass_font_database ASS_FontDatabase;
 
 /* ASS Style: line */
 typedef struct ass_style {
@@ -151,6 +152,9 @@ typedef struct ass_event {
     char *Effect;
     char *Text;
 
+    // Deprecated and reserved: no longer used by libass, as renderers keep
+    // their own per-event state (left in place for ABI-compatibility).
+    // Always NULL in tracks created by libass; do not set or read it.
     ASS_RenderPriv *render_priv;
 } ASS_Event;
 
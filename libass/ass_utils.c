@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include "ass_library.h"
 #include "ass.h"
@@ -271,3 +272,25 @@ int ass_lookup_style(ASS_Track *track, char *name)
             track, name, track->styles[i].Name);
     return i;
 }
+
+/**
+ * \brief Processor time of the calling thread, in seconds
+ * Unlike clock(), it leaves out the work of other threads, so it can
+ * measure what one constructor cost while workers render. Falls back
+ * to a monotonic clock, then to clock() where neither is available.
+ */
+double ass_thread_time(void)
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID) || defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+#ifdef CLOCK_MONOTONIC
+    if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+#endif
+    return (double) clock() / CLOCKS_PER_SEC;
+}
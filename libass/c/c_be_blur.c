@@ -19,6 +19,7 @@
 #include "config.h"
 #include "ass_compat.h"
 #include "ass_utils.h"
+#include "ass_bitmap_engine.h"
 
 #include <stddef.h>
 #include <stdint.h>
@@ -26,6 +27,55 @@
 
 #define ALIGNMENT  16
 
+static inline void be_blur_pre_row(uint8_t *buf, size_t width)
+{
+    for (size_t x = 0; x < width; x++) {
+        // This is equivalent to (value * 64 + 127) / 255 for all
+        // values from 0 to 256 inclusive. Assist vectorizing compilers
+        // by noting that all temporaries fit in 8 bits.
+        buf[x] = (uint8_t) ((buf[x] >> 1) + 1) >> 1;
+    }
+}
+
+static inline void be_blur_post_row(uint8_t *buf, size_t width)
+{
+    for (size_t x = 0; x < width; x++) {
+        // This is equivalent to (value * 255 + 32) / 64 for all values
+        // from 0 to 96 inclusive, and we only care about 0 to 64.
+        uint8_t value = buf[x];
+        buf[x] = (value << 2) - (value > 32);
+    }
+}
+/**
+ * \brief Scale bitmap values down to [0, 64] before be blur
+ * Pure C implementation.
+ */
+void ass_be_blur_pre_c(uint8_t *buf, ptrdiff_t stride,
+                       size_t width, size_t height)
+{
+    ASSUME(!((uintptr_t) buf % ALIGNMENT) && !(stride % ALIGNMENT));
+    ASSUME(width > 0 && height > 0);
+
+    uint8_t *end = buf + stride * height;
+    for (; buf < end; buf += stride)
+        be_blur_pre_row(buf, width);
+}
+
+/**
+ * \brief Scale bitmap values back up to [0, 255] after be blur
+ * Pure C implementation.
+ */
+void ass_be_blur_post_c(uint8_t *buf, ptrdiff_t stride,
+                        size_t width, size_t height)
+{
+    ASSUME(!((uintptr_t) buf % ALIGNMENT) && !(stride % ALIGNMENT));
+    ASSUME(width > 0 && height > 0);
+
+    uint8_t *end = buf + stride * height;
+    for (; buf < end; buf += stride)
+        be_blur_post_row(buf, width);
+}
+
 static inline uint16_t sliding_sum(uint16_t *prev, uint16_t next)
 {
     uint16_t sum = *prev + next;
@@ -33,6 +83,56 @@ static inline uint16_t sliding_sum(uint16_t *prev, uint16_t next)
     return sum;
 }
 
+// Horizontal [1, 2, 1] sums are computed directly rather than as running
+// sums, and inner pixels are processed in fixed-size blocks, so that rows
+// get vectorized even with cautious compiler cost models.
+static inline void be_blur_first_row(const uint8_t *restrict src, size_t width,
+                                     uint16_t *restrict col_pix_buf,
+                                     uint16_t *restrict col_sum_buf)
+{
+    col_pix_buf[0] = col_sum_buf[0] = 2 * src[0] + src[1];
+    size_t x = 1;
+    for (; x + ALIGNMENT < width; x += ALIGNMENT)
+        for (int k = 0; k < ALIGNMENT; k++)
+            col_pix_buf[x + k] = col_sum_buf[x + k] =
+                src[x + k - 1] + 2 * src[x + k] + src[x + k + 1];
+    for (; x < width - 1; x++)
+        col_pix_buf[x] = col_sum_buf[x] = src[x - 1] + 2 * src[x] + src[x + 1];
+    col_pix_buf[width - 1] = col_sum_buf[width - 1] = src[width - 2] + 2 * src[width - 1];
+}
+
+static inline uint8_t be_blur_pixel(uint16_t col_pix, uint16_t *col_pix_buf,
+                                    uint16_t *col_sum_buf)
+{
+    uint16_t col_sum = sliding_sum(col_pix_buf, col_pix);
+    return sliding_sum(col_sum_buf, col_sum) >> 4;
+}
+
+static inline void be_blur_row(uint8_t *restrict dst, const uint8_t *restrict src,
+                               size_t width, uint16_t *restrict col_pix_buf,
+                               uint16_t *restrict col_sum_buf)
+{
+    dst[0] = be_blur_pixel(2 * src[0] + src[1], &col_pix_buf[0], &col_sum_buf[0]);
+    size_t x = 1;
+    for (; x + ALIGNMENT < width; x += ALIGNMENT)
+        for (int k = 0; k < ALIGNMENT; k++)
+            dst[x + k] = be_blur_pixel(src[x + k - 1] + 2 * src[x + k] + src[x + k + 1],
+                                       &col_pix_buf[x + k], &col_sum_buf[x + k]);
+    for (; x < width - 1; x++)
+        dst[x] = be_blur_pixel(src[x - 1] + 2 * src[x] + src[x + 1],
+                               &col_pix_buf[x], &col_sum_buf[x]);
+    dst[width - 1] = be_blur_pixel(src[width - 2] + 2 * src[width - 1],
+                                   &col_pix_buf[width - 1], &col_sum_buf[width - 1]);
+}
+
+static inline void be_blur_last_row(uint8_t *restrict dst, size_t width,
+                                    const uint16_t *restrict col_pix_buf,
+                                    const uint16_t *restrict col_sum_buf)
+{
+    for (size_t x = 0; x < width; x++)
+        dst[x] = (col_sum_buf[x] + col_pix_buf[x]) >> 4;
+}
+
 /**
  * \brief Blur with [[1,2,1], [2,4,2], [1,2,1]] kernel
  * This blur is the same as the one employed by vsfilter.
@@ -48,33 +148,72 @@ void ass_be_blur_c(uint8_t *restrict buf, ptrdiff_t stride,
     uint16_t *col_pix_buf = tmp;
     uint16_t *col_sum_buf = tmp + stride;
 
-    {
-        size_t x = 1;
-        uint16_t sum = buf[x - 1];
-        for ( ; x < width; x++) {
-            uint16_t col_pix = sliding_sum(&sum, buf[x - 1] + buf[x]);
-            col_pix_buf[x - 1] = col_sum_buf[x - 1] = col_pix;
-        }
-        uint16_t col_pix = sum + buf[x - 1];
-        col_pix_buf[x - 1] = col_sum_buf[x - 1] = col_pix;
-    }
-
+    be_blur_first_row(buf, width, col_pix_buf, col_sum_buf);
     for (size_t y = 1; y < height; y++) {
-        uint8_t *dst = buf;
+        be_blur_row(buf, buf + stride, width, col_pix_buf, col_sum_buf);
         buf += stride;
+    }
+    be_blur_last_row(buf, width, col_pix_buf, col_sum_buf);
+}
+
+/**
+ * \brief Run passes [first, first + count) of a \be with given total passes
+ * Pass N consumes the row that pass N - 1 has just produced, so every row
+ * goes through all passes of the group while it is still in cache.
+ */
+static void be_blur_sweep(uint8_t *restrict buf, ptrdiff_t stride,
+                          size_t width, size_t height,
+                          int first, int count, int total,
+                          uint16_t *restrict tmp)
+{
+    // At step S, pass N of the group turns row (S - N) of its input
+    // into row (S - N - 1) of its output, both stored in place.
+    for (size_t step = 0; step < height + count; step++) {
+        if (!first && total > 1 && step < height)
+            be_blur_pre_row(buf + step * stride, width);
+
+        for (int pass = 0; pass < count && pass <= step; pass++) {
+            size_t y = step - pass;
+            if (y > height)
+                continue;
+
+            uint16_t *col_pix_buf = tmp + 2 * pass * stride;
+            uint16_t *col_sum_buf = col_pix_buf + stride;
+            uint8_t *row = buf + y * stride;
+            if (!y) {
+                be_blur_first_row(row, width, col_pix_buf, col_sum_buf);
+                continue;
+            }
+            if (y < height)
+                be_blur_row(row - stride, row, width, col_pix_buf, col_sum_buf);
+            else
+                be_blur_last_row(row - stride, width, col_pix_buf, col_sum_buf);
 
-        size_t x = 1;
-        uint16_t sum = buf[x - 1];
-        for ( ; x < width; x++) {
-            uint16_t col_pix = sliding_sum(&sum, buf[x - 1] + buf[x]);
-            uint16_t col_sum = sliding_sum(&col_pix_buf[x - 1], col_pix);
-            dst[x - 1] = sliding_sum(&col_sum_buf[x - 1], col_sum) >> 4;
+            if (first + pass == total - 2)
+                be_blur_post_row(row - stride, width);
         }
-        uint16_t col_pix = sum + buf[x - 1];
-        uint16_t col_sum = sliding_sum(&col_pix_buf[x - 1], col_pix);
-        dst[x - 1] = sliding_sum(&col_sum_buf[x - 1], col_sum) >> 4;
     }
+}
 
-    for (size_t x = 0; x < width; x++)
-        buf[x] = (col_sum_buf[x] + col_pix_buf[x]) >> 4;
+/**
+ * \brief Apply \be with several passes in as few sweeps over the bitmap
+ * as the cache allows
+ * Gives the same result as be_blur alone for one pass, and as be_blur_pre,
+ * (passes - 1) times be_blur, be_blur_post and be_blur for more passes.
+ * Pure C implementation.
+ * \param tmp buffer of (2 * ass_be_blur_group(stride, passes) * stride) elements
+ */
+void ass_be_blur_multi_c(uint8_t *restrict buf, ptrdiff_t stride,
+                         size_t width, size_t height, int passes,
+                         uint16_t *restrict tmp)
+{
+    ASSUME(!((uintptr_t) buf % ALIGNMENT) && !(stride % ALIGNMENT));
+    ASSUME(!((uintptr_t) tmp % ALIGNMENT));
+    ASSUME(width > 1 && height > 1 && passes > 0);
+
+    int group = ass_be_blur_group(stride, passes);
+    for (int first = 0; first < passes; first += group) {
+        int count = FFMIN(passes - first, group);
+        be_blur_sweep(buf, stride, width, height, first, count, passes, tmp);
+    }
 }
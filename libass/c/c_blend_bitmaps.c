@@ -88,3 +88,76 @@ void ass_mul_bitmaps_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
         src2 += src2_stride;
     }
 }
+
+/**
+ * \brief Remove the glyph body from its border
+ * Border pixels not exceeding the glyph are cleared,
+ * the rest are reduced by half of the glyph coverage.
+ */
+void ass_fix_outline_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                       const uint8_t *restrict src, ptrdiff_t src_stride,
+                       size_t width, size_t height)
+{
+    ASSUME(!(dst_stride % ALIGNMENT));
+    ASSUME(!(src_stride % ALIGNMENT));
+    ASSUME(width > 0 && height > 0);
+
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (size_t x = 0; x < width; x++) {
+            dst[x] = dst[x] > src[x] ? dst[x] - (src[x] >> 1) : 0;
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+/**
+ * \brief Shift bitmap right by a fraction of a pixel
+ * \param shift shift amount in 1/64 pixel, [0, 64)
+ */
+void ass_shift_horz_c(uint8_t *buf, ptrdiff_t stride,
+                      size_t width, size_t height, int shift)
+{
+    ASSUME(!((uintptr_t) buf % ALIGNMENT) && !(stride % ALIGNMENT));
+    ASSUME(width > 0 && height > 0);
+
+    uint8_t *end = buf + stride * height;
+    for (; buf < end; buf += stride) {
+        uint8_t carry = 0;
+        for (size_t x = 0; x < width - 1; x++) {
+            uint8_t part = buf[x] * shift >> 6;
+            buf[x] += carry - part;
+            carry = part;
+        }
+        buf[width - 1] += carry;
+    }
+}
+
+/**
+ * \brief Shift bitmap down by a fraction of a pixel
+ * \param shift shift amount in 1/64 pixel, [0, 64)
+ * Works row by row from the bottom up, so that the row above
+ * is still intact when the current one is processed.
+ */
+void ass_shift_vert_c(uint8_t *buf, ptrdiff_t stride,
+                      size_t width, size_t height, int shift)
+{
+    ASSUME(!((uintptr_t) buf % ALIGNMENT) && !(stride % ALIGNMENT));
+    ASSUME(width > 0 && height > 0);
+
+    if (height == 1)
+        return;
+
+    uint8_t *ptr = buf + stride * (height - 1);
+    for (size_t x = 0; x < width; x++)
+        ptr[x] += ptr[x - stride] * shift >> 6;
+    for (ptr -= stride; ptr > buf; ptr -= stride) {
+        for (size_t x = 0; x < width; x++) {
+            uint8_t part = ptr[x] * shift >> 6;
+            ptr[x] += (uint8_t) (ptr[x - stride] * shift >> 6) - part;
+        }
+    }
+    for (size_t x = 0; x < width; x++)
+        buf[x] -= buf[x] * shift >> 6;
+}
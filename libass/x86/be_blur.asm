@@ -234,3 +234,83 @@ INIT_XMM ssse3
 BE_BLUR
 INIT_YMM avx2
 BE_BLUR
+
+;------------------------------------------------------------------------------
+; BE_BLUR_PRE
+; void be_blur_pre(uint8_t *buf, ptrdiff_t stride,
+;                  size_t width, size_t height);
+;------------------------------------------------------------------------------
+
+%macro BE_BLUR_PRE 0
+cglobal be_blur_pre, 4,5,3
+    add r2, mmsize - 1
+    and r2, -mmsize
+    lea r0, [r0 + r2]
+    neg r2
+    imul r3, r1
+    add r3, r0
+    pxor m1, m1
+    pcmpeqb m2, m2
+    psrlw m2, 9
+    packuswb m2, m2
+
+.height_loop:
+    mov r4, r2
+.width_loop:
+    mova m0, [r0 + r4]
+    psrlw m0, 1
+    pand m0, m2
+    pavgb m0, m1
+    mova [r0 + r4], m0
+    add r4, mmsize
+    jnz .width_loop
+    add r0, r1
+    cmp r0, r3
+    jb .height_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+BE_BLUR_PRE
+INIT_YMM avx2
+BE_BLUR_PRE
+
+;------------------------------------------------------------------------------
+; BE_BLUR_POST
+; void be_blur_post(uint8_t *buf, ptrdiff_t stride,
+;                   size_t width, size_t height);
+;------------------------------------------------------------------------------
+
+%macro BE_BLUR_POST 0
+cglobal be_blur_post, 4,5,3
+    add r2, mmsize - 1
+    and r2, -mmsize
+    lea r0, [r0 + r2]
+    neg r2
+    imul r3, r1
+    add r3, r0
+    mov r4d, 0x21212121
+    BCASTD 2, r4d
+
+.height_loop:
+    mov r4, r2
+.width_loop:
+    mova m0, [r0 + r4]
+    pmaxub m1, m0, m2
+    pcmpeqb m1, m0
+    paddb m0, m0
+    paddb m0, m0
+    paddb m0, m1
+    mova [r0 + r4], m0
+    add r4, mmsize
+    jnz .width_loop
+    add r0, r1
+    cmp r0, r3
+    jb .height_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+BE_BLUR_POST
+INIT_YMM avx2
+BE_BLUR_POST
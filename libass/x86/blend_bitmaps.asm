@@ -1,5 +1,5 @@
 ;******************************************************************************
-;* blend_bitmaps.asm: SSE2 and AVX2 bitmap blending
+;* blend_bitmaps.asm: SSE2, AVX2 and AVX-512 bitmap blending
 ;******************************************************************************
 ;* Copyright (C) 2013 rcombs <rcombs@rcombs.me>
 ;*
@@ -273,3 +273,362 @@ INIT_XMM sse2
 MUL_BITMAPS
 INIT_YMM avx2
 MUL_BITMAPS
+
+;------------------------------------------------------------------------------
+; FIX_OUTLINE
+; void fix_outline(uint8_t *dst, ptrdiff_t dst_stride,
+;                  const uint8_t *src, ptrdiff_t src_stride,
+;                  size_t width, size_t height);
+;------------------------------------------------------------------------------
+
+%macro FIX_OUTLINE 0
+%if ARCH_X86_64
+cglobal fix_outline, 6,8,7
+    DECLARE_REG_TMP 7
+%else
+cglobal fix_outline, 5,7,7
+    DECLARE_REG_TMP 5
+%endif
+    lea r0, [r0 + r4]
+    lea r2, [r2 + r4]
+    neg r4
+    mov r6, r4
+    and r4, mmsize - 1
+    LOAD_EDGE_MASK 2, r4, t0
+    pxor m5, m5
+    pcmpeqb m6, m6
+    psrlw m6, 9
+    packuswb m6, m6
+%if !ARCH_X86_64
+    mov r5, r5m
+%endif
+    imul r5, r3
+    add r5, r2
+    mov r4, r6
+    jmp .loop_entry
+
+.width_loop:
+    psubusb m3, m0, m1
+    pcmpeqb m3, m5
+    psrlw m1, 1
+    pand m1, m6
+    psubusb m0, m1
+    pandn m3, m0
+    movu [r0 + r4 - mmsize], m3
+.loop_entry:
+    movu m0, [r0 + r4]
+    movu m1, [r2 + r4]
+    add r4, mmsize
+    jnc .width_loop
+    pand m1, m2
+    psubusb m3, m0, m1
+    pcmpeqb m3, m5
+    psrlw m1, 1
+    pand m1, m6
+    psubusb m0, m1
+    pandn m3, m0
+    movu [r0 + r4 - mmsize], m3
+    add r0, r1
+    add r2, r3
+    mov r4, r6
+    cmp r2, r5
+    jl .loop_entry
+    RET
+%endmacro
+
+INIT_XMM sse2
+FIX_OUTLINE
+INIT_YMM avx2
+FIX_OUTLINE
+
+;------------------------------------------------------------------------------
+; SHIFT_PART 1:m_dst, 2:m_src, 3:m_tmp, 4:m_zero, 5:m_shift
+; Calculate (src * shift) >> 6 for every byte
+;------------------------------------------------------------------------------
+
+%macro SHIFT_PART 5
+    punpckhbw m%3, m%2, m%4
+    punpcklbw m%1, m%2, m%4
+    pmullw m%3, m%5
+    pmullw m%1, m%5
+    psrlw m%3, 6
+    psrlw m%1, 6
+    packuswb m%1, m%3
+%endmacro
+
+;------------------------------------------------------------------------------
+; SHIFT_IN 1:m_dst, 2:m_src, 3:m_prev, 4:m_tmp
+; Shift bytes of m_src up by one, filling the lowest byte
+; with the highest byte of m_prev
+;------------------------------------------------------------------------------
+
+%macro SHIFT_IN 4
+%if mmsize == 32
+    vperm2i128 m%1, m%3, m%2, 0x21
+    vpalignr m%1, m%2, m%1, 15
+%else
+    PALIGNR m%1, m%2, m%3, m%4, 15
+%endif
+%endmacro
+
+;------------------------------------------------------------------------------
+; SHIFT_HORZ
+; void shift_horz(uint8_t *buf, ptrdiff_t stride,
+;                 size_t width, size_t height, int shift);
+;------------------------------------------------------------------------------
+
+%macro SHIFT_HORZ 0
+cglobal shift_horz, 5,7,8
+    BCASTW 5, r4d
+    pxor m6, m6
+    lea r5, [r2 - 1]
+    and r5, -mmsize
+    sub r2, r5
+    neg r2
+    lea r6, [r2 + mmsize + 1]
+    LOAD_EDGE_MASK 4, r6, r2
+    imul r3, r1
+    add r3, r0
+
+.height_loop:
+    pxor m3, m3
+    xor r6, r6
+    jmp .loop_entry
+
+.width_loop:
+    psubb m0, m1
+    SHIFT_IN 2, 1, 3, 7
+    paddb m0, m2
+    mova [r0 + r6 - mmsize], m0
+    mova m3, m1
+.loop_entry:
+    mova m0, [r0 + r6]
+    SHIFT_PART 1, 0, 2, 6, 5
+    add r6, mmsize
+    cmp r6, r5
+    jbe .width_loop
+    pand m1, m4
+    psubb m0, m1
+    SHIFT_IN 2, 1, 3, 7
+    paddb m0, m2
+    mova [r0 + r6 - mmsize], m0
+    add r0, r1
+    cmp r0, r3
+    jb .height_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+SHIFT_HORZ
+INIT_YMM avx2
+SHIFT_HORZ
+
+;------------------------------------------------------------------------------
+; SHIFT_VERT
+; void shift_vert(uint8_t *buf, ptrdiff_t stride,
+;                 size_t width, size_t height, int shift);
+;------------------------------------------------------------------------------
+
+%macro SHIFT_VERT 0
+cglobal shift_vert, 5,6,7
+    dec r3
+    jz .end
+    BCASTW 5, r4d
+    pxor m6, m6
+    add r2, mmsize - 1
+    and r2, -mmsize
+    lea r0, [r0 + r2]
+    neg r2
+    imul r3, r1
+    add r3, r0
+
+    ; rows are processed bottom-up,
+    ; so the row above is always intact
+    mov r4, r3
+    sub r3, r1
+    mov r5, r2
+.last_row_loop:
+    mova m1, [r3 + r5]
+    SHIFT_PART 2, 1, 3, 6, 5
+    mova m0, [r4 + r5]
+    paddb m0, m2
+    mova [r4 + r5], m0
+    add r5, mmsize
+    jnz .last_row_loop
+    cmp r3, r0
+    je .first_row
+
+.height_loop:
+    mov r4, r3
+    sub r3, r1
+    mov r5, r2
+.width_loop:
+    mova m0, [r4 + r5]
+    SHIFT_PART 1, 0, 3, 6, 5
+    psubb m0, m1
+    mova m1, [r3 + r5]
+    SHIFT_PART 2, 1, 3, 6, 5
+    paddb m0, m2
+    mova [r4 + r5], m0
+    add r5, mmsize
+    jnz .width_loop
+    cmp r3, r0
+    jne .height_loop
+
+.first_row:
+    mov r5, r2
+.first_row_loop:
+    mova m0, [r0 + r5]
+    SHIFT_PART 1, 0, 3, 6, 5
+    psubb m0, m1
+    mova [r0 + r5], m0
+    add r5, mmsize
+    jnz .first_row_loop
+.end:
+    RET
+%endmacro
+
+INIT_XMM sse2
+SHIFT_VERT
+INIT_YMM avx2
+SHIFT_VERT
+
+%if ARCH_X86_64
+
+;------------------------------------------------------------------------------
+; LOAD_TAIL_MASK 1:k_dst, 2:r_width, 3:r_offs, 4:r_tmp
+; Set r_offs to the offset of the last (possibly partial) vector of a row
+; and k_dst to the byte mask of its part within the row; clobbers r_width
+;------------------------------------------------------------------------------
+
+%macro LOAD_TAIL_MASK 4
+    lea %3, [%2 - 1]
+    and %3, -mmsize
+    sub %2, %3
+    mov %4, -1
+    bzhi %4, %4, %2
+    kmovq %1, %4
+%endmacro
+
+;------------------------------------------------------------------------------
+; MUL_BYTES 1:m_dst/src1, 2:m_src2, 3:m_tmp1, 4:m_tmp2, 5:m_zero, 6:m_words_255
+; dst = (src1 * src2 + 255) >> 8; clobbers m_src2
+;------------------------------------------------------------------------------
+
+%macro MUL_BYTES 6
+    punpckhbw %3, %1, %5
+    punpckhbw %4, %2, %5
+    punpcklbw %1, %5
+    punpcklbw %2, %5
+    pmullw %3, %4
+    pmullw %1, %2
+    paddw %3, %6
+    paddw %1, %6
+    psrlw %3, 8
+    psrlw %1, 8
+    packuswb %1, %3
+%endmacro
+
+;------------------------------------------------------------------------------
+; The AVX-512 versions handle the ends of rows with masked loads and stores,
+; so they neither read nor write past the width and do not need
+; more than the AVX2 bitmap alignment.
+;------------------------------------------------------------------------------
+
+INIT_ZMM avx512
+
+; void add_bitmaps(uint8_t *dst, ptrdiff_t dst_stride,
+;                  const uint8_t *src, ptrdiff_t src_stride,
+;                  size_t width, size_t height);
+
+cglobal add_bitmaps, 6,8,2
+    LOAD_TAIL_MASK k1, r4, r6, r7
+.height_loop:
+    xor r7, r7
+    test r6, r6
+    jz .tail
+.width_loop:
+    movu m0, [r0 + r7]
+    paddusb m0, [r2 + r7]
+    movu [r0 + r7], m0
+    add r7, mmsize
+    cmp r7, r6
+    jb .width_loop
+.tail:
+    vmovdqu8 m0{k1}{z}, [r0 + r7]
+    vmovdqu8 m1{k1}{z}, [r2 + r7]
+    paddusb m0, m1
+    vmovdqu8 [r0 + r7]{k1}, m0
+    add r0, r1
+    add r2, r3
+    dec r5
+    jnz .height_loop
+    RET
+
+; void imul_bitmaps(uint8_t *dst, ptrdiff_t dst_stride,
+;                   const uint8_t *src, ptrdiff_t src_stride,
+;                   size_t width, size_t height);
+
+cglobal imul_bitmaps, 6,8,7
+    LOAD_TAIL_MASK k1, r4, r6, r7
+    vpbroadcastd m5, [words_255]
+    pxor m4, m4
+    vpternlogd m6, m6, m6, 0xFF
+.height_loop:
+    xor r7, r7
+    test r6, r6
+    jz .tail
+.width_loop:
+    movu m0, [r0 + r7]
+    pxor m1, m6, [r2 + r7]
+    MUL_BYTES m0, m1, m2, m3, m4, m5
+    movu [r0 + r7], m0
+    add r7, mmsize
+    cmp r7, r6
+    jb .width_loop
+.tail:
+    vmovdqu8 m0{k1}{z}, [r0 + r7]
+    vmovdqu8 m1{k1}{z}, [r2 + r7]
+    pxor m1, m6
+    MUL_BYTES m0, m1, m2, m3, m4, m5
+    vmovdqu8 [r0 + r7]{k1}, m0
+    add r0, r1
+    add r2, r3
+    dec r5
+    jnz .height_loop
+    RET
+
+; void mul_bitmaps(uint8_t *dst, ptrdiff_t dst_stride,
+;                  const uint8_t *src1, ptrdiff_t src1_stride,
+;                  const uint8_t *src2, ptrdiff_t src2_stride,
+;                  size_t width, size_t height);
+
+cglobal mul_bitmaps, 8,10,6
+    LOAD_TAIL_MASK k1, r6, r8, r9
+    vpbroadcastd m5, [words_255]
+    pxor m4, m4
+.height_loop:
+    xor r9, r9
+    test r8, r8
+    jz .tail
+.width_loop:
+    movu m0, [r2 + r9]
+    movu m1, [r4 + r9]
+    MUL_BYTES m0, m1, m2, m3, m4, m5
+    movu [r0 + r9], m0
+    add r9, mmsize
+    cmp r9, r8
+    jb .width_loop
+.tail:
+    vmovdqu8 m0{k1}{z}, [r2 + r9]
+    vmovdqu8 m1{k1}{z}, [r4 + r9]
+    MUL_BYTES m0, m1, m2, m3, m4, m5
+    vmovdqu8 [r0 + r9]{k1}, m0
+    add r0, r1
+    add r2, r3
+    add r4, r5
+    dec r7
+    jnz .height_loop
+    RET
+
+%endif
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <time.h>
 #include "../libass/ass.h"
 
 typedef struct image_s {
@@ -89,10 +90,18 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    int frames = 0;
+    clock_t start = clock();
     while (tm < end_time) {
         ass_render_frame(ass_renderer, track, (int) (tm * 1000), NULL);
         tm += 1 / fps;
+        frames++;
     }
+    double elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+    printf("%d frames in %.3f s", frames, elapsed);
+    if (elapsed > 0)
+        printf(" (%.1f fps)", frames / elapsed);
+    printf("\n");
 
     ass_free_track(track);
     ass_renderer_done(ass_renderer);
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Rasterizer tile size benchmark.
+ *
+ * Fills synthetic glyph-like and drawing-like outlines of growing size
+ * with small and large tiles, and with the tile size picked by
+ * ass_rasterizer_select(), to show where large tiles start to pay off.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ass_utils.h"
+#include "ass_outline.h"
+#include "ass_bitmap_engine.h"
+#include "ass_rasterizer.h"
+
+#define RASTERIZER_PRECISION 16
+#define MAX_SIZE 1024
+#define MIN_TIME 0.02  // seconds per run
+#define RUN_COUNT 8
+
+typedef enum {
+    SHAPE_GLYPH,     // 'o'-like glyph of quadratic splines
+    SHAPE_POLYGON,   // drawing with a few long edges
+    SHAPE_SQUIGGLE,  // drawing with many short edges
+    SHAPE_COUNT
+} ShapeType;
+
+static const char *const shape_names[SHAPE_COUNT] = {
+    "glyph", "polygon", "squiggle"
+};
+
+static bool add_ellipse(ASS_Outline *outline, double cx, double cy,
+                        double rx, double ry, int n, bool reverse)
+{
+    double step = (reverse ? -2 : 2) * M_PI / n;
+    double k = 1 / cos(M_PI / n);
+    for (int i = 0; i < n; i++) {
+        double a = i * step;
+        ASS_Vector pt = { lrint(cx + rx * cos(a)), lrint(cy + ry * sin(a)) };
+        ASS_Vector cp = {
+            lrint(cx + k * rx * cos(a + step / 2)),
+            lrint(cy + k * ry * sin(a + step / 2))
+        };
+        if (!ass_outline_add_point(outline, pt, OUTLINE_QUADRATIC_SPLINE) ||
+                !ass_outline_add_point(outline, cp, 0))
+            return false;
+    }
+    ass_outline_close_contour(outline);
+    return true;
+}
+
+static bool add_star(ASS_Outline *outline, double c, double r,
+                     int n, double depth)
+{
+    for (int i = 0; i < n; i++) {
+        double a = 2 * M_PI * i / n;
+        double rr = r * (i % 2 ? 1 - depth : 1);
+        ASS_Vector pt = { lrint(c + rr * cos(a)), lrint(c + rr * sin(a)) };
+        if (!ass_outline_add_point(outline, pt, OUTLINE_LINE_SEGMENT))
+            return false;
+    }
+    ass_outline_close_contour(outline);
+    return true;
+}
+
+/**
+ * \brief Build an outline of given type fitting into size x size pixels
+ */
+static bool build_shape(ASS_Outline *outline, ShapeType type, int size)
+{
+    double c = size * 32.0, r = size * 30.0;
+    ass_outline_free(outline);
+    if (!ass_outline_alloc(outline, 64, 64))
+        return false;
+
+    switch (type) {
+    case SHAPE_GLYPH:
+        return add_ellipse(outline, c, c, r, r * 1.1, 8, false) &&
+            add_ellipse(outline, c, c, r * 0.7, r * 0.85, 8, true);
+    case SHAPE_POLYGON:
+        return add_star(outline, c, r, 10, 0.4);
+    case SHAPE_SQUIGGLE:
+        return add_star(outline, c, r, 512, 0.05);
+    default:
+        return false;
+    }
+}
+
+/**
+ * \brief Rasterize outline the same way ass_outline_to_bitmap() does
+ * \param tiles rasterizer functions to use, NULL to select automatically
+ * \param order out: tile order used
+ */
+static bool fill_outline(const BitmapEngine *engine, RasterizerData *rst,
+                         const ASS_Outline *outline,
+                         const RasterizerEngine *tiles,
+                         uint8_t *buf, int *order)
+{
+    if (!ass_rasterizer_set_outline(rst, outline, false))
+        return false;
+    if (!tiles)
+        tiles = ass_rasterizer_select(engine, rst);
+    *order = tiles->tile_order;
+
+    int32_t x_min = (rst->bbox.x_min -   1) >> 6;
+    int32_t y_min = (rst->bbox.y_min -   1) >> 6;
+    int32_t x_max = (rst->bbox.x_max + 127) >> 6;
+    int32_t y_max = (rst->bbox.y_max + 127) >> 6;
+    int mask = (1 << tiles->tile_order) - 1;
+    int32_t w = (x_max - x_min + mask) & ~mask;
+    int32_t h = (y_max - y_min + mask) & ~mask;
+    ptrdiff_t stride = ass_align(1 << engine->align_order, w);
+    return ass_rasterizer_fill(tiles, rst, buf, x_min, y_min, stride, h, stride);
+}
+
+/**
+ * \brief Measure time of one fill in microseconds
+ * Takes the best average of several runs to filter out system noise.
+ */
+static double bench(const BitmapEngine *engine, RasterizerData *rst,
+                    const ASS_Outline *outline, const RasterizerEngine *tiles,
+                    uint8_t *buf, int *order)
+{
+    double best = -1;
+    for (int run = 0; run < RUN_COUNT; run++) {
+        int count = 0;
+        double elapsed = 0;
+        clock_t start = clock();
+        for (int iter = 1; elapsed < MIN_TIME; iter *= 2) {
+            for (int i = 0; i < iter; i++)
+                if (!fill_outline(engine, rst, outline, tiles, buf, order))
+                    return -1;
+            count += iter;
+            elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+        }
+        double t = 1e6 * elapsed / count;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned flags = ASS_CPU_FLAG_ALL | ASS_FLAG_ADAPTIVE_TILES;
+    if (argc > 1 && !strcmp(argv[1], "--c"))
+        flags = ASS_CPU_FLAG_NONE | ASS_FLAG_ADAPTIVE_TILES;
+    else if (argc > 1) {
+        printf("usage: %s [--c]\n", argv[0] ? argv[0] : "rasterizer");
+        return 1;
+    }
+
+    BitmapEngine engine = ass_bitmap_engine_init(flags);
+    RasterizerData rst;
+    if (!ass_rasterizer_init(&engine, &rst, RASTERIZER_PRECISION)) {
+        printf("rasterizer init failed!\n");
+        return 1;
+    }
+
+    size_t buf_size = (size_t) (MAX_SIZE + 64) * (MAX_SIZE + 64);
+    uint8_t *buf = ass_aligned_alloc(1 << engine.align_order, buf_size, false);
+    ASS_Outline outline = {0};
+    if (!buf) {
+        printf("buffer allocation failed!\n");
+        return 1;
+    }
+
+    printf("%-9s %5s %9s %10s %10s %10s %5s\n", "shape", "size",
+           "segments", "tile16 us", "tile32 us", "auto us", "auto");
+    for (ShapeType type = 0; type < SHAPE_COUNT; type++) {
+        for (int size = 8; size <= MAX_SIZE; size += size / 2) {
+            if (!build_shape(&outline, type, size)) {
+                printf("outline construction failed!\n");
+                return 1;
+            }
+
+            int order;
+            if (!ass_rasterizer_set_outline(&rst, &outline, false)) {
+                printf("outline processing failed!\n");
+                return 1;
+            }
+            size_t n_segments = rst.size[0];
+
+            double t16 = bench(&engine, &rst, &outline, &engine.tile16, buf, &order);
+            double t32 = bench(&engine, &rst, &outline, &engine.tile32, buf, &order);
+            double t   = bench(&engine, &rst, &outline, NULL, buf, &order);
+            if (t16 < 0 || t32 < 0 || t < 0) {
+                printf("rasterization failed!\n");
+                return 1;
+            }
+            printf("%-9s %5d %9zu %10.2f %10.2f %10.2f %5d\n",
+                   shape_names[type], size, n_segments,
+                   t16, t32, t, 1 << order);
+        }
+    }
+
+    ass_outline_free(&outline);
+    ass_aligned_free(buf);
+    ass_rasterizer_done(&rst);
+    return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * HarfBuzz shaping benchmark.
+ *
+ * Shapes the runs of every event of a subtitle file (split at override
+ * blocks, like karaoke syllables) with ass_shaper_shape() alone, without
+ * rasterization or blending. The shaped run cache is emptied before each
+ * run so that HarfBuzz really shapes it. The "uncached" pass also empties
+ * the HarfBuzz font and shape plan caches, so that every run creates its
+ * sub-font and plan again as it did before those caches existed.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ass.h"
+#include "ass_utils.h"
+#include "ass_font.h"
+#include "ass_font_database.h"
+#include "ass_render.h"
+#include "ass_shaper.h"
+
+#define MIN_TIME 0.1  // seconds per run
+#define RUN_COUNT 8
+
+typedef struct {
+    GlyphInfo *glyphs;          // initial state of the event's glyphs
+    GlyphInfo *work;            // shaped copy
+    FriBidiChar *event_text;
+    int length;
+} Line;
+
+static void msg_callback(int level, const char *fmt, va_list va, void *data)
+{
+    if (level > 2)
+        return;
+    printf("libass: ");
+    vprintf(fmt, va);
+    printf("\n");
+}
+
+static ASS_Font *style_font(ASS_Renderer *renderer, const ASS_Style *style)
+{
+    ASS_FontDesc desc = {
+        .family = { style->FontName, strlen(style->FontName) },
+        .bold = style->Bold ? 700 : 400,
+        .italic = style->Italic ? 100 : 0,
+    };
+    return ass_font_new(renderer, &desc);
+}
+
+/**
+ * \brief Fill glyphs of the event text with override blocks left out,
+ * starting a new run after each of them
+ */
+static bool load_line(Line *line, const ASS_Event *event, ASS_Font *font,
+                      const ASS_Style *style)
+{
+    size_t size = strlen(event->Text) + 1;
+    line->glyphs = calloc(size, sizeof(GlyphInfo));
+    line->work = calloc(size, sizeof(GlyphInfo));
+    line->event_text = calloc(size, sizeof(FriBidiChar));
+    if (!line->glyphs || !line->work || !line->event_text)
+        return false;
+
+    bool new_run = true;
+    char *p = event->Text;
+    while (*p) {
+        if (*p == '{') {
+            char *end = strchr(p, '}');
+            if (!end)
+                break;
+            p = end + 1;
+            new_run = true;
+            continue;
+        }
+        GlyphInfo *info = &line->glyphs[line->length++];
+        info->symbol = ass_utf8_get_char(&p);
+        info->font = font;
+        info->font_size = style->FontSize;
+        info->scale_x = info->scale_y = info->scale_fix = 1;
+        info->starts_new_run = new_run;
+        new_run = false;
+    }
+    return true;
+}
+
+static void free_line(Line *line)
+{
+    free(line->glyphs);
+    free(line->work);
+    free(line->event_text);
+}
+
+/**
+ * \brief Shape every run of every line once
+ */
+static bool shape_lines(ASS_Renderer *renderer, ASS_Shaper *shaper,
+                        Line *lines, int n_lines, bool cached, int *n_runs)
+{
+    CacheStore *cache = &renderer->cache;
+    *n_runs = 0;
+    for (int i = 0; i < n_lines; i++) {
+        Line *line = &lines[i];
+        memcpy(line->work, line->glyphs, line->length * sizeof(GlyphInfo));
+        for (int start = 0, end; start < line->length; start = end) {
+            for (end = start + 1; end < line->length; end++)
+                if (line->work[end].starts_new_run)
+                    break;
+
+            ass_cache_empty(cache->shape_cache);
+            if (!cached) {
+                ass_cache_empty(cache->hb_font_cache);
+                ass_cache_empty(cache->shape_plan_cache);
+            }
+
+            TextInfo text_info = {
+                .glyphs = line->work + start,
+                .event_text = line->event_text,
+                .length = end - start,
+            };
+            ass_font_database_lock(renderer->fontdb);
+            ass_shaper_find_runs(shaper, renderer, text_info.glyphs,
+                                 text_info.length);
+            bool ok = ass_shaper_shape(shaper, &text_info);
+            ass_font_database_unlock(renderer->fontdb);
+            ass_shaper_cleanup(shaper, &text_info);
+            if (!ok)
+                return false;
+            ++*n_runs;
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief Measure time of shaping one run in microseconds
+ * Takes the best average of several runs to filter out system noise.
+ */
+static double bench(ASS_Renderer *renderer, ASS_Shaper *shaper,
+                    Line *lines, int n_lines, bool cached, int *n_runs)
+{
+    double best = -1;
+    for (int run = 0; run < RUN_COUNT; run++) {
+        int count = 0;
+        double elapsed = 0;
+        clock_t start = clock();
+        for (int iter = 1; elapsed < MIN_TIME; iter *= 2) {
+            for (int i = 0; i < iter; i++) {
+                if (!shape_lines(renderer, shaper, lines, n_lines,
+                                 cached, n_runs))
+                    return -1;
+                count += *n_runs;
+            }
+            elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+        }
+        double t = 1e6 * elapsed / count;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        printf("usage: %s <subtitle file>\n", argv[0] ? argv[0] : "shaper");
+        return 1;
+    }
+
+    ASS_Library *library = ass_library_init();
+    if (!library) {
+        printf("ass_library_init failed!\n");
+        return 1;
+    }
+    ass_set_message_cb(library, msg_callback, NULL);
+    ass_set_extract_fonts(library, 1);
+
+    int result = 1, n_runs;
+    Line *lines = NULL;
+    ASS_Font **fonts = NULL;
+    ASS_Shaper *shaper = NULL;
+    ASS_Renderer *renderer = NULL;
+    ASS_Track *track = ass_read_file(library, argv[1], NULL);
+    if (!track) {
+        printf("track init failed!\n");
+        goto end;
+    }
+
+    renderer = ass_renderer_init(library);
+    if (!renderer) {
+        printf("ass_renderer_init failed!\n");
+        goto end;
+    }
+    ass_set_fonts(renderer, NULL, "Sans", 1, NULL, 1);
+
+    shaper = ass_shaper_new(&renderer->cache);
+    lines = calloc(track->n_events, sizeof(Line));
+    fonts = calloc(track->n_styles, sizeof(ASS_Font *));
+    if (!shaper || !lines || !fonts) {
+        printf("allocation failed!\n");
+        goto end;
+    }
+    ass_shaper_set_level(shaper, ASS_SHAPING_COMPLEX);
+    ass_shaper_set_kerning(shaper, track->Kerning);
+    ass_shaper_set_language(shaper, track->Language);
+
+    for (int i = 0; i < track->n_events; i++) {
+        int style = track->events[i].Style;
+        if (!fonts[style])
+            fonts[style] = style_font(renderer, &track->styles[style]);
+        if (!fonts[style]) {
+            printf("font selection failed!\n");
+            goto end;
+        }
+        if (!load_line(&lines[i], &track->events[i], fonts[style],
+                       &track->styles[style])) {
+            printf("allocation failed!\n");
+            goto end;
+        }
+    }
+
+    double uncached = bench(renderer, shaper, lines, track->n_events,
+                            false, &n_runs);
+    double cached = bench(renderer, shaper, lines, track->n_events,
+                          true, &n_runs);
+    if (uncached < 0 || cached < 0) {
+        printf("shaping failed!\n");
+        goto end;
+    }
+    printf("%d events, %d runs\n", track->n_events, n_runs);
+    printf("uncached: %8.2f us per run\n", uncached);
+    printf("cached:   %8.2f us per run (%.2fx)\n", cached, uncached / cached);
+    result = 0;
+
+end:
+    if (lines) {
+        for (int i = 0; i < track->n_events; i++)
+            free_line(&lines[i]);
+        free(lines);
+    }
+    if (fonts) {
+        for (int i = 0; i < track->n_styles; i++)
+            if (fonts[i])
+                ass_cache_dec_ref(fonts[i]);
+        free(fonts);
+    }
+    if (shaper)
+        ass_shaper_free(shaper);
+    if (renderer)
+        ass_renderer_done(renderer);
+    if (track)
+        ass_free_track(track);
+    ass_library_done(library);
+    return result;
+}